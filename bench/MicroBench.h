@@ -0,0 +1,299 @@
+/**
+ * @file MicroBench.h
+ * @brief Small in-tree microbenchmark harness behind `make bench`
+ *
+ * A benchmark is a function that performs n operations. The harness doubles
+ * n until one batch takes at least the target batch time, runs one batch to
+ * warm up, then times a fixed number of batches. Each batch yields one ns/op
+ * sample; the mean and the 50th, 90th and 99th percentiles are taken over
+ * the samples. Allocations are counted by the replacement operator new that
+ * the benchmark program installs with MICROBENCH_COUNT_ALLOCATIONS, so
+ * memory from malloc or mmap (arenas, shadow memory) is not included.
+ */
+
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace microbench
+{
+
+/// Operator new calls since program start, from every thread.
+inline std::atomic<std::uint64_t> &allocations()
+{
+    static std::atomic<std::uint64_t> count(0);
+    return count;
+}
+
+struct Options
+{
+    std::string filter;       ///< Only benchmarks whose name contains this
+    std::string json;         ///< File the results are written to, if set
+    int samples = 100;        ///< Timed batches per benchmark
+    double batchUs = 50.0;    ///< Minimum duration of one batch
+};
+
+struct Result
+{
+    std::string name;
+    std::uint64_t ops;        ///< Operations in the timed batches
+    double mean;              ///< ns/op over all timed batches
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double allocsPerOp;
+};
+
+/**
+ * @class Suite
+ * @brief Ordered list of benchmarks with optional per-benchmark set-up and tear-down
+ *
+ * setUp runs before calibration and tearDown after the last batch, both
+ * untimed. A benchmark's run function must be callable repeatedly with any n.
+ */
+class Suite
+{
+public:
+    typedef std::function<void(std::uint64_t n)> RunFn;
+    typedef std::function<void()> HookFn;
+
+    void add(const std::string &name, RunFn run, HookFn setUp = HookFn(), HookFn tearDown = HookFn())
+    {
+        Entry e;
+        e.name = name;
+        e.run = run;
+        e.setUp = setUp;
+        e.tearDown = tearDown;
+        entries.push_back(e);
+    }
+
+    std::vector<Result> runAll(const Options &options) const
+    {
+        std::vector<Result> results;
+        std::printf("%-44s %12s %10s %10s %10s %10s %10s\n", "benchmark", "ops", "ns/op", "p50", "p90", "p99",
+                    "allocs/op");
+        for (const Entry &e : entries)
+        {
+            if (e.name.find(options.filter) == std::string::npos)
+            {
+                continue;
+            }
+            if (e.setUp)
+            {
+                e.setUp();
+            }
+            Result r = measure(e, options);
+            if (e.tearDown)
+            {
+                e.tearDown();
+            }
+            std::printf("%-44s %12llu %10.1f %10.1f %10.1f %10.1f %10.3f\n", r.name.c_str(),
+                        static_cast<unsigned long long>(r.ops), r.mean, r.p50, r.p90, r.p99, r.allocsPerOp);
+            std::fflush(stdout);
+            results.push_back(r);
+        }
+        return results;
+    }
+
+private:
+    struct Entry
+    {
+        std::string name;
+        RunFn run;
+        HookFn setUp;
+        HookFn tearDown;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    static double timeBatch(const Entry &e, std::uint64_t n)
+    {
+        auto start = Clock::now();
+        e.run(n);
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    static double percentile(const std::vector<double> &sorted, double q)
+    {
+        std::size_t rank = static_cast<std::size_t>(std::ceil(q * sorted.size()));
+        return sorted[rank ? rank - 1 : 0];
+    }
+
+    static Result measure(const Entry &e, const Options &options)
+    {
+        std::uint64_t n = 1;
+        while (timeBatch(e, n) < options.batchUs * 1000.0 && n < (std::uint64_t(1) << 30))
+        {
+            n *= 2;
+        }
+        timeBatch(e, n);
+
+        std::vector<double> samples;
+        samples.reserve(options.samples);
+        double totalNs = 0;
+        std::uint64_t allocationsBefore = allocations().load(std::memory_order_relaxed);
+        for (int s = 0; s < options.samples; ++s)
+        {
+            double ns = timeBatch(e, n);
+            totalNs += ns;
+            samples.push_back(ns / n);
+        }
+        std::uint64_t allocated = allocations().load(std::memory_order_relaxed) - allocationsBefore;
+        std::sort(samples.begin(), samples.end());
+
+        Result r;
+        r.name = e.name;
+        r.ops = n * samples.size();
+        r.mean = totalNs / r.ops;
+        r.min = samples.front();
+        r.p50 = percentile(samples, 0.50);
+        r.p90 = percentile(samples, 0.90);
+        r.p99 = percentile(samples, 0.99);
+        r.allocsPerOp = static_cast<double>(allocated) / r.ops;
+        return r;
+    }
+
+    std::vector<Entry> entries;
+};
+
+/**
+ * @class FixtureSlot
+ * @brief Holds at most one T, in cache-line aligned memory
+ *
+ * Detector objects have over-aligned members, which operator new does not
+ * honour before C++17, so fixtures are created here in set-up hooks.
+ */
+template <typename T>
+class FixtureSlot
+{
+public:
+    FixtureSlot() : object(nullptr) {}
+    ~FixtureSlot() { reset(); }
+    FixtureSlot(const FixtureSlot &) = delete;
+    FixtureSlot &operator=(const FixtureSlot &) = delete;
+
+    template <typename... Args>
+    void emplace(Args... args)
+    {
+        reset();
+        void *memory = nullptr;
+        if (posix_memalign(&memory, 64, sizeof(T)) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        object = new (memory) T(args...);
+    }
+
+    void reset()
+    {
+        if (object)
+        {
+            object->~T();
+            std::free(object);
+            object = nullptr;
+        }
+    }
+
+    T &operator*() const { return *object; }
+    T *operator->() const { return object; }
+
+private:
+    T *object;
+};
+
+/// Writes results and run parameters as JSON. Returns false if the file cannot be written.
+inline bool writeJson(const std::string &path, const Options &options, const std::vector<Result> &results)
+{
+    std::FILE *out = std::fopen(path.c_str(), "w");
+    if (!out)
+    {
+        return false;
+    }
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    std::fprintf(out, "{\n  \"context\": {\n");
+    std::fprintf(out, "    \"date\": \"%s\",\n", date);
+    std::fprintf(out, "    \"compiler\": \"%s\",\n", __VERSION__);
+    std::fprintf(out, "    \"samples\": %d,\n", options.samples);
+    std::fprintf(out, "    \"batch_us\": %.1f\n  },\n", options.batchUs);
+    std::fprintf(out, "  \"benchmarks\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const Result &r = results[i];
+        std::fprintf(out,
+                     "    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.2f, \"min\": %.2f, \"p50\": %.2f, "
+                     "\"p90\": %.2f, \"p99\": %.2f, \"allocs_per_op\": %.4f}%s\n",
+                     r.name.c_str(), static_cast<unsigned long long>(r.ops), r.mean, r.min, r.p50, r.p90, r.p99,
+                     r.allocsPerOp, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    return std::fclose(out) == 0;
+}
+
+/// Parses --filter=, --json=, --samples= and --batch-us=. Returns false on an unknown argument.
+inline bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.compare(0, 9, "--filter=") == 0)
+        {
+            options.filter = value;
+        }
+        else if (arg.compare(0, 7, "--json=") == 0)
+        {
+            options.json = value;
+        }
+        else if (arg.compare(0, 10, "--samples=") == 0)
+        {
+            options.samples = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg.compare(0, 11, "--batch-us=") == 0)
+        {
+            options.batchUs = std::atof(value.c_str());
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace microbench
+
+#ifdef MICROBENCH_COUNT_ALLOCATIONS
+// Kept out of line so the compiler does not pair inlined malloc/free calls
+// with the library's new/delete and warn about a mismatch.
+__attribute__((noinline)) void *operator new(std::size_t size)
+{
+    microbench::allocations().fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+#endif
+
+#endif // MICROBENCH_H
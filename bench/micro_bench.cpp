@@ -0,0 +1,287 @@
+/**
+ * @file micro_bench.cpp
+ * @brief Per-event cost of the detector callbacks, run by `make bench`
+ *
+ * Benchmarks, each under both policies (verbose/ and production/):
+ * - access/<State>: onSharedVariableAccess on a variable put into State
+ *   just before the access. Two threads take turns, so the access is
+ *   checked against the other thread's. Both hold a common lock, so no race
+ *   is reported.
+ * - access/race: the same without the common lock; every access is a
+ *   repeat of one race and only counted.
+ * - access/Shared+latency: access/Shared with latency tracking on
+ * - lock/acquire_release and lock/acquire_release_bound: one
+ *   onLockAcquire and onLockRelease pair, without and with a bound variable
+ * - barrier/<n>_threads: one barrierWait crossing of n threads
+ * And once, since they do not depend on the policy:
+ * - lockset/has_common_lock/<n>: LocksetTable::hasCommonLock on two
+ *   disjoint n-lock sets (memoized, as the detector calls it)
+ * - lockset/sorted/<n> and lockset/bitset/<n>: the unmemoized kernels
+ *
+ * Usage: ./bench/micro_bench [--filter=substring] [--json=file] [--samples=n] [--batch-us=us]
+ */
+
+#define MICROBENCH_COUNT_ALLOCATIONS
+#include "MicroBench.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include "../include/Lock.h"
+#include "../include/Lockset.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+/// Two registered threads, a lock both hold and a registered variable.
+template <typename Policy>
+struct AccessFixture
+{
+    BasicDataRaceDetector<Policy> drd;
+    Thread threads[2];
+    Lock common;
+    SharedVariable var;
+
+    explicit AccessFixture(bool shareLock) : threads{Thread(1), Thread(2)}, common(1), var("bench")
+    {
+        drd.locksetMainStart();
+        for (Thread &t : threads)
+        {
+            drd.registerThread(&t);
+            if (shareLock)
+            {
+                // Only the locksets matter to the check, not who owns the lock.
+                t.template acquireLock<Policy>(&common, true);
+            }
+        }
+        drd.registerSharedVariable(&var);
+    }
+};
+
+template <typename Policy>
+void addAccess(microbench::Suite &suite, const std::string &prefix, const std::string &name, State state,
+               bool shareLock, bool timed = false)
+{
+    std::shared_ptr<microbench::FixtureSlot<AccessFixture<Policy>>> f(new microbench::FixtureSlot<AccessFixture<Policy>>());
+    suite.add(prefix + "access/" + name,
+              [f, state](std::uint64_t n)
+              {
+                  AccessFixture<Policy> &x = **f;
+                  for (std::uint64_t i = 0; i < n; ++i)
+                  {
+                      x.var.setState(state);
+                      x.drd.onSharedVariableAccess(&x.threads[i & 1], &x.var, AccessType::WRITE);
+                  }
+              },
+              [f, shareLock, timed]
+              {
+                  f->emplace(shareLock);
+                  (*f)->drd.setLatencyTracking(timed);
+              },
+              [f] { f->reset(); });
+}
+
+template <typename Policy>
+void addLock(microbench::Suite &suite, const std::string &prefix, bool bound)
+{
+    std::shared_ptr<microbench::FixtureSlot<AccessFixture<Policy>>> f(new microbench::FixtureSlot<AccessFixture<Policy>>());
+    suite.add(prefix + (bound ? "lock/acquire_release_bound" : "lock/acquire_release"),
+              [f, bound](std::uint64_t n)
+              {
+                  AccessFixture<Policy> &x = **f;
+                  Lock *l = &x.common;
+                  for (std::uint64_t i = 0; i < n; ++i)
+                  {
+                      if (bound)
+                      {
+                          x.drd.onLockAcquire(&x.threads[0], l, true, &x.var);
+                          x.drd.onLockRelease(&x.threads[0], l, &x.var);
+                      }
+                      else
+                      {
+                          x.drd.onLockAcquire(&x.threads[0], l, true);
+                          x.drd.onLockRelease(&x.threads[0], l);
+                      }
+                  }
+              },
+              [f] { f->emplace(false); },
+              [f] { f->reset(); });
+}
+
+/// A detector, its barrier and helper threads that cross it until stopped.
+template <typename Policy>
+struct BarrierFixture
+{
+    BasicDataRaceDetector<Policy> drd;
+    pthread_barrier_t barrier;
+    std::uint64_t crossings;
+    std::atomic<std::uint64_t> stopAfter;
+    std::vector<std::thread> helpers;
+
+    explicit BarrierFixture(int threads) : crossings(0), stopAfter(~std::uint64_t(0))
+    {
+        drd.locksetMainStart();
+        drd.initializeBarrier(&barrier, nullptr, threads);
+        for (int i = 1; i < threads; ++i)
+        {
+            helpers.emplace_back([this]
+            {
+                for (std::uint64_t crossed = 1;; ++crossed)
+                {
+                    drd.barrierWait();
+                    if (crossed == stopAfter.load())
+                    {
+                        return;
+                    }
+                }
+            });
+        }
+    }
+
+    void cross()
+    {
+        drd.barrierWait();
+        ++crossings;
+    }
+
+    ~BarrierFixture()
+    {
+        // A helper may read stopAfter before or after the last timed crossing,
+        // so it names the crossing to stop after rather than being a flag.
+        stopAfter.store(crossings + 1);
+        cross();
+        for (auto &h : helpers)
+        {
+            h.join();
+        }
+    }
+};
+
+template <typename Policy>
+void addBarrier(microbench::Suite &suite, const std::string &prefix, int threads)
+{
+    std::shared_ptr<microbench::FixtureSlot<BarrierFixture<Policy>>> f(new microbench::FixtureSlot<BarrierFixture<Policy>>());
+    suite.add(prefix + "barrier/" + std::to_string(threads) + "_threads",
+              [f](std::uint64_t n)
+              {
+                  for (std::uint64_t i = 0; i < n; ++i)
+                  {
+                      (*f)->cross();
+                  }
+              },
+              [f, threads] { f->emplace(threads); },
+              [f] { f->reset(); });
+}
+
+template <typename Policy>
+void addDetector(microbench::Suite &suite, const std::string &prefix)
+{
+    addAccess<Policy>(suite, prefix, "Virgin", State::Virgin, true);
+    addAccess<Policy>(suite, prefix, "Initializing", State::Initializing, true);
+    addAccess<Policy>(suite, prefix, "Exclusive", State::Exclusive, true);
+    addAccess<Policy>(suite, prefix, "Shared", State::Shared, true);
+    addAccess<Policy>(suite, prefix, "SharedModified", State::SharedModified, true);
+    addAccess<Policy>(suite, prefix, "Clean", State::Clean, true);
+    addAccess<Policy>(suite, prefix, "race", State::SharedModified, false);
+    addAccess<Policy>(suite, prefix, "Shared+latency", State::Shared, true, true);
+    addLock<Policy>(suite, prefix, false);
+    addLock<Policy>(suite, prefix, true);
+    addBarrier<Policy>(suite, prefix, 2);
+    addBarrier<Policy>(suite, prefix, 4);
+}
+
+/// Two disjoint interned locksets of n locks each, alternating lock indices.
+struct LocksetPair
+{
+    std::vector<std::unique_ptr<Lock>> locks;
+    const Lockset *a;
+    const Lockset *b;
+
+    explicit LocksetPair(int n)
+    {
+        std::vector<Lock *> even, odd;
+        for (int i = 0; i < 2 * n; ++i)
+        {
+            locks.emplace_back(new Lock(i));
+            (i % 2 ? odd : even).push_back(locks.back().get());
+        }
+        a = LocksetTable::instance().intern(even);
+        b = LocksetTable::instance().intern(odd);
+    }
+};
+
+void addLockset(microbench::Suite &suite, int n)
+{
+    // Locks are never reused, so the sets are built once for all three.
+    std::shared_ptr<LocksetPair> p(new LocksetPair(n));
+    std::string size = std::to_string(n);
+    suite.add("lockset/has_common_lock/" + size, [p](std::uint64_t ops)
+    {
+        bool any = false;
+        for (std::uint64_t i = 0; i < ops; ++i)
+        {
+            any ^= LocksetTable::instance().hasCommonLock(p->a, p->b);
+        }
+        asm volatile("" : : "r"(any));
+    });
+    suite.add("lockset/sorted/" + size, [p](std::uint64_t ops)
+    {
+        bool any = false;
+        for (std::uint64_t i = 0; i < ops; ++i)
+        {
+            any ^= p->a->intersectsSorted(*p->b);
+        }
+        asm volatile("" : : "r"(any));
+    });
+    suite.add("lockset/bitset/" + size, [p](std::uint64_t ops)
+    {
+        bool any = false;
+        for (std::uint64_t i = 0; i < ops; ++i)
+        {
+            any ^= p->a->intersectsBitset(*p->b);
+        }
+        asm volatile("" : : "r"(any));
+    });
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    microbench::Options options;
+    if (!microbench::parseOptions(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--filter=substring] [--json=file] [--samples=n] [--batch-us=us]"
+                  << std::endl;
+        return 2;
+    }
+    Logger::setLevel(LogLevel::Off);
+
+    microbench::Suite suite;
+    addDetector<VerbosePolicy>(suite, "verbose/");
+    addDetector<ProductionPolicy>(suite, "production/");
+    for (int n : {1, 16, 64, 256, 1024})
+    {
+        addLockset(suite, n);
+    }
+
+    std::vector<microbench::Result> results = suite.runAll(options);
+    if (!options.json.empty())
+    {
+        if (!microbench::writeJson(options.json, options, results))
+        {
+            std::cerr << "Cannot write " << options.json << std::endl;
+            return 1;
+        }
+        std::cout << "Results written to " << options.json << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,505 @@
+/**
+ * @file stress.cpp
+ * @brief Configurable stress generator: throughput, peak RSS and recall against injected races
+ *
+ * Every thread runs a fixed number of critical sections. A section picks a
+ * guard lock, holds it for a number of accesses drawn from the lock-hold
+ * distribution, and each access reads or writes a random variable guarded
+ * by that lock (variable v is guarded by lock v % locks). With the race
+ * injection probability a section skips its lock, which breaks the locking
+ * discipline for every variable it touches. Threads cross a barrier every
+ * barrier-every sections.
+ *
+ * The access streams are a function of the seed and the thread id only, so
+ * once the detector has run they are replayed without it to find the true
+ * races: variables where, between two barriers, an unguarded access by one
+ * thread meets an access by another thread and at least one of the two is
+ * a write. Recall is the share of those variables the detector reported;
+ * reported variables without a true race are counted as false positives,
+ * and the program fails if they outnumber the true races found.
+ *
+ * The lockset engine misses races the replay counts. It does not check a
+ * variable until a second thread accesses it, so an unguarded access while
+ * the first thread owns it goes unseen. After a barrier it leaves variables
+ * Clean and reports no more races on them. Its false positives are reads
+ * of an Exclusive variable by a second thread holding none of the first
+ * thread's locks, which it reports although both accesses are reads. The
+ * hybrid engine also drops races ordered by a release and a later acquire
+ * of some lock, which the replay does not model.
+ *
+ * The race table is sized for the run (--race-slots, default four slots
+ * per variable) so that every reported variable is counted. If it still
+ * overflows, the program says so and recall is only a lower bound.
+ *
+ * Usage: ./bench/stress [--threads=8] [--variables=10000] [--locks=64]
+ *        [--sections=20000] [--reads=0.75] [--hold=uniform:4] [--race=0.001]
+ *        [--barrier-every=0] [--engine=lockset] [--latency=0] [--seed=1]
+ *        [--race-slots=4*variables]
+ *   --hold is fixed:N, uniform:N (1..N) or geometric:N (mean N).
+ *   --engine is lockset or hybrid.
+ *   --latency=1 also prints the latency percentiles of each callback.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+enum class HoldShape
+{
+    Fixed,
+    Uniform,
+    Geometric
+};
+
+struct Config
+{
+    int threads = 8;
+    int variables = 10000;
+    int locks = 64;
+    int sections = 20000;
+    double reads = 0.75;
+    HoldShape hold = HoldShape::Uniform;
+    int holdLength = 4;
+    double race = 0.001;
+    int barrierEvery = 0;
+    DetectorEngine engine = DetectorEngine::Lockset;
+    bool latency = false;
+    std::uint64_t seed = 1;
+    std::size_t raceSlots = 0;    ///< 0: four per variable
+};
+
+/// SplitMix64: small, fast and the same on every platform.
+struct Rng
+{
+    std::uint64_t state;
+
+    std::uint64_t next()
+    {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    std::uint32_t below(std::uint32_t n) { return static_cast<std::uint32_t>((next() >> 32) * n >> 32); }
+};
+
+struct Access
+{
+    std::uint32_t variable;
+    bool write;
+};
+
+struct Section
+{
+    std::uint32_t lock;
+    bool guarded;
+    std::vector<Access> accesses;
+};
+
+/// Draws thread id's sections; the detector run and the replay share it.
+class Workload
+{
+public:
+    Workload(const Config &config, int id) : config(config)
+    {
+        rng.state = config.seed * 0x100000001B3ull + static_cast<std::uint64_t>(id);
+    }
+
+    void next(Section &section)
+    {
+        section.lock = rng.below(config.locks);
+        section.guarded = rng.uniform() >= config.race;
+        section.accesses.clear();
+        int length = holdLength();
+        // Variables guarded by this lock: lock, lock + locks, lock + 2 * locks, ...
+        std::uint32_t group = (config.variables - section.lock + config.locks - 1) / config.locks;
+        for (int i = 0; i < length; ++i)
+        {
+            Access a;
+            a.variable = section.lock + rng.below(group) * config.locks;
+            a.write = rng.uniform() >= config.reads;
+            section.accesses.push_back(a);
+        }
+    }
+
+private:
+    int holdLength()
+    {
+        switch (config.hold)
+        {
+        case HoldShape::Fixed:
+            return config.holdLength;
+        case HoldShape::Uniform:
+            return 1 + static_cast<int>(rng.below(config.holdLength));
+        case HoldShape::Geometric:
+        default:
+        {
+            // Number of trials up to the first success with p = 1 / mean.
+            double u = 1.0 - rng.uniform();
+            double p = 1.0 / config.holdLength;
+            return p >= 1.0 ? 1 : 1 + static_cast<int>(std::log(u) / std::log(1.0 - p));
+        }
+        }
+    }
+
+    const Config &config;
+    Rng rng;
+};
+
+/// Up to two distinct thread ids; enough to tell whether some other thread is in the set.
+struct ThreadPair
+{
+    int first = -1;
+    int second = -1;
+
+    void add(int id)
+    {
+        if (first < 0)
+        {
+            first = id;
+        }
+        else if (first != id && second < 0)
+        {
+            second = id;
+        }
+    }
+    bool empty() const { return first < 0; }
+    bool distinct() const { return second >= 0; }
+};
+
+/// Whether some s in a and some u in b are different threads.
+bool differentPair(const ThreadPair &a, const ThreadPair &b)
+{
+    if (a.empty() || b.empty())
+    {
+        return false;
+    }
+    return a.distinct() || b.distinct() || a.first != b.first;
+}
+
+struct PhaseRecord
+{
+    ThreadPair all, writers, unguardedReaders, unguardedWriters;
+};
+
+/// Variables with a true race, found by replaying every thread's stream without the detector.
+std::vector<bool> trueRaces(const Config &config)
+{
+    std::vector<bool> racy(config.variables, false);
+    std::vector<std::unique_ptr<Workload>> workloads;
+    for (int id = 0; id < config.threads; ++id)
+    {
+        workloads.emplace_back(new Workload(config, id));
+    }
+    int phaseLength = config.barrierEvery > 0 ? config.barrierEvery : config.sections;
+    Section section;
+    for (int start = 0; start < config.sections; start += phaseLength)
+    {
+        std::vector<PhaseRecord> phase(config.variables);
+        int end = std::min(config.sections, start + phaseLength);
+        for (int id = 0; id < config.threads; ++id)
+        {
+            for (int s = start; s < end; ++s)
+            {
+                workloads[id]->next(section);
+                for (const Access &a : section.accesses)
+                {
+                    PhaseRecord &r = phase[a.variable];
+                    r.all.add(id);
+                    if (a.write)
+                    {
+                        r.writers.add(id);
+                    }
+                    if (!section.guarded)
+                    {
+                        (a.write ? r.unguardedWriters : r.unguardedReaders).add(id);
+                    }
+                }
+            }
+        }
+        for (int v = 0; v < config.variables; ++v)
+        {
+            const PhaseRecord &r = phase[v];
+            if (differentPair(r.unguardedWriters, r.all) || differentPair(r.unguardedReaders, r.writers))
+            {
+                racy[v] = true;
+            }
+        }
+    }
+    return racy;
+}
+
+bool parseHold(const std::string &value, Config &config)
+{
+    std::size_t colon = value.find(':');
+    std::string shape = value.substr(0, colon);
+    if (shape == "fixed")
+    {
+        config.hold = HoldShape::Fixed;
+    }
+    else if (shape == "uniform")
+    {
+        config.hold = HoldShape::Uniform;
+    }
+    else if (shape == "geometric")
+    {
+        config.hold = HoldShape::Geometric;
+    }
+    else
+    {
+        return false;
+    }
+    config.holdLength = colon == std::string::npos ? 1 : std::max(1, std::atoi(value.c_str() + colon + 1));
+    return true;
+}
+
+bool parseArgs(int argc, char **argv, Config &config)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        std::size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+        {
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (key == "threads")
+            config.threads = std::max(1, std::atoi(value.c_str()));
+        else if (key == "variables")
+            config.variables = std::max(1, std::atoi(value.c_str()));
+        else if (key == "locks")
+            config.locks = std::max(1, std::atoi(value.c_str()));
+        else if (key == "sections")
+            config.sections = std::max(1, std::atoi(value.c_str()));
+        else if (key == "reads")
+            config.reads = std::atof(value.c_str());
+        else if (key == "hold")
+        {
+            if (!parseHold(value, config))
+                return false;
+        }
+        else if (key == "race")
+            config.race = std::atof(value.c_str());
+        else if (key == "barrier-every")
+            config.barrierEvery = std::max(0, std::atoi(value.c_str()));
+        else if (key == "engine" && (value == "lockset" || value == "hybrid"))
+            config.engine = value == "hybrid" ? DetectorEngine::Hybrid : DetectorEngine::Lockset;
+        else if (key == "latency")
+            config.latency = std::atoi(value.c_str()) != 0;
+        else if (key == "seed")
+            config.seed = std::strtoull(value.c_str(), nullptr, 10);
+        else if (key == "race-slots")
+            config.raceSlots = std::strtoull(value.c_str(), nullptr, 10);
+        else
+            return false;
+    }
+    // Every variable needs a guard lock.
+    config.locks = std::min(config.locks, config.variables);
+    if (config.raceSlots == 0)
+    {
+        config.raceSlots = std::max<std::size_t>(RaceTable::kDefaultSlots, 4 * static_cast<std::size_t>(config.variables));
+    }
+    return true;
+}
+
+long peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Config config;
+    if (!parseArgs(argc, argv, config))
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [--threads=N] [--variables=N] [--locks=N] [--sections=N] [--reads=R]\n"
+                     "          [--hold=fixed:N|uniform:N|geometric:N] [--race=P] [--barrier-every=N]\n"
+                     "          [--engine=lockset|hybrid] [--latency=0|1] [--seed=N] [--race-slots=N]\n",
+                     argv[0]);
+        return 2;
+    }
+    Logger::setLevel(LogLevel::Off);
+
+    DataRaceDetector drd(config.raceSlots);
+    drd.setEngine(config.engine);
+    drd.setLatencyTracking(config.latency);
+    std::vector<std::unique_ptr<SharedVariable>> variables;
+    std::vector<std::unique_ptr<Lock>> locks;
+    std::unique_ptr<std::mutex[]> mutexes(new std::mutex[config.locks]);
+    for (int v = 0; v < config.variables; ++v)
+    {
+        variables.emplace_back(new SharedVariable("v" + std::to_string(v)));
+    }
+    for (int l = 0; l < config.locks; ++l)
+    {
+        locks.emplace_back(new Lock(l));
+    }
+    drd.locksetMainStart();
+    for (auto &v : variables)
+    {
+        drd.registerSharedVariable(v.get());
+    }
+    pthread_barrier_t barrier;
+    if (config.barrierEvery > 0)
+    {
+        drd.initializeBarrier(&barrier, nullptr, config.threads);
+    }
+
+    std::atomic<std::uint64_t> events(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int id = 0; id < config.threads; ++id)
+    {
+        workers.emplace_back([&, id]
+        {
+            drd.registerThread(id + 1);
+            Workload workload(config, id);
+            Section section;
+            std::uint64_t local = 0;
+            for (int s = 0; s < config.sections; ++s)
+            {
+                workload.next(section);
+                Lock *lock = locks[section.lock].get();
+                if (section.guarded)
+                {
+                    mutexes[section.lock].lock();
+                    drd.onLockAcquire(lock, true);
+                    local += 2;
+                }
+                for (const Access &a : section.accesses)
+                {
+                    drd.onSharedVariableAccess(variables[a.variable].get(),
+                                               a.write ? AccessType::WRITE : AccessType::READ);
+                }
+                local += section.accesses.size();
+                if (section.guarded)
+                {
+                    drd.onLockRelease(lock);
+                    mutexes[section.lock].unlock();
+                }
+                if (config.barrierEvery > 0 && (s + 1) % config.barrierEvery == 0)
+                {
+                    drd.barrierWait();
+                    ++local;
+                }
+            }
+            drd.unregisterThread();
+            events += local;
+        });
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    drd.locksetMainEnd();
+    long rss = peakRssKb();
+
+    std::unordered_map<std::uint32_t, int> byNameId;
+    for (int v = 0; v < config.variables; ++v)
+    {
+        byNameId[variables[v]->getNameId()] = v;
+    }
+    std::vector<bool> reported(config.variables, false);
+    std::vector<RaceRecord> races = drd.getRaceReports();
+    for (const RaceRecord &race : races)
+    {
+        auto it = byNameId.find(static_cast<std::uint32_t>(race.key.location));
+        if (race.key.kind == RaceKey::Variable && it != byNameId.end())
+        {
+            reported[it->second] = true;
+        }
+    }
+    std::vector<bool> racy = trueRaces(config);
+    int truth = 0, found = 0, falsePositives = 0;
+    for (int v = 0; v < config.variables; ++v)
+    {
+        truth += racy[v];
+        found += racy[v] && reported[v];
+        falsePositives += reported[v] && !racy[v];
+    }
+
+    std::printf("%s engine: threads %d, variables %d, locks %d, sections %d, reads %.2f, race %g, "
+                "barrier every %d\n",
+                config.engine == DetectorEngine::Hybrid ? "hybrid" : "lockset", config.threads, config.variables,
+                config.locks, config.sections, config.reads, config.race, config.barrierEvery);
+    std::printf("events        %llu in %.3f s = %.2f M events/s\n", static_cast<unsigned long long>(events.load()),
+                seconds, events.load() / seconds / 1e6);
+    std::printf("peak RSS      %.1f MiB\n", rss / 1024.0);
+    std::printf("true races    %d variables\n", truth);
+    std::printf("recall        %d/%d = %.1f%%\n", found, truth, truth ? 100.0 * found / truth : 100.0);
+    std::printf("false pos.    %d variables\n", falsePositives);
+    DetectorStats stats = drd.snapshot();
+    if (stats.raceTableOverflows)
+    {
+        std::fprintf(stderr,
+                     "WARNING: %llu races did not fit the %zu-slot race table; recall is a lower bound. "
+                     "Rerun with a larger --race-slots.\n",
+                     static_cast<unsigned long long>(stats.raceTableOverflows), config.raceSlots);
+    }
+    std::printf("conflicts     %llu lockset checks, %llu racing accesses, %llu barrier waits\n",
+                static_cast<unsigned long long>(stats.conflictChecks),
+                static_cast<unsigned long long>(stats.raceOccurrences),
+                static_cast<unsigned long long>(stats.barrierWaits));
+    std::printf("transitions  ");
+    for (std::size_t st = 0; st < kStateCount; ++st)
+    {
+        if (stats.transitions[st])
+        {
+            std::printf(" %s %llu", SharedVariable::stateToString(static_cast<State>(st)).c_str(),
+                        static_cast<unsigned long long>(stats.transitions[st]));
+        }
+    }
+    std::printf("\n");
+    if (config.latency)
+    {
+        LatencySnapshot latency = drd.getLatencySnapshot();
+        std::printf("\n%-24s %12s %10s %10s %10s %10s %12s\n", "latency (ns)", "count", "mean", "p50", "p99",
+                    "p999", "max");
+        for (std::size_t e = 0; e < kLatencyEvents; ++e)
+        {
+            const LatencySummary &l = latency.events[e];
+            if (l.count)
+            {
+                std::printf("%-24s %12llu %10.1f %10llu %10llu %10llu %12llu\n",
+                            latencyEventName(static_cast<LatencyEvent>(e)), static_cast<unsigned long long>(l.count),
+                            l.mean, static_cast<unsigned long long>(l.p50), static_cast<unsigned long long>(l.p99),
+                            static_cast<unsigned long long>(l.p999), static_cast<unsigned long long>(l.max));
+            }
+        }
+    }
+    if (falsePositives > found)
+    {
+        std::fprintf(stderr, "FAILED: %d false positives outnumber the %d true races found\n", falsePositives,
+                     found);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file async_pipeline.cpp
+ * @brief Runs one workload with online detection and again in asynchronous mode
+ *
+ * The workload is the one of trace_record.cpp followed by a detector
+ * barrier. The per-event cost on the application threads and the races
+ * found are printed for both modes.
+ *
+ * Usage: ./examples/async_pipeline [iterations] [threads] [analyzers]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+int numThreads = 4;
+std::mutex commonMutex;
+
+void worker(DataRaceDetector *drd, int threadId, Lock *ownLock, SharedVariable *ownVar,
+            Lock *commonLock, SharedVariable *commonVar, SharedVariable *racyVar, int iterations)
+{
+    Thread thread(threadId);
+    drd->registerThread(&thread);
+
+    drd->onSharedVariableAccess(&thread, racyVar, AccessType::WRITE);
+    for (int i = 0; i < iterations; ++i)
+    {
+        drd->onLockAcquire(&thread, ownLock, true, ownVar);
+        drd->onSharedVariableAccess(&thread, ownVar, AccessType::WRITE);
+        drd->onLockRelease(&thread, ownLock, ownVar);
+
+        std::lock_guard<std::mutex> guard(commonMutex);
+        drd->onLockAcquire(&thread, commonLock, false, commonVar);
+        drd->onSharedVariableAccess(&thread, commonVar, AccessType::READ);
+        drd->onLockRelease(&thread, commonLock, commonVar);
+    }
+    drd->barrierWait();
+
+    drd->unregisterThread(&thread);
+}
+
+/// Runs the workload and returns nanoseconds per event.
+double run(DataRaceDetector &drd, int iterations)
+{
+    Lock commonLock(0);
+    SharedVariable commonVar("common");
+    SharedVariable racyVar("racy");
+    std::vector<std::unique_ptr<Lock>> locks;
+    std::vector<std::unique_ptr<SharedVariable>> vars;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        locks.emplace_back(new Lock(i + 1));
+        vars.emplace_back(new SharedVariable("var" + std::to_string(i + 1)));
+    }
+
+    drd.locksetMainStart();
+    pthread_barrier_t barrier;
+    drd.initializeBarrier(&barrier, nullptr, numThreads);
+    drd.registerSharedVariable(&commonVar);
+    drd.registerSharedVariable(&racyVar);
+    for (auto &v : vars)
+    {
+        drd.registerSharedVariable(v.get());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers.emplace_back(worker, &drd, i + 1, locks[i].get(), vars[i].get(),
+                             &commonLock, &commonVar, &racyVar, iterations);
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    drd.locksetMainEnd();
+
+    double events = (6.0 * iterations + 1) * numThreads;
+    return std::chrono::duration<double, std::nano>(end - start).count() / events;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+    numThreads = argc > 2 ? std::atoi(argv[2]) : 4;
+    unsigned analyzers = argc > 3 ? static_cast<unsigned>(std::atoi(argv[3])) : 2;
+    Logger::setLevel(LogLevel::Race);
+
+    DataRaceDetector online;
+    double onlineCost = run(online, iterations);
+    std::cout << "Online: " << onlineCost << " ns/event, "
+              << online.getNumDataRaces() << " races" << std::endl;
+
+    DataRaceDetector async;
+    async.startAsync(analyzers);
+    double asyncCost = run(async, iterations);
+    std::cout << "Async:  " << asyncCost << " ns/event on the application threads, "
+              << async.getNumDataRaces() << " races (" << analyzers << " analyzers)" << std::endl;
+    async.stopAsync();
+    return 0;
+}
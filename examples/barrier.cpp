@@ -42,13 +42,16 @@ int main() {
 }
 
 void runBarrierScenario(DataRaceDetector& drd, SharedVariable& var1, Lock& lock1, pthread_barrier_t& barrier, int numThreads, bool mixedAccess) {
-    std::vector<Thread> threads(numThreads);
+    std::vector<Thread*> threads(numThreads);
     std::vector<pthread_t> pthreads(numThreads);
+    // Arguments must outlive the loop: the threads read them after it moves on
+    std::vector<std::tuple<DataRaceDetector*, SharedVariable*, Lock*, pthread_barrier_t*, Thread*, bool>> threadArgs;
+    threadArgs.reserve(numThreads);
 
     for (int i = 0; i < numThreads; ++i) {
-        threads[i] = Thread(i + 1); // Create threads
-        auto threadArg = std::make_tuple(&drd, &var1, &lock1, &barrier, &threads[i], mixedAccess); // Include mixedAccess flag
-        pthread_create(&pthreads[i], NULL, threadFunction, &threadArg);
+        threads[i] = drd.createThread(i + 1); // Cache-line aligned, owned by the detector
+        threadArgs.push_back(std::make_tuple(&drd, &var1, &lock1, &barrier, threads[i], mixedAccess)); // Include mixedAccess flag
+        pthread_create(&pthreads[i], NULL, threadFunction, &threadArgs.back());
     }
 
     for (auto& pthread : pthreads) {
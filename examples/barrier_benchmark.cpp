@@ -0,0 +1,139 @@
+/**
+ * @file barrier_benchmark.cpp
+ * @brief Barrier crossings with many registered variables, lazy versus eager reset
+ *
+ * Every thread writes its own slice of variables without locks, then all
+ * threads cross a barrier and each moves on to the slice its neighbour
+ * wrote. Each variable is therefore written by a different thread in every
+ * phase, which is only race-free because the barrier resets it. The
+ * detector's barrierWait only starts a new barrier generation, and each
+ * variable resets itself when it is next accessed. The eager run instead
+ * walks every registered variable at each barrier, as the detector used to,
+ * with the other threads held until the walk is done. The time a barrier
+ * holds the threads and the races found are printed for both.
+ *
+ * Usage: ./examples/barrier_benchmark [variables] [threads] [barriers] [accesses]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct Config
+{
+    int numVariables;
+    int numThreads;
+    int barriers;
+    int accesses;
+};
+
+void run(bool lazy, const Config &config, std::vector<std::unique_ptr<SharedVariable>> &variables)
+{
+    DataRaceDetector drd;
+    drd.locksetMainStart();
+    for (auto &v : variables)
+    {
+        // The previous run's threads are gone with its detector.
+        v->reset();
+        drd.registerSharedVariable(v.get());
+    }
+    pthread_barrier_t barrier;
+    drd.initializeBarrier(&barrier, nullptr, config.numThreads);
+    pthread_barrier_t eager;
+    pthread_barrier_init(&eager, nullptr, config.numThreads);
+
+    // Per thread: the longest time it spent in any one barrier.
+    std::vector<double> slowest(config.numThreads, 0.0);
+    auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int id = 0; id < config.numThreads; ++id)
+    {
+        workers.emplace_back([&, id]
+        {
+            drd.registerThread(id + 1);
+            for (int phase = 0; phase < config.barriers; ++phase)
+            {
+                int slice = (id + phase) % config.numThreads;
+                for (int k = 0; k < config.accesses; ++k)
+                {
+                    SharedVariable *v = variables[(slice * config.accesses + k) % config.numVariables].get();
+                    drd.onSharedVariableAccess(v, AccessType::WRITE);
+                }
+
+                auto arrived = Clock::now();
+                if (lazy)
+                {
+                    drd.barrierWait();
+                }
+                else if (pthread_barrier_wait(&eager) == PTHREAD_BARRIER_SERIAL_THREAD)
+                {
+                    for (auto &v : variables)
+                    {
+                        v->setState(State::Clean);
+                    }
+                    pthread_barrier_wait(&eager);
+                }
+                else
+                {
+                    pthread_barrier_wait(&eager);
+                }
+                double us = std::chrono::duration<double, std::micro>(Clock::now() - arrived).count();
+                slowest[id] = std::max(slowest[id], us);
+            }
+            drd.unregisterThread();
+        });
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    drd.locksetMainEnd();
+    pthread_barrier_destroy(&eager);
+
+    std::cout << std::left << std::setw(8) << (lazy ? "lazy" : "eager") << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << totalMs << " ms total" << std::setw(12)
+              << *std::max_element(slowest.begin(), slowest.end()) << " us longest barrier" << std::setw(6)
+              << drd.getNumDataRaces() << " races" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Config config;
+    config.numVariables = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    config.numThreads = argc > 2 ? std::atoi(argv[2]) : 64;
+    config.barriers = argc > 3 ? std::atoi(argv[3]) : 20;
+    config.accesses = argc > 4 ? std::atoi(argv[4]) : 256;
+    Logger::setLevel(LogLevel::Off);
+
+    std::vector<std::unique_ptr<SharedVariable>> variables;
+    for (int i = 0; i < config.numVariables; ++i)
+    {
+        variables.emplace_back(new SharedVariable("v" + std::to_string(i)));
+    }
+    std::cout << config.numVariables << " variables, " << config.numThreads << " threads, "
+              << config.barriers << " barriers" << std::endl;
+
+    run(true, config, variables);
+    run(false, config, variables);
+    return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file lockset_benchmark.cpp
+ * @brief Compares std::set, sorted-array and bitset lockset intersection
+ *
+ * For several program lock counts, two locksets each holding a quarter of
+ * the locks are intersected with
+ * - the original std::set + std::set_intersection path,
+ * - a merge of the interned locksets' sorted arrays,
+ * - the SIMD AND+test kernel on the locksets' bitsets,
+ * - the SIMD AND kernel and set-bit scan that LocksetTable::intersect runs
+ *   under the Bitset representation to build an uncached intersection,
+ * - the per-index bit test that path used before.
+ * Both a disjoint pair (the race case) and an overlapping pair are measured.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+#include "../include/Lock.h"
+#include "../include/Lockset.h"
+#include "../include/LockBitset.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+volatile std::size_t sink;
+
+template <typename F>
+double nanosecondsPerOp(int iterations, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        sink = sink + f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+void measure(int numLocks, const char *label, const std::vector<Lock *> &a, const std::vector<Lock *> &b, int iterations)
+{
+    std::set<Lock *> setA(a.begin(), a.end());
+    std::set<Lock *> setB(b.begin(), b.end());
+    LocksetTable &table = LocksetTable::instance();
+    const Lockset *lsA = table.intern(a);
+    const Lockset *lsB = table.intern(b);
+
+    double stdSet = nanosecondsPerOp(iterations, [&]()
+    {
+        std::set<Lock *> common;
+        std::set_intersection(setA.begin(), setA.end(), setB.begin(), setB.end(),
+                              std::inserter(common, common.begin()));
+        return common.size();
+    });
+    double sorted = nanosecondsPerOp(iterations, [&]()
+    {
+        return static_cast<std::size_t>(lsA->intersectsSorted(*lsB));
+    });
+    double bitset = nanosecondsPerOp(iterations, [&]()
+    {
+        return static_cast<std::size_t>(lsA->intersectsBitset(*lsB));
+    });
+    std::vector<std::uint32_t> common;
+    double refine = nanosecondsPerOp(iterations, [&]()
+    {
+        common.clear();
+        LockBitset(lsA->getBits(), lsB->getBits()).appendIndices(common);
+        return common.size();
+    });
+    double probe = nanosecondsPerOp(iterations, [&]()
+    {
+        common.clear();
+        const LockBitset &bBits = lsB->getBits();
+        for (std::uint32_t index : lsA->getIndices())
+        {
+            if (bBits.test(index))
+            {
+                common.push_back(index);
+            }
+        }
+        return common.size();
+    });
+
+    std::cout << std::setw(6) << numLocks << "  " << std::setw(11) << label
+              << std::setw(12) << stdSet << std::setw(12) << sorted
+              << std::setw(12) << bitset << std::setw(12) << refine << std::setw(12) << probe << "\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+    Logger::setLevel(LogLevel::Off);
+
+    std::cout << "Bitset kernel: " << bitset_kernels::kernelName() << "\n";
+    std::cout << "ns/op; each lockset holds a quarter of the program's locks\n";
+    std::cout << " locks  pair         std::set  sorted-arr   bitset-any  bitset-and  index-test\n";
+
+    std::mt19937 rng(42);
+    const int lockCounts[] = {16, 64, 128, 256, 512, 1024};
+    for (int numLocks : lockCounts)
+    {
+        std::vector<std::unique_ptr<Lock>> storage;
+        std::vector<Lock *> locks;
+        for (int i = 0; i < numLocks; ++i)
+        {
+            storage.emplace_back(new Lock(i));
+            locks.push_back(storage.back().get());
+        }
+        std::shuffle(locks.begin(), locks.end(), rng);
+
+        std::size_t quarter = locks.size() / 4;
+        std::vector<Lock *> a(locks.begin(), locks.begin() + quarter);
+        std::vector<Lock *> disjoint(locks.begin() + quarter, locks.begin() + 2 * quarter);
+        std::vector<Lock *> overlapping(disjoint);
+        overlapping.back() = a.back();
+
+        measure(numLocks, "disjoint", a, disjoint, iterations);
+        measure(numLocks, "overlapping", a, overlapping, iterations);
+    }
+    return 0;
+}
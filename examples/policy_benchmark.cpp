@@ -0,0 +1,75 @@
+/**
+ * @file policy_benchmark.cpp
+ * @brief Compares the per-event cost of VerbosePolicy and ProductionPolicy detectors
+ *
+ * A single thread repeatedly acquires a lock, writes a shared variable and
+ * releases the lock. The verbose detector's log output is sent to /dev/null
+ * so that only the cost of producing the records is measured, not the
+ * terminal.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+template <typename Policy>
+double nanosecondsPerEvent(int iterations)
+{
+    BasicDataRaceDetector<Policy> drd;
+    Lock lock1(1);
+    SharedVariable var1("var1");
+    Thread thread(1);
+
+    drd.locksetMainStart();
+    drd.registerThread(&thread);
+    drd.registerSharedVariable(&var1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        drd.onLockAcquire(&thread, &lock1, true, &var1);
+        drd.onSharedVariableAccess(&thread, &var1, AccessType::WRITE);
+        drd.onLockRelease(&thread, &lock1, &var1);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    drd.unregisterThread(&thread);
+    drd.locksetMainEnd();
+
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / (3.0 * iterations);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    std::FILE *devNull = std::fopen("/dev/null", "w");
+    if (!devNull)
+    {
+        std::cerr << "Cannot open /dev/null" << std::endl;
+        return 1;
+    }
+    Logger::setOutput(devNull, devNull);
+    Logger::setLevel(LogLevel::Trace);
+
+    double verbose = nanosecondsPerEvent<VerbosePolicy>(iterations);
+    double production = nanosecondsPerEvent<ProductionPolicy>(iterations);
+
+    Logger::flush();
+    Logger::setOutput(stdout, stderr);
+    std::fclose(devNull);
+
+    std::cout << "Iterations: " << iterations << " (3 events each)\n";
+    std::cout << "VerbosePolicy:    " << verbose << " ns/event\n";
+    std::cout << "ProductionPolicy: " << production << " ns/event\n";
+    std::cout << "Speedup:          " << verbose / production << "x\n";
+    return 0;
+}
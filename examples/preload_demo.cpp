@@ -0,0 +1,163 @@
+/**
+ * @file preload_demo.cpp
+ * @brief A plain pthread program to run under liblockset_preload.so
+ *
+ * The program never calls the detector. Its mutexes, rwlock, barrier and
+ * threads are seen through the interposed pthread calls, and its shared
+ * counters are annotated with the weak lockset_preload_access, which is
+ * only called when the library is loaded. Phase 1 guards every access,
+ * phase 2 writes a counter without a lock. Before starting the threads,
+ * main times uncontended lock/unlock pairs, so running the program with
+ * and without LD_PRELOAD gives the interposition overhead. It then locks
+ * more mutexes than the library's lock map initially holds, so phase 1
+ * only stays race-free if the map grows.
+ *
+ * Usage: [LD_PRELOAD=./liblockset_preload.so] ./examples/preload_demo [threads] [iterations]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <pthread.h>
+#include "../include/LocksetPreload.h"
+
+namespace
+{
+
+int numThreads = 4;
+int iterations = 20000;
+const int kTableSize = 64;
+const int kTimedPairs = 200000;
+const int kManyMutexes = 70000;
+
+pthread_mutex_t counterMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t tableLock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_barrier_t phaseBarrier;
+
+long counter = 0;
+long table[kTableSize];
+long racy = 0;
+unsigned long long phase1Races = 0;
+
+void annotate(const void *addr, size_t size, bool isWrite)
+{
+    if (lockset_preload_access)
+    {
+        lockset_preload_access(addr, size, isWrite ? 1 : 0);
+    }
+}
+
+double timeLockPairs()
+{
+    pthread_mutex_t own = PTHREAD_MUTEX_INITIALIZER;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kTimedPairs; ++i)
+    {
+        pthread_mutex_lock(&own);
+        pthread_mutex_unlock(&own);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    pthread_mutex_destroy(&own);
+    return ns / kTimedPairs;
+}
+
+void *worker(void *arg)
+{
+    long id = reinterpret_cast<long>(arg);
+
+    // Phase 1: every access is guarded
+    for (int i = 0; i < iterations; ++i)
+    {
+        pthread_mutex_lock(&counterMutex);
+        annotate(&counter, sizeof counter, true);
+        ++counter;
+        pthread_mutex_unlock(&counterMutex);
+
+        long *slot = &table[(id + i) % kTableSize];
+        if (i % 8 == 0)
+        {
+            pthread_rwlock_wrlock(&tableLock);
+            annotate(slot, sizeof *slot, true);
+            ++*slot;
+        }
+        else
+        {
+            pthread_rwlock_rdlock(&tableLock);
+            annotate(slot, sizeof *slot, false);
+            volatile long value = *slot;
+            (void)value;
+        }
+        pthread_rwlock_unlock(&tableLock);
+    }
+
+    if (pthread_barrier_wait(&phaseBarrier) == PTHREAD_BARRIER_SERIAL_THREAD && lockset_preload_races)
+    {
+        phase1Races = lockset_preload_races();
+    }
+    pthread_barrier_wait(&phaseBarrier);
+
+    // Phase 2: racy is written without a lock
+    for (int i = 0; i < iterations; ++i)
+    {
+        annotate(&racy, sizeof racy, true);
+        ++racy;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        numThreads = std::atoi(argv[1]);
+    }
+    if (argc > 2)
+    {
+        iterations = std::atoi(argv[2]);
+    }
+    if (numThreads < 2 || iterations < 1)
+    {
+        std::fprintf(stderr, "usage: %s [threads >= 2] [iterations >= 1]\n", argv[0]);
+        return 1;
+    }
+
+    double ns = timeLockPairs();
+    std::vector<pthread_mutex_t> many(kManyMutexes);
+    for (pthread_mutex_t &m : many)
+    {
+        pthread_mutex_init(&m, nullptr);
+        pthread_mutex_lock(&m);
+        pthread_mutex_unlock(&m);
+    }
+    pthread_barrier_init(&phaseBarrier, nullptr, numThreads);
+    std::vector<pthread_t> threads(numThreads);
+    for (long t = 0; t < numThreads; ++t)
+    {
+        pthread_create(&threads[t], nullptr, worker, reinterpret_cast<void *>(t));
+    }
+    for (pthread_t t : threads)
+    {
+        pthread_join(t, nullptr);
+    }
+    pthread_barrier_destroy(&phaseBarrier);
+    for (pthread_mutex_t &m : many)
+    {
+        pthread_mutex_destroy(&m);
+    }
+
+    std::printf("%d threads, %d iterations; counter %ld\n", numThreads, iterations, counter);
+    std::printf("Uncontended lock/unlock pair: %.1f ns\n", ns);
+    if (lockset_preload_races)
+    {
+        std::printf("Phase 1 (locked): %llu races\n", phase1Races);
+        std::printf("Phase 2 (unlocked): %llu races\n", lockset_preload_races() - phase1Races);
+    }
+    else
+    {
+        std::printf("liblockset_preload.so not loaded; races not checked\n");
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file race_report.cpp
+ * @brief Two threads race on one variable in a loop; the race is reported once
+ *
+ * Every iteration of both threads is a racing access, but the detector
+ * prints each distinct race once and aggregates the repeats. The aggregated
+ * table is printed at the end. Retirement is turned off, or the variable
+ * would stop being analyzed after its first race.
+ *
+ * Usage: ./examples/race_report [iterations]
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+void worker(DataRaceDetector *drd, int threadId, SharedVariable *counter, int iterations)
+{
+    Thread thread(threadId);
+    drd->registerThread(&thread);
+    for (int i = 0; i < iterations; ++i)
+    {
+        drd->onSharedVariableAccess(&thread, counter, AccessType::READ);
+        drd->onSharedVariableAccess(&thread, counter, AccessType::WRITE);
+    }
+    drd->unregisterThread(&thread);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+    Logger::setLevel(LogLevel::Info);
+
+    DataRaceDetector drd;
+    SharedVariable counter("counter");
+    drd.setRetirement(false);
+    drd.locksetMainStart();
+    drd.registerSharedVariable(&counter);
+
+    std::thread t1(worker, &drd, 1, &counter, iterations);
+    std::thread t2(worker, &drd, 2, &counter, iterations);
+    t1.join();
+    t2.join();
+    drd.locksetMainEnd();
+
+    std::cout << drd.getNumDataRaces() << " distinct races, "
+              << drd.getNumRaceOccurrences() << " racing accesses" << std::endl;
+    for (const RaceRecord &race : drd.getRaceReports())
+    {
+        std::cout << "  thread " << race.key.thread << " vs " << race.key.otherThread
+                  << (race.key.type == AccessType::WRITE ? " write" : " read")
+                  << " in state " << SharedVariable::stateToString(race.key.state)
+                  << ": " << race.count << " times over "
+                  << (race.lastSeen - race.firstSeen) / 1000 << " us" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file registry_benchmark.cpp
+ * @brief Registration, lookup, thread churn, barrier reset and teardown with many variables
+ *
+ * Every worker registers every variable, so each is registered once per
+ * thread. The registry keeps one entry per variable. The program then looks
+ * every variable up by id and by name, runs short-lived threads that each
+ * register, access a few variables and unregister, resets all variables at
+ * a barrier, unregisters every other variable and starts a new run. The
+ * time of each step is printed.
+ *
+ * Usage: ./examples/registry_benchmark [variables] [threads] [churn]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void report(const char *step, double ms, const std::string &detail)
+{
+    std::cout << std::left << std::setw(28) << step << std::right << std::setw(10)
+              << std::fixed << std::setprecision(2) << ms << " ms   " << detail << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int numVariables = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int numThreads = argc > 2 ? std::atoi(argv[2]) : 4;
+    int churn = argc > 3 ? std::atoi(argv[3]) : 200;
+    Logger::setLevel(LogLevel::Off);
+
+    DataRaceDetector drd;
+    std::vector<std::unique_ptr<SharedVariable>> variables;
+    for (int i = 0; i < numVariables; ++i)
+    {
+        variables.emplace_back(new SharedVariable("v" + std::to_string(i)));
+    }
+    drd.locksetMainStart();
+
+    auto start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        workers.emplace_back([&]
+        {
+            for (auto &v : variables)
+            {
+                drd.registerSharedVariable(v.get());
+            }
+        });
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    report("register (all threads)", msSince(start),
+           std::to_string(numThreads * numVariables) + " calls, " +
+               std::to_string(drd.getNumSharedVariables()) + " registered");
+
+    start = Clock::now();
+    int found = 0;
+    for (auto &v : variables)
+    {
+        found += drd.findSharedVariable(v->getNameId()) == v.get();
+        found += drd.findSharedVariable(v->getName()) == v.get();
+    }
+    report("lookup by id and name", msSince(start), std::to_string(found) + " found");
+
+    start = Clock::now();
+    for (int c = 0; c < churn; ++c)
+    {
+        std::thread worker([&, c]
+        {
+            Thread thread(c + 1);
+            drd.registerThread(&thread);
+            for (int k = 0; k < 4; ++k)
+            {
+                SharedVariable *v = variables[(c * 4 + k) % numVariables].get();
+                drd.onSharedVariableAccess(&thread, v, AccessType::WRITE);
+            }
+            drd.unregisterThread(&thread);
+        });
+        worker.join();
+    }
+    report("thread churn", msSince(start), std::to_string(churn) + " threads");
+
+    start = Clock::now();
+    drd.onBarrierReset();
+    report("barrier reset", msSince(start), std::to_string(numVariables) + " variables");
+
+    start = Clock::now();
+    for (int i = 0; i < numVariables; i += 2)
+    {
+        drd.unregisterSharedVariable(variables[i].get());
+    }
+    found = 0;
+    for (auto &v : variables)
+    {
+        found += drd.findSharedVariable(v->getNameId()) == v.get();
+    }
+    report("unregister every other", msSince(start),
+           std::to_string(drd.getNumSharedVariables()) + " registered, " + std::to_string(found) + " found");
+
+    start = Clock::now();
+    drd.locksetMainStart();
+    report("teardown (locksetMainStart)", msSince(start),
+           std::to_string(drd.getNumSharedVariables()) + " registered");
+    return 0;
+}
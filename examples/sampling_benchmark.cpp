@@ -0,0 +1,112 @@
+/**
+ * @file sampling_benchmark.cpp
+ * @brief Compares full checking with adaptive sampling on a mostly race-free workload
+ *
+ * Every worker repeatedly writes a hot variable under a common lock and
+ * reads their own variable without locks. Every racyEvery iterations they
+ * also write an unprotected shared variable. The cost per access, the
+ * sampled/skipped split and the races found are printed with sampling off
+ * and on.
+ *
+ * Usage: ./examples/sampling_benchmark [iterations] [threads] [racy-every]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+std::mutex hotMutex;
+
+void worker(DataRaceDetector *drd, int threadId, Lock *hotLock, SharedVariable *hotVar,
+            SharedVariable *ownVar, SharedVariable *racyVar, int iterations, int racyEvery)
+{
+    Thread thread(threadId);
+    drd->registerThread(&thread);
+    for (int i = 0; i < iterations; ++i)
+    {
+        {
+            std::lock_guard<std::mutex> guard(hotMutex);
+            drd->onLockAcquire(&thread, hotLock, true, hotVar);
+            drd->onSharedVariableAccess(&thread, hotVar, AccessType::WRITE);
+            drd->onLockRelease(&thread, hotLock, hotVar);
+        }
+        drd->onSharedVariableAccess(&thread, ownVar, AccessType::READ);
+        if (i % racyEvery == 0)
+        {
+            drd->onSharedVariableAccess(&thread, racyVar, AccessType::WRITE);
+        }
+    }
+    drd->unregisterThread(&thread);
+}
+
+void run(bool sampling, int iterations, int numThreads, int racyEvery)
+{
+    DataRaceDetector drd;
+    Lock hotLock(0);
+    SharedVariable hotVar("hot");
+    SharedVariable racyVar("racy");
+    std::vector<std::unique_ptr<SharedVariable>> ownVars;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        ownVars.emplace_back(new SharedVariable("own" + std::to_string(i + 1)));
+    }
+
+    drd.locksetMainStart();
+    drd.registerSharedVariable(&hotVar);
+    drd.registerSharedVariable(&racyVar);
+    for (auto &v : ownVars)
+    {
+        drd.registerSharedVariable(v.get());
+    }
+    drd.setSampling(sampling);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers.emplace_back(worker, &drd, i + 1, &hotLock, &hotVar, ownVars[i].get(), &racyVar,
+                             iterations, racyEvery);
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double accesses = static_cast<double>(numThreads) * (2.0 * iterations + (iterations + racyEvery - 1) / racyEvery);
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / accesses;
+    std::cout << std::left << std::setw(10) << (sampling ? "Sampling" : "Full")
+              << std::right << std::setw(8) << std::fixed << std::setprecision(1) << ns << " ns/access"
+              << std::setw(12) << drd.getNumSampledAccesses() << " sampled"
+              << std::setw(12) << drd.getNumSkippedAccesses() << " skipped"
+              << std::setw(8) << drd.getNumDataRaces() << " races"
+              << "   (hot variable at 1/" << (1u << hotVar.getSampleShift()) << ")" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int numThreads = argc > 2 ? std::atoi(argv[2]) : 4;
+    int racyEvery = argc > 3 ? std::atoi(argv[3]) : 1000;
+    Logger::setLevel(LogLevel::Off);
+
+    run(false, iterations, numThreads, racyEvery);
+    run(true, iterations, numThreads, racyEvery);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file scaling_benchmark.cpp
+ * @brief Measures detector throughput as the number of application threads grows
+ *
+ * Every worker repeatedly acquires its own lock, writes its own shared
+ * variable and reads a variable shared by all workers under the read side
+ * of a real reader-writer lock (modelled by a common Lock held in read
+ * mode), so the readers do not serialize each other. Detector logging is switched off while
+ * measuring so that the numbers reflect the cost of the detection logic and
+ * its synchronization.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <pthread.h>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+pthread_rwlock_t commonRwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+void worker(DataRaceDetector *drd, int threadId, Lock *ownLock, SharedVariable *ownVar,
+            Lock *commonLock, SharedVariable *commonVar, int iterations)
+{
+    Thread thread(threadId);
+    drd->registerThread(&thread);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        drd->onLockAcquire(&thread, ownLock, true, ownVar);
+        drd->onSharedVariableAccess(&thread, ownVar, AccessType::WRITE);
+        drd->onLockRelease(&thread, ownLock, ownVar);
+
+        pthread_rwlock_rdlock(&commonRwlock);
+        drd->onLockAcquire(&thread, commonLock, false, commonVar);
+        drd->onSharedVariableAccess(&thread, commonVar, AccessType::READ);
+        drd->onLockRelease(&thread, commonLock, commonVar);
+        pthread_rwlock_unlock(&commonRwlock);
+    }
+
+    drd->unregisterThread(&thread);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const int maxThreads = 64;
+
+    Logger::setLevel(LogLevel::Off);
+
+    std::ostringstream report;
+    report << "threads  events      seconds     events/sec\n";
+
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        DataRaceDetector drd;
+        Lock commonLock(0);
+        SharedVariable commonVar("common");
+        std::vector<std::unique_ptr<Lock>> locks;
+        std::vector<std::unique_ptr<SharedVariable>> vars;
+        for (int i = 0; i < numThreads; ++i)
+        {
+            locks.emplace_back(new Lock(i + 1));
+            vars.emplace_back(new SharedVariable("var" + std::to_string(i + 1)));
+        }
+
+        drd.locksetMainStart();
+        drd.registerSharedVariable(&commonVar);
+        for (auto &v : vars)
+        {
+            drd.registerSharedVariable(v.get());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int i = 0; i < numThreads; ++i)
+        {
+            workers.emplace_back(worker, &drd, i + 1, locks[i].get(), vars[i].get(),
+                                 &commonLock, &commonVar, iterations);
+        }
+        for (auto &w : workers)
+        {
+            w.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        drd.locksetMainEnd();
+
+        // Each iteration reports two acquisitions, two accesses and two releases.
+        double events = 6.0 * iterations * numThreads;
+        double seconds = std::chrono::duration<double>(end - start).count();
+        report.width(7);
+        report << numThreads << "  ";
+        report.width(10);
+        report << static_cast<long long>(events) << "  ";
+        report.width(10);
+        report << seconds << "  ";
+        report.width(12);
+        report << static_cast<long long>(events / seconds) << "\n";
+    }
+
+    std::cout << report.str();
+    return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file shm_producer.cpp
+ * @brief Runs one workload with online detection and again streamed to a lockset-daemon
+ *
+ * The workload is the one of trace_record.cpp. The per-event cost of both
+ * modes is printed as wall-clock time and as CPU time of the application
+ * threads. Where the daemon has no core of its own, its analysis shows up
+ * in the wall-clock time of the streaming run but not in its CPU time.
+ * The daemon started with the same name should report the races the
+ * online run found.
+ *
+ * Usage: ./examples/shm_producer [name] [iterations] [threads]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+#include "../include/ShmChannel.h"
+
+namespace
+{
+
+int numThreads = 4;
+std::mutex commonMutex;
+
+double threadCpuNanoseconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void worker(DataRaceDetector *drd, int threadId, Lock *ownLock, SharedVariable *ownVar,
+            Lock *commonLock, SharedVariable *commonVar, SharedVariable *racyVar, int iterations,
+            double *cpuNanoseconds)
+{
+    double cpuStart = threadCpuNanoseconds();
+    Thread thread(threadId);
+    drd->registerThread(&thread);
+
+    drd->onSharedVariableAccess(&thread, racyVar, AccessType::WRITE);
+    for (int i = 0; i < iterations; ++i)
+    {
+        drd->onLockAcquire(&thread, ownLock, true, ownVar);
+        drd->onSharedVariableAccess(&thread, ownVar, AccessType::WRITE);
+        drd->onLockRelease(&thread, ownLock, ownVar);
+
+        std::lock_guard<std::mutex> guard(commonMutex);
+        drd->onLockAcquire(&thread, commonLock, false, commonVar);
+        drd->onSharedVariableAccess(&thread, commonVar, AccessType::READ);
+        drd->onLockRelease(&thread, commonLock, commonVar);
+    }
+
+    drd->unregisterThread(&thread);
+    *cpuNanoseconds = threadCpuNanoseconds() - cpuStart;
+}
+
+struct Cost
+{
+    double wall;    ///< Nanoseconds per event
+    double cpu;     ///< CPU nanoseconds of the application threads per event
+};
+
+Cost run(DataRaceDetector &drd, int iterations)
+{
+    Lock commonLock(0);
+    SharedVariable commonVar("common");
+    SharedVariable racyVar("racy");
+    std::vector<std::unique_ptr<Lock>> locks;
+    std::vector<std::unique_ptr<SharedVariable>> vars;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        locks.emplace_back(new Lock(i + 1));
+        vars.emplace_back(new SharedVariable("var" + std::to_string(i + 1)));
+    }
+
+    drd.locksetMainStart();
+    drd.registerSharedVariable(&commonVar);
+    drd.registerSharedVariable(&racyVar);
+    for (auto &v : vars)
+    {
+        drd.registerSharedVariable(v.get());
+    }
+
+    std::vector<double> cpu(numThreads);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers.emplace_back(worker, &drd, i + 1, locks[i].get(), vars[i].get(),
+                             &commonLock, &commonVar, &racyVar, iterations, &cpu[i]);
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    drd.locksetMainEnd();
+
+    double events = (6.0 * iterations + 1) * numThreads;
+    double cpuTotal = 0;
+    for (double c : cpu)
+    {
+        cpuTotal += c;
+    }
+    return Cost{std::chrono::duration<double, std::nano>(end - start).count() / events, cpuTotal / events};
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string name = argc > 1 ? argv[1] : "lockset";
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 100000;
+    numThreads = argc > 3 ? std::atoi(argv[3]) : 4;
+    Logger::setLevel(LogLevel::Race);
+
+    DataRaceDetector online;
+    Cost onlineCost = run(online, iterations);
+    std::cout << "Online:    " << onlineCost.wall << " ns/event (" << onlineCost.cpu << " CPU), "
+              << online.getNumDataRaces() << " races" << std::endl;
+
+    DataRaceDetector streamer;
+    if (!streamer.startStreaming(name))
+    {
+        std::cerr << "No lockset-daemon serving " << name << std::endl;
+        return 1;
+    }
+    Cost streamCost = run(streamer, iterations);
+    streamer.stopStreaming();
+    std::cout << "Streaming: " << streamCost.wall << " ns/event (" << streamCost.cpu << " CPU)";
+    if (ShmChannel::droppedRecords())
+    {
+        std::cout << " (" << ShmChannel::droppedRecords() << " events dropped)";
+    }
+    std::cout << std::endl;
+    return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file thread_pool.cpp
+ * @brief Worker churn with caller-owned Thread objects versus thread_local handles
+ *
+ * A pool retires all its workers and starts new ones every round, with
+ * many variables registered. Caller-owned workers pass their stack Thread
+ * to every callback, so each unregisterThread walks every variable to hand
+ * the ones it accessed a copy. Handle-based workers call
+ * registerThread(id), use the overloads without a Thread argument and
+ * unregister in constant time, because the detector owns their records.
+ * Registration cost, per-access cost and the slots in use are printed.
+ *
+ * Usage: ./examples/thread_pool [rounds] [workers] [variables] [accesses]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+std::uint64_t nsSince(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+struct Totals
+{
+    std::atomic<std::uint64_t> lifecycleNs{0};
+    std::atomic<std::uint64_t> accessNs{0};
+    std::atomic<std::uint32_t> maxSlot{0};
+};
+
+std::mutex poolMutex;
+
+void ownedWorker(DataRaceDetector *drd, int id, Lock *lock, std::vector<std::unique_ptr<SharedVariable>> *vars,
+                 int accesses, Totals *totals)
+{
+    auto start = Clock::now();
+    Thread thread(id);
+    drd->registerThread(&thread);
+    std::uint64_t lifecycle = nsSince(start);
+
+    start = Clock::now();
+    for (int i = 0; i < accesses; ++i)
+    {
+        SharedVariable *v = (*vars)[(id * 7 + i) % vars->size()].get();
+        std::lock_guard<std::mutex> guard(poolMutex);
+        drd->onLockAcquire(&thread, lock, true, v);
+        drd->onSharedVariableAccess(&thread, v, AccessType::WRITE);
+        drd->onLockRelease(&thread, lock, v);
+    }
+    totals->accessNs += nsSince(start);
+
+    start = Clock::now();
+    drd->unregisterThread(&thread);
+    totals->lifecycleNs += lifecycle + nsSince(start);
+}
+
+void handleWorker(DataRaceDetector *drd, int id, Lock *lock, std::vector<std::unique_ptr<SharedVariable>> *vars,
+                  int accesses, Totals *totals)
+{
+    auto start = Clock::now();
+    Thread *thread = drd->registerThread(id);
+    std::uint64_t lifecycle = nsSince(start);
+    std::uint32_t slot = thread->getSlot();
+    std::uint32_t seen = totals->maxSlot.load();
+    while (slot > seen && !totals->maxSlot.compare_exchange_weak(seen, slot))
+    {
+    }
+
+    start = Clock::now();
+    for (int i = 0; i < accesses; ++i)
+    {
+        SharedVariable *v = (*vars)[(id * 7 + i) % vars->size()].get();
+        std::lock_guard<std::mutex> guard(poolMutex);
+        drd->onLockAcquire(lock, true, v);
+        drd->onSharedVariableAccess(v, AccessType::WRITE);
+        drd->onLockRelease(lock, v);
+    }
+    totals->accessNs += nsSince(start);
+
+    start = Clock::now();
+    drd->unregisterThread();
+    totals->lifecycleNs += lifecycle + nsSince(start);
+}
+
+void run(bool handles, int rounds, int workers, int numVariables, int accesses)
+{
+    DataRaceDetector drd;
+    Lock lock(0);
+    std::vector<std::unique_ptr<SharedVariable>> vars;
+    for (int i = 0; i < numVariables; ++i)
+    {
+        vars.emplace_back(new SharedVariable("v" + std::to_string(i)));
+    }
+    drd.locksetMainStart();
+    for (auto &v : vars)
+    {
+        drd.registerSharedVariable(v.get());
+    }
+
+    Totals totals;
+    int id = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        std::vector<std::thread> pool;
+        for (int w = 0; w < workers; ++w)
+        {
+            pool.emplace_back(handles ? handleWorker : ownedWorker, &drd, ++id, &lock, &vars, accesses, &totals);
+        }
+        for (auto &t : pool)
+        {
+            t.join();
+        }
+    }
+    drd.locksetMainEnd();
+
+    double threads = static_cast<double>(rounds) * workers;
+    std::cout << std::left << std::setw(16) << (handles ? "thread_local" : "Thread*") << std::right
+              << std::setw(10) << std::fixed << std::setprecision(1) << totals.lifecycleNs / threads / 1000.0
+              << " us register+unregister" << std::setw(8) << totals.accessNs / (threads * accesses * 3.0)
+              << " ns/event" << std::setw(6) << drd.getNumDataRaces() << " races";
+    if (handles)
+    {
+        std::cout << "   (" << static_cast<int>(threads) << " threads in " << totals.maxSlot.load() + 1 << " slots)";
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 50;
+    int workers = argc > 2 ? std::atoi(argv[2]) : 8;
+    int numVariables = argc > 3 ? std::atoi(argv[3]) : 50000;
+    int accesses = argc > 4 ? std::atoi(argv[4]) : 1000;
+    Logger::setLevel(LogLevel::Off);
+
+    run(false, rounds, workers, numVariables, accesses);
+    run(true, rounds, workers, numVariables, accesses);
+    return 0;
+}
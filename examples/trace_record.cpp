@@ -0,0 +1,209 @@
+/**
+ * @file trace_record.cpp
+ * @brief Runs one workload with online detection and again in recording mode
+ *
+ * Each worker writes their own variable under their own lock, read a
+ * common variable under a common lock, and write an unprotected variable
+ * once (the race). Before them, three threads started one after the other
+ * write a hand-off variable under {A}, {A, B} and {B}, so that only the
+ * refined candidate set C(v) finds the race. Two live threads then take
+ * turns writing a relay variable under A, which is no race, and a readmode
+ * variable holding A only in read mode, which is one. The per-event
+ * cost of both modes is printed, as wall-clock time and as CPU time of
+ * the application threads; the latter leaves out the recorder's thread
+ * that makes and seals segment files. The recorded trace is left in the
+ * given directory for offline analysis; `make trace-test` checks that
+ * lockset-analyze reports the same number of races as the online run.
+ *
+ * Usage: ./examples/trace_record [trace-dir] [iterations] [threads]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include "../include/Lock.h"
+#include "../include/SharedVariable.h"
+#include "../include/Thread.h"
+#include "../include/Accesstype.h"
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+#include "../include/TraceRecorder.h"
+
+namespace
+{
+
+int numThreads = 4;
+std::mutex commonMutex;
+
+double threadCpuNanoseconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void worker(DataRaceDetector *drd, int threadId, Lock *ownLock, SharedVariable *ownVar,
+            Lock *commonLock, SharedVariable *commonVar, SharedVariable *racyVar, int iterations,
+            double *cpuNanoseconds)
+{
+    double cpuStart = threadCpuNanoseconds();
+    Thread thread(threadId);
+    drd->registerThread(&thread);
+
+    drd->onSharedVariableAccess(&thread, racyVar, AccessType::WRITE);
+    for (int i = 0; i < iterations; ++i)
+    {
+        drd->onLockAcquire(&thread, ownLock, true, ownVar);
+        drd->onSharedVariableAccess(&thread, ownVar, AccessType::WRITE);
+        drd->onLockRelease(&thread, ownLock, ownVar);
+
+        std::lock_guard<std::mutex> guard(commonMutex);
+        drd->onLockAcquire(&thread, commonLock, false, commonVar);
+        drd->onSharedVariableAccess(&thread, commonVar, AccessType::READ);
+        drd->onLockRelease(&thread, commonLock, commonVar);
+    }
+
+    drd->unregisterThread(&thread);
+    *cpuNanoseconds = threadCpuNanoseconds() - cpuStart;
+}
+
+/// Writes handoff from one thread at a time, each holding the given locks.
+void handOff(DataRaceDetector *drd, int firstId, SharedVariable *handoff, const std::vector<std::vector<Lock *>> &held)
+{
+    for (std::size_t i = 0; i < held.size(); ++i)
+    {
+        std::thread writer([&, i]
+        {
+            Thread thread(firstId + static_cast<int>(i));
+            drd->registerThread(&thread);
+            for (Lock *l : held[i])
+            {
+                drd->onLockAcquire(&thread, l, true);
+            }
+            drd->onSharedVariableAccess(&thread, handoff, AccessType::WRITE);
+            for (Lock *l : held[i])
+            {
+                drd->onLockRelease(&thread, l);
+            }
+            drd->unregisterThread(&thread);
+        });
+        writer.join();
+    }
+}
+
+/// Writes relay from two registered threads in turn, each holding lock in the given mode.
+void relay(DataRaceDetector *drd, int firstId, SharedVariable *relayVar, Lock *lock, bool writeMode)
+{
+    Thread first(firstId);
+    Thread second(firstId + 1);
+    drd->registerThread(&first);
+    drd->registerThread(&second);
+    for (Thread *t : {&first, &second, &first})
+    {
+        drd->onLockAcquire(t, lock, writeMode);
+        drd->onSharedVariableAccess(t, relayVar, AccessType::WRITE);
+        drd->onLockRelease(t, lock);
+    }
+    drd->unregisterThread(&second);
+    drd->unregisterThread(&first);
+}
+
+struct Cost
+{
+    double wall;    ///< Nanoseconds per event
+    double cpu;     ///< CPU nanoseconds of the application threads per event
+};
+
+Cost run(DataRaceDetector &drd, int iterations)
+{
+    Lock commonLock(0);
+    Lock lockA(-1);
+    Lock lockB(-2);
+    SharedVariable commonVar("common");
+    SharedVariable racyVar("racy");
+    SharedVariable handoffVar("handoff");
+    SharedVariable relayVar("relay");
+    SharedVariable readModeVar("readmode");
+    std::vector<std::unique_ptr<Lock>> locks;
+    std::vector<std::unique_ptr<SharedVariable>> vars;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        locks.emplace_back(new Lock(i + 1));
+        vars.emplace_back(new SharedVariable("var" + std::to_string(i + 1)));
+    }
+
+    drd.locksetMainStart();
+    drd.registerSharedVariable(&commonVar);
+    drd.registerSharedVariable(&racyVar);
+    drd.registerSharedVariable(&handoffVar);
+    drd.registerSharedVariable(&relayVar);
+    drd.registerSharedVariable(&readModeVar);
+    for (auto &v : vars)
+    {
+        drd.registerSharedVariable(v.get());
+    }
+    handOff(&drd, numThreads + 1, &handoffVar, {{&lockA}, {&lockA, &lockB}, {&lockB}});
+    relay(&drd, numThreads + 4, &relayVar, &lockA, true);
+    relay(&drd, numThreads + 6, &readModeVar, &lockA, false);
+
+    std::vector<double> cpu(numThreads);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers.emplace_back(worker, &drd, i + 1, locks[i].get(), vars[i].get(),
+                             &commonLock, &commonVar, &racyVar, iterations, &cpu[i]);
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    drd.locksetMainEnd();
+
+    double events = (6.0 * iterations + 1) * numThreads;
+    double cpuTotal = 0;
+    for (double c : cpu)
+    {
+        cpuTotal += c;
+    }
+    return Cost{std::chrono::duration<double, std::nano>(end - start).count() / events, cpuTotal / events};
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string directory = argc > 1 ? argv[1] : "trace-out";
+    int iterations = argc > 2 ? std::atoi(argv[2]) : 100000;
+    numThreads = argc > 3 ? std::atoi(argv[3]) : 4;
+    Logger::setLevel(LogLevel::Race);
+
+    DataRaceDetector online;
+    Cost onlineCost = run(online, iterations);
+    std::cout << "Online:    " << onlineCost.wall << " ns/event (" << onlineCost.cpu << " CPU), "
+              << online.getNumDataRaces() << " races" << std::endl;
+
+    DataRaceDetector recorder;
+    if (!recorder.startRecording(directory))
+    {
+        std::cerr << "Cannot record into " << directory << std::endl;
+        return 1;
+    }
+    Cost recordCost = run(recorder, iterations);
+    recorder.stopRecording();
+    std::cout << "Recording: " << recordCost.wall << " ns/event (" << recordCost.cpu << " CPU), trace written to "
+              << directory;
+    if (TraceRecorder::droppedRecords())
+    {
+        std::cout << " (" << TraceRecorder::droppedRecords() << " records dropped)";
+    }
+    std::cout << std::endl;
+    return 0;
+}
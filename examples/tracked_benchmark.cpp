@@ -0,0 +1,236 @@
+/**
+ * @file tracked_benchmark.cpp
+ * @brief Cost of Tracked and TrackedMutex, and their code with tracking compiled out
+ *
+ * The Makefile builds this file twice:
+ *
+ * - examples/tracked_benchmark reports to a ProductionPolicy detector. It
+ *   times each operation plain and tracked, then checks the races of a
+ *   locked and an unlocked phase.
+ * - examples/tracked_benchmark_off is built with LOCKSET_NO_TRACKING and
+ *   without the detector sources, so it links only if the wrappers call
+ *   nothing. The plain and tracked timings should match.
+ *
+ * Each operation is a pair of extern "C" functions, raw_* on the plain
+ * types and tracked_* on the wrappers. `make tracked-codegen` compiles the
+ * file with LOCKSET_NO_TRACKING and checks that each pair's assembly is the
+ * same.
+ *
+ * Usage: ./examples/tracked_benchmark[_off] [iterations] [threads]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include "../include/Tracked.h"
+
+typedef BasicDataRaceDetector<ProductionPolicy> Detector;
+
+/**
+ * A reader-writer lock with the std::shared_mutex interface, which C++11
+ * lacks; TrackedMutex<std::shared_mutex> is used the same way in C++17.
+ */
+class RwLock
+{
+public:
+    RwLock() { pthread_rwlock_init(&rwlock, nullptr); }
+    ~RwLock() { pthread_rwlock_destroy(&rwlock); }
+    void lock() { pthread_rwlock_wrlock(&rwlock); }
+    bool try_lock() { return pthread_rwlock_trywrlock(&rwlock) == 0; }
+    void unlock() { pthread_rwlock_unlock(&rwlock); }
+    void lock_shared() { pthread_rwlock_rdlock(&rwlock); }
+    bool try_lock_shared() { return pthread_rwlock_tryrdlock(&rwlock) == 0; }
+    void unlock_shared() { pthread_rwlock_unlock(&rwlock); }
+
+private:
+    RwLock(const RwLock &) = delete;
+    RwLock &operator=(const RwLock &) = delete;
+
+    pthread_rwlock_t rwlock;
+};
+
+typedef TrackedMutex<std::mutex, Detector> Mutex;
+typedef TrackedMutex<RwLock, Detector> SharedMutex;
+typedef Tracked<long, Detector> Long;
+
+#ifdef LOCKSET_NO_TRACKING
+static_assert(sizeof(Mutex) == sizeof(std::mutex) && sizeof(SharedMutex) == sizeof(RwLock) &&
+                  sizeof(Long) == sizeof(long),
+              "the wrappers must have the size of the wrapped types");
+#endif
+
+const int kTableSize = 64;
+
+extern "C" {
+
+__attribute__((noinline)) void raw_counter_step(long &counter, std::mutex &m)
+{
+    std::lock_guard<std::mutex> guard(m);
+    counter = counter + 1;
+}
+
+__attribute__((noinline)) void tracked_counter_step(Long &counter, Mutex &m)
+{
+    std::lock_guard<Mutex> guard(m);
+    counter = counter + 1;
+}
+
+__attribute__((noinline)) long raw_shared_read(const long *table, RwLock &l, int i)
+{
+    l.lock_shared();
+    long value = table[i & (kTableSize - 1)];
+    l.unlock_shared();
+    return value;
+}
+
+__attribute__((noinline)) long tracked_shared_read(const Long *table, SharedMutex &l, int i)
+{
+    l.lock_shared();
+    long value = table[i & (kTableSize - 1)];
+    l.unlock_shared();
+    return value;
+}
+
+__attribute__((noinline)) void raw_transfer(long &from, long &to, std::mutex &a, std::mutex &b)
+{
+    std::lock(a, b);
+    from = from - 1;
+    to = to + 1;
+    b.unlock();
+    a.unlock();
+}
+
+__attribute__((noinline)) void tracked_transfer(Long &from, Long &to, Mutex &a, Mutex &b)
+{
+    TrackedScopedLock<Mutex, Mutex> guard(a, b);
+    from = from - 1;
+    to = to + 1;
+}
+
+} // extern "C"
+
+namespace
+{
+
+int iterations = 1000000;
+int numThreads = 4;
+
+std::mutex rawMutex, rawOther;
+RwLock rawRwLock;
+long rawCounter, rawFrom, rawTo;
+long rawTable[kTableSize];
+
+Mutex trackedMutex, trackedOther;
+SharedMutex trackedRwLock;
+Long trackedCounter, trackedFrom, trackedTo;
+Long trackedTable[kTableSize];
+Long racy;
+
+template <typename F>
+double nanosecondsPerCall(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        f(i);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+void timeOperations()
+{
+    long sink = 0;
+    std::printf("%-16s %10s %10s\n", "operation", "plain ns", "tracked ns");
+    double raw = nanosecondsPerCall([](int) { raw_counter_step(rawCounter, rawMutex); });
+    double tracked = nanosecondsPerCall([](int) { tracked_counter_step(trackedCounter, trackedMutex); });
+    std::printf("%-16s %10.1f %10.1f\n", "counter_step", raw, tracked);
+    raw = nanosecondsPerCall([&sink](int i) { sink += raw_shared_read(rawTable, rawRwLock, i); });
+    tracked = nanosecondsPerCall([&sink](int i) { sink += tracked_shared_read(trackedTable, trackedRwLock, i); });
+    std::printf("%-16s %10.1f %10.1f\n", "shared_read", raw, tracked);
+    raw = nanosecondsPerCall([](int) { raw_transfer(rawFrom, rawTo, rawMutex, rawOther); });
+    tracked = nanosecondsPerCall([](int) { tracked_transfer(trackedFrom, trackedTo, trackedMutex, trackedOther); });
+    std::printf("%-16s %10.1f %10.1f\n", "transfer", raw, tracked);
+    if (sink != 0)
+    {
+        std::printf("unexpected table contents\n");
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        iterations = std::atoi(argv[1]);
+    }
+    if (argc > 2)
+    {
+        numThreads = std::atoi(argv[2]);
+    }
+    if (iterations < 1 || numThreads < 2)
+    {
+        std::fprintf(stderr, "usage: %s [iterations >= 1] [threads >= 2]\n", argv[0]);
+        return 1;
+    }
+
+#ifdef LOCKSET_NO_TRACKING
+    std::printf("Tracking compiled out (LOCKSET_NO_TRACKING)\n");
+    timeOperations();
+#else
+    Detector drd;
+    drd.locksetMainStart();
+    setTrackingDetector(&drd);
+    drd.registerThread(1);
+    std::printf("Tracking into a ProductionPolicy detector\n");
+    timeOperations();
+
+    // Phase 1: every tracked value is accessed under its lock
+    unsigned long long before = drd.getNumDataRaces();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&drd, t] {
+            drd.registerThread(t + 2);
+            for (int i = 0; i < iterations / 100; ++i)
+            {
+                tracked_counter_step(trackedCounter, trackedMutex);
+                tracked_shared_read(trackedTable, trackedRwLock, i);
+                tracked_transfer(trackedFrom, trackedTo, trackedMutex, trackedOther);
+            }
+            drd.unregisterThread();
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    unsigned long long locked = drd.getNumDataRaces() - before;
+
+    // Phase 2: racy is written without a lock
+    threads.clear();
+    for (int t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&drd, t] {
+            drd.registerThread(numThreads + t + 2);
+            for (int i = 0; i < iterations / 100; ++i)
+            {
+                racy = i;
+            }
+            drd.unregisterThread();
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    std::printf("Phase 1 (locked): %llu races\n", locked);
+    std::printf("Phase 2 (unlocked): %llu races\n", drd.getNumDataRaces() - before - locked);
+    setTrackingDetector<Detector>(nullptr);
+#endif
+    return 0;
+}
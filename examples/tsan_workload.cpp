@@ -0,0 +1,182 @@
+/**
+ * @file tsan_workload.cpp
+ * @brief One workload checked through -fsanitize=thread and through hand-inserted callbacks
+ *
+ * The Makefile builds this file three ways:
+ *
+ * - examples/tsan_workload: compiled with -fsanitize=thread and linked
+ *   against liblockset_tsan.so, which receives every load and store
+ * - examples/tsan_workload_hand: LOCKSET_HAND_INSTRUMENTED, linked with
+ *   the detector, reporting the same accesses and locks through
+ *   onMemoryAccess and onLockAcquire/onLockRelease
+ * - examples/tsan_workload_plain: neither, for the baseline
+ *
+ * Phase 1 updates a shared table under a mutex and a per-thread buffer
+ * without one. Phase 2 writes the counter racy without a lock. The cost
+ * of one phase 1 iteration (two reads, two writes, one lock/unlock), the
+ * races of each phase and the address of racy are printed.
+ *
+ * Usage: ./examples/tsan_workload[_hand|_plain] [threads] [iterations]
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <pthread.h>
+
+#ifdef LOCKSET_HAND_INSTRUMENTED
+#include "../include/DataRaceDetector.h"
+
+namespace
+{
+BasicDataRaceDetector<ProductionPolicy> drd;
+Lock *tableLock;
+thread_local Thread *self;
+} // namespace
+
+#define LOCKSET_READ(p) drd.onMemoryAccess(self, (const void *)(p), sizeof *(p), AccessType::READ)
+#define LOCKSET_WRITE(p) drd.onMemoryAccess(self, (const void *)(p), sizeof *(p), AccessType::WRITE)
+#define LOCKSET_ACQUIRE() drd.onLockAcquire(self, tableLock, true)
+#define LOCKSET_RELEASE() drd.onLockRelease(self, tableLock)
+#else
+#include "../include/LocksetPreload.h"
+
+#define LOCKSET_READ(p)
+#define LOCKSET_WRITE(p)
+#define LOCKSET_ACQUIRE()
+#define LOCKSET_RELEASE()
+#endif
+
+namespace
+{
+
+int numThreads = 4;
+int iterations = 200000;
+const int kTableSize = 256;
+const int kBufferSize = 1024;
+
+pthread_mutex_t tableMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_barrier_t phaseBarrier;
+
+long table[kTableSize];
+// volatile so that -O2 keeps every store of the phase 2 loop, and with it
+// the __tsan_write8 calls the race is found through.
+volatile long racy = 0;
+std::chrono::steady_clock::time_point start;
+double phase1Nanoseconds = 0;
+unsigned long long phase1Races = 0;
+bool racesCounted = false;
+
+unsigned long long racesSoFar()
+{
+#ifdef LOCKSET_HAND_INSTRUMENTED
+    racesCounted = true;
+    return drd.getNumDataRaces();
+#else
+    racesCounted = lockset_preload_races != nullptr;
+    return racesCounted ? lockset_preload_races() : 0;
+#endif
+}
+
+void *worker(void *arg)
+{
+    long id = reinterpret_cast<long>(arg);
+#ifdef LOCKSET_HAND_INSTRUMENTED
+    self = drd.registerThread(static_cast<int>(id) + 2);
+#endif
+    std::vector<long> buffer(kBufferSize);
+    // Read once: after the barrier reset a read of the global by several
+    // threads would be reported too, and racy is to be the only race.
+    const int count = iterations;
+
+    // Phase 1: the table is guarded, the buffer is private
+    for (int i = 0; i < count; ++i)
+    {
+        long *slot = &table[(id * 7 + i) & (kTableSize - 1)];
+        pthread_mutex_lock(&tableMutex);
+        LOCKSET_ACQUIRE();
+        LOCKSET_READ(slot);
+        LOCKSET_WRITE(slot);
+        *slot += i;
+        LOCKSET_RELEASE();
+        pthread_mutex_unlock(&tableMutex);
+
+        long *own = &buffer[i & (kBufferSize - 1)];
+        LOCKSET_READ(own);
+        LOCKSET_WRITE(own);
+        *own ^= i;
+    }
+
+    if (pthread_barrier_wait(&phaseBarrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+    {
+        phase1Nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        phase1Races = racesSoFar();
+#ifdef LOCKSET_HAND_INSTRUMENTED
+        drd.onBarrierReset();
+#endif
+    }
+    pthread_barrier_wait(&phaseBarrier);
+
+    // Phase 2: racy is written without a lock
+    for (int i = 0; i < count / 100; ++i)
+    {
+        LOCKSET_WRITE(&racy);
+        racy = id + i;
+    }
+
+#ifdef LOCKSET_HAND_INSTRUMENTED
+    drd.unregisterThread(self);
+#endif
+    return nullptr;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        numThreads = std::atoi(argv[1]);
+    }
+    if (argc > 2)
+    {
+        iterations = std::atoi(argv[2]);
+    }
+    if (numThreads < 2 || iterations < 100)
+    {
+        std::fprintf(stderr, "usage: %s [threads >= 2] [iterations >= 100]\n", argv[0]);
+        return 1;
+    }
+
+#ifdef LOCKSET_HAND_INSTRUMENTED
+    drd.locksetMainStart();
+    self = drd.registerThread(1);
+    tableLock = drd.createLock(1);
+#endif
+    pthread_barrier_init(&phaseBarrier, nullptr, numThreads);
+    std::vector<pthread_t> threads(numThreads);
+    start = std::chrono::steady_clock::now();
+    for (long t = 0; t < numThreads; ++t)
+    {
+        pthread_create(&threads[t], nullptr, worker, reinterpret_cast<void *>(t));
+    }
+    for (pthread_t t : threads)
+    {
+        pthread_join(t, nullptr);
+    }
+    pthread_barrier_destroy(&phaseBarrier);
+    unsigned long long races = racesSoFar();
+
+    std::printf("%d threads, %d iterations: %.1f ns per iteration\n", numThreads, iterations,
+                phase1Nanoseconds / (static_cast<double>(numThreads) * iterations));
+    if (racesCounted)
+    {
+        std::printf("Phase 1 (locked): %llu races\n", phase1Races);
+        std::printf("Phase 2 (unlocked): %llu races\n", races - phase1Races);
+    }
+    std::printf("racy at 0x%llx = %ld\n", static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(&racy)),
+                racy);
+    return 0;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file AddressMap.h
+ * @brief Growable map from object addresses to detector objects with lock-free lookup
+ *
+ * Used where the detector learns about objects only by address, such as
+ * the pthread_mutex_t of an interposed program. A lookup is a hash and a
+ * short probe of acquire loads with no lock. Inserts and removals are
+ * rare (the first use and the destruction of an object) and take a mutex;
+ * an insert that would fill the table past half its capacity first moves
+ * the live entries to a table twice the size.
+ */
+
+#ifndef ADDRESSMAP_H
+#define ADDRESSMAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class AddressMap
+ * @brief Open-addressing table of address -> T*
+ *
+ * A removed address keeps its slot with no value until the table is next
+ * rebuilt, so probes for other addresses still pass it and a lookup of
+ * the address finds nothing. Tables replaced by a bigger one are kept
+ * until the map is destroyed, since a concurrent lookup may still read
+ * them. Once the table would have to grow past kMaxCapacity,
+ * findOrCreate returns nullptr and the caller treats the object as
+ * untracked.
+ */
+template <typename T>
+class AddressMap
+{
+public:
+    /// Longest probe sequence searched before the table is rebuilt.
+    static const std::size_t kMaxProbes = 64;
+    /// Largest table the map grows to (16M addresses).
+    static const std::size_t kMaxCapacity = std::size_t(1) << 24;
+
+    /// Initial capacity, rounded up to a power of two.
+    explicit AddressMap(std::size_t capacity) : table(new Table(roundUp(capacity))), live(0) {}
+
+    ~AddressMap()
+    {
+        delete table.load(std::memory_order_relaxed);
+        for (Table *old : retired)
+        {
+            delete old;
+        }
+    }
+
+    /// The value of key, or nullptr if there is none (yet).
+    T *find(const void *key) const
+    {
+        std::uintptr_t k = reinterpret_cast<std::uintptr_t>(key);
+        const Table *t = table.load(std::memory_order_acquire);
+        for (std::size_t i = 0, slot = t->hash(k); i < kMaxProbes; ++i, slot = (slot + 1) & t->mask)
+        {
+            std::uintptr_t found = t->entries[slot].key.load(std::memory_order_acquire);
+            if (found == k)
+            {
+                return t->entries[slot].value.load(std::memory_order_acquire);
+            }
+            if (found == 0)
+            {
+                return nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief The value of key, calling create() to make it if key is new
+     *
+     * Exactly one caller creates the value of a key; callers racing with it
+     * wait on the mutex and get the same value. Returns nullptr if the map
+     * is full.
+     */
+    template <typename Create>
+    T *findOrCreate(const void *key, Create create)
+    {
+        if (T *value = find(key))
+        {
+            return value;
+        }
+        std::uintptr_t k = reinterpret_cast<std::uintptr_t>(key);
+        std::lock_guard<std::mutex> guard(mutex);
+        for (;;)
+        {
+            Table *t = table.load(std::memory_order_relaxed);
+            Entry *e = t->slotFor(k);
+            if (e && e->key.load(std::memory_order_relaxed) == k)
+            {
+                T *value = e->value.load(std::memory_order_relaxed);
+                if (!value)
+                {
+                    // Removed earlier; the slot is still the key's.
+                    value = create();
+                    e->value.store(value, std::memory_order_release);
+                    live.fetch_add(1, std::memory_order_relaxed);
+                }
+                return value;
+            }
+            if (e && (t->filled + 1) * 2 <= t->mask + 1)
+            {
+                T *value = create();
+                e->value.store(value, std::memory_order_relaxed);
+                e->key.store(k, std::memory_order_release);
+                ++t->filled;
+                live.fetch_add(1, std::memory_order_relaxed);
+                return value;
+            }
+            if (!rebuild(t))
+            {
+                return nullptr;
+            }
+        }
+    }
+
+    /// Removes key. Returns its value, or nullptr if it had none.
+    T *remove(const void *key)
+    {
+        std::uintptr_t k = reinterpret_cast<std::uintptr_t>(key);
+        std::lock_guard<std::mutex> guard(mutex);
+        Entry *e = table.load(std::memory_order_relaxed)->slotFor(k);
+        if (!e || e->key.load(std::memory_order_relaxed) != k)
+        {
+            return nullptr;
+        }
+        T *value = e->value.exchange(nullptr, std::memory_order_acq_rel);
+        if (value)
+        {
+            live.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    /// Number of keys with a value.
+    std::size_t size() const { return live.load(std::memory_order_relaxed); }
+    std::size_t capacity() const { return table.load(std::memory_order_acquire)->mask + 1; }
+
+private:
+    struct Entry
+    {
+        std::atomic<std::uintptr_t> key;
+        std::atomic<T *> value;
+    };
+
+    struct Table
+    {
+        explicit Table(std::size_t capacity) : mask(capacity - 1), entries(new Entry[capacity]), filled(0)
+        {
+            for (std::size_t i = 0; i < capacity; ++i)
+            {
+                entries[i].key.store(0, std::memory_order_relaxed);
+                entries[i].value.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        std::size_t hash(std::uintptr_t k) const
+        {
+            std::uint64_t h = static_cast<std::uint64_t>(k) * 0x9E3779B97F4A7C15ull;
+            return static_cast<std::size_t>(h >> 32) & mask;
+        }
+
+        /// The slot holding k, else the first empty one on its probe sequence, else nullptr.
+        Entry *slotFor(std::uintptr_t k)
+        {
+            for (std::size_t i = 0, slot = hash(k); i < kMaxProbes; ++i, slot = (slot + 1) & mask)
+            {
+                std::uintptr_t found = entries[slot].key.load(std::memory_order_relaxed);
+                if (found == k || found == 0)
+                {
+                    return &entries[slot];
+                }
+            }
+            return nullptr;
+        }
+
+        std::size_t mask;
+        std::unique_ptr<Entry[]> entries;
+        std::size_t filled;    ///< Slots with a key, including removed ones
+    };
+
+    static std::size_t roundUp(std::size_t n)
+    {
+        std::size_t c = 1;
+        while (c < n)
+        {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    /**
+     * Publishes a table holding the live entries of t: the same size if
+     * removed keys take up most of t, else twice the size. Returns false
+     * if that would exceed kMaxCapacity. Called with the mutex held.
+     */
+    bool rebuild(Table *t)
+    {
+        std::size_t capacity = t->mask + 1;
+        std::size_t count = live.load(std::memory_order_relaxed);
+        if (t->filled - count < count || (count + 1) * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        if (capacity > kMaxCapacity)
+        {
+            return false;
+        }
+        std::unique_ptr<Table> bigger(new Table(capacity));
+        for (std::size_t i = 0; i <= t->mask; ++i)
+        {
+            T *value = t->entries[i].value.load(std::memory_order_relaxed);
+            if (!value)
+            {
+                continue;
+            }
+            std::uintptr_t k = t->entries[i].key.load(std::memory_order_relaxed);
+            Entry *e = bigger->slotFor(k);
+            if (!e)
+            {
+                // A probe sequence overflowed; try twice the size.
+                capacity *= 2;
+                if (capacity > kMaxCapacity)
+                {
+                    return false;
+                }
+                bigger.reset(new Table(capacity));
+                i = std::size_t(-1);
+                continue;
+            }
+            e->key.store(k, std::memory_order_relaxed);
+            e->value.store(value, std::memory_order_relaxed);
+            ++bigger->filled;
+        }
+        retired.push_back(t);
+        table.store(bigger.release(), std::memory_order_release);
+        return true;
+    }
+
+    AddressMap(const AddressMap &) = delete;
+    AddressMap &operator=(const AddressMap &) = delete;
+
+    std::atomic<Table *> table;
+    std::mutex mutex;
+    std::vector<Table *> retired;
+    std::atomic<std::size_t> live;
+};
+
+#endif // ADDRESSMAP_H
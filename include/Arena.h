@@ -0,0 +1,174 @@
+/**
+ * @file Arena.h
+ * @brief Chunked bump allocator and typed slabs carved from it
+ *
+ * An Arena hands out memory from large preallocated chunks. Allocation
+ * bumps an atomic offset and takes no lock. A full chunk is followed by a
+ * new one under a mutex. Memory is never returned piecewise: reset() gives
+ * it all back at once, which is what makes teardown instant.
+ *
+ * A Slab<T, Align> places objects of one type in the arena, each in a slot
+ * aligned to Align. With Align = Arena::kCacheLine no two objects share a
+ * cache line. Destroyed objects go on a free list and are reused before the
+ * arena is asked for more.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+
+/**
+ * @class Arena
+ * @brief Thread-safe bump allocator over a list of chunks
+ */
+class Arena
+{
+public:
+    static const std::size_t kCacheLine = 64;
+    static const std::size_t kDefaultBytes = std::size_t(1) << 20;
+
+    /// Preallocates a first chunk of bytes; later chunks are at least as big.
+    explicit Arena(std::size_t bytes = kDefaultBytes);
+    ~Arena();
+
+    /// size bytes aligned to align (a power of two, at most kCacheLine).
+    void *allocate(std::size_t size, std::size_t align);
+
+    /// Frees every chunk and preallocates a new first chunk of bytes.
+    /// Not thread-safe; nothing allocated from the arena may be used after.
+    void reset(std::size_t bytes);
+    void reset() { reset(chunkBytes); }
+
+    /// Bytes of all chunks, and bytes handed out from them.
+    std::size_t capacity() const;
+    std::size_t used() const;
+    std::size_t chunks() const;
+
+private:
+    struct Chunk
+    {
+        Chunk *next;
+        std::size_t size;
+        std::atomic<std::size_t> offset;
+    };
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    static Chunk *newChunk(std::size_t size, Chunk *next);
+    void release();
+
+    std::size_t chunkBytes;
+    std::atomic<Chunk *> current;
+    std::mutex growMutex;
+};
+
+/**
+ * @class Slab
+ * @brief Pool of T objects in Align-aligned arena slots
+ *
+ * create() and destroy() take the slab's mutex; they are meant for object
+ * creation, not for per-access paths. clear() runs the destructor of every
+ * live object and forgets all slots; it must precede the arena's reset().
+ */
+template <typename T, std::size_t Align = alignof(T)>
+class Slab
+{
+public:
+    explicit Slab(Arena &arena) : arena(arena), all(nullptr), freeList(nullptr), numLive(0) {}
+    ~Slab() { clear(); }
+
+    template <typename... Args>
+    T *create(Args &&...args)
+    {
+        Slot *slot;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            slot = freeList;
+            if (slot)
+            {
+                freeList = slot->nextFree;
+            }
+        }
+        if (!slot)
+        {
+            slot = new (arena.allocate(kSlotSize, kSlotAlign)) Slot();
+            std::lock_guard<std::mutex> guard(mutex);
+            slot->nextAll = all;
+            all = slot;
+        }
+        T *object = new (objectOf(slot)) T(std::forward<Args>(args)...);
+        std::lock_guard<std::mutex> guard(mutex);
+        slot->live = true;
+        ++numLive;
+        return object;
+    }
+
+    void destroy(T *object)
+    {
+        if (!object)
+        {
+            return;
+        }
+        object->~T();
+        Slot *slot = reinterpret_cast<Slot *>(reinterpret_cast<char *>(object) - kObjectOffset);
+        std::lock_guard<std::mutex> guard(mutex);
+        slot->live = false;
+        slot->nextFree = freeList;
+        freeList = slot;
+        --numLive;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        for (Slot *slot = all; slot; slot = slot->nextAll)
+        {
+            if (slot->live)
+            {
+                static_cast<T *>(objectOf(slot))->~T();
+            }
+        }
+        all = nullptr;
+        freeList = nullptr;
+        numLive = 0;
+    }
+
+    std::size_t live() const
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        return numLive;
+    }
+
+private:
+    struct Slot
+    {
+        Slot() : nextAll(nullptr), nextFree(nullptr), live(false) {}
+        Slot *nextAll;
+        Slot *nextFree;
+        bool live;
+    };
+
+    static const std::size_t kSlotAlign = Align > alignof(Slot) ? Align : alignof(Slot);
+    static const std::size_t kObjectOffset = (sizeof(Slot) + kSlotAlign - 1) & ~(kSlotAlign - 1);
+    static const std::size_t kSlotSize = kObjectOffset + ((sizeof(T) + kSlotAlign - 1) & ~(kSlotAlign - 1));
+
+    static void *objectOf(Slot *slot) { return reinterpret_cast<char *>(slot) + kObjectOffset; }
+
+    Slab(const Slab &) = delete;
+    Slab &operator=(const Slab &) = delete;
+
+    Arena &arena;
+    mutable std::mutex mutex;
+    Slot *all;
+    Slot *freeList;
+    std::size_t numLive;
+};
+
+#endif // ARENA_H
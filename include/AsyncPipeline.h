@@ -0,0 +1,135 @@
+/**
+ * @file AsyncPipeline.h
+ * @brief Hands detector events from application threads to partitioned analyzer threads
+ *
+ * Every shared variable belongs to one of N partitions, chosen by address,
+ * and every partition has one analyzer thread. Application threads append
+ * events to thread-local per-partition buffers and hand a buffer over only
+ * when it is full or on flush(), so the cost of an event on the application
+ * thread is a vector append. An analyzer thread is the only thread that
+ * touches the per-variable state of its partition, so the analysis needs no
+ * per-variable locks.
+ *
+ * Events of one thread reach each partition in program order. Events of
+ * different threads are interleaved in batch order, not exactly as they
+ * happened.
+ */
+
+#ifndef ASYNCPIPELINE_H
+#define ASYNCPIPELINE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Accesstype.h"
+
+class Lockset;
+class SharedVariable;
+class Thread;
+
+/**
+ * @enum AsyncEventKind
+ * @brief Events the analyzer threads process
+ *
+ * - Access: thread accessed variable holding lockset
+ * - Release: thread released a lock bound to variable
+ * - Reset: barrier reset of every variable (broadcast)
+ * - Retire: thread is going away; replacement takes its place (broadcast)
+ */
+enum class AsyncEventKind : std::uint8_t
+{
+    Access,
+    Release,
+    Reset,
+    Retire
+};
+
+/**
+ * @struct AsyncEvent
+ * @brief One queued event; thread and lockset are captured when it happens
+ */
+struct AsyncEvent
+{
+    AsyncEventKind kind;
+    AccessType type;
+    Thread *thread;
+    union
+    {
+        SharedVariable *variable;
+        Thread *replacement;
+    };
+    const Lockset *lockset;
+};
+
+/**
+ * @class AsyncPipeline
+ * @brief Partitioned event queues with one analyzer thread per partition
+ */
+class AsyncPipeline
+{
+public:
+    /// Events a thread buffers per partition before handing them over.
+    static const std::size_t kBatchEvents = 256;
+
+    /// Called on the partition's analyzer thread for every event.
+    typedef std::function<void(unsigned partition, const AsyncEvent &event)> Handler;
+
+    AsyncPipeline(unsigned partitions, Handler handler);
+    /// Processes everything handed over so far, then stops the analyzers.
+    ~AsyncPipeline();
+
+    unsigned partitions() const { return static_cast<unsigned>(queues.size()); }
+
+    unsigned partitionOf(const void *p) const
+    {
+        std::uintptr_t h = reinterpret_cast<std::uintptr_t>(p);
+        h = (h >> 4) ^ (h >> 12);
+        return static_cast<unsigned>(h % queues.size());
+    }
+
+    /// Buffers an event for the partition of event.variable.
+    void append(const AsyncEvent &event);
+
+    /// Hands the calling thread's buffered events to the analyzers.
+    void flush();
+
+    /// Flushes, then queues event to every partition.
+    void broadcast(const AsyncEvent &event);
+
+    /// Waits until every event handed over so far has been processed.
+    void drain();
+
+private:
+    AsyncPipeline(const AsyncPipeline &) = delete;
+    AsyncPipeline &operator=(const AsyncPipeline &) = delete;
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable done;
+        std::vector<std::vector<AsyncEvent>> batches;
+        std::uint64_t submitted;
+        std::uint64_t processed;
+        bool stopping;
+        std::thread analyzer;
+    };
+
+    struct LocalBuffers;
+    friend struct LocalBuffers;
+
+    void submit(unsigned partition, std::vector<AsyncEvent> &batch);
+    std::vector<std::vector<AsyncEvent>> &localBuffers();
+    void analyze(unsigned partition);
+
+    Handler handler;
+    std::uint64_t session;
+    std::vector<std::unique_ptr<Queue>> queues;
+};
+
+#endif // ASYNCPIPELINE_H
@@ -0,0 +1,283 @@
+/**
+ * @file ConcurrentRegistry.h
+ * @brief Hash-indexed registry of object pointers used for threads and shared
+ * variables, and a sharded index from keys to registered objects
+ */
+
+#ifndef CONCURRENTREGISTRY_H
+#define CONCURRENTREGISTRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class ConcurrentRegistry
+ * @brief Set of pointers with O(1) insert, remove and lookup and lock-free iteration
+ *
+ * Entries live in a chunked array of atomic slots, so iteration is a plain
+ * walk that skips empty slots and never blocks. A hash index from pointer
+ * to slot, split into mutex-guarded shards, makes insertion idempotent and
+ * removal and lookup constant time. Removal clears the slot, which the next
+ * insertion reuses, so a registry with thread churn stays as large as its
+ * peak population. Chunks are only freed by clear(), which must be called
+ * while no other thread uses the registry (locksetMainStart and the
+ * detector destructor).
+ */
+template <typename T>
+class ConcurrentRegistry
+{
+public:
+    ConcurrentRegistry()
+        : directory(new std::atomic<std::atomic<T *> *>[kMaxChunks]),
+          shards(new Shard[kShards]),
+          highWater(0),
+          live(0)
+    {
+        for (std::size_t i = 0; i < kMaxChunks; ++i)
+        {
+            directory[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    ~ConcurrentRegistry() { clear(); }
+
+    ConcurrentRegistry(const ConcurrentRegistry &) = delete;
+    ConcurrentRegistry &operator=(const ConcurrentRegistry &) = delete;
+
+    /// Adds p unless it is already present. Returns whether it was added.
+    bool insertUnique(T *p)
+    {
+        Shard &shard = shardOf(p);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        if (shard.slots.count(p))
+        {
+            return false;
+        }
+        std::size_t slot = claimSlot();
+        slotAt(slot).store(p, std::memory_order_release);
+        shard.slots.emplace(p, slot);
+        live.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /// Removes p. Returns false if p was not registered.
+    bool remove(T *p)
+    {
+        std::size_t slot;
+        {
+            Shard &shard = shardOf(p);
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            auto it = shard.slots.find(p);
+            if (it == shard.slots.end())
+            {
+                return false;
+            }
+            slot = it->second;
+            shard.slots.erase(it);
+            slotAt(slot).store(nullptr, std::memory_order_release);
+        }
+        std::lock_guard<std::mutex> guard(slotsMutex);
+        freeSlots.push_back(slot);
+        live.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool contains(const T *p) const
+    {
+        Shard &shard = shardOf(p);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        return shard.slots.count(const_cast<T *>(p)) != 0;
+    }
+
+    /// Live entries.
+    std::size_t size() const { return live.load(std::memory_order_relaxed); }
+
+    /// Calls f on every live entry. Safe to run concurrently with insert/remove.
+    template <typename F>
+    void forEach(F f) const
+    {
+        std::size_t n = highWater.load(std::memory_order_acquire);
+        for (std::size_t c = 0; c * kChunkSize < n; ++c)
+        {
+            std::atomic<T *> *chunk = directory[c].load(std::memory_order_acquire);
+            std::size_t end = n - c * kChunkSize < kChunkSize ? n - c * kChunkSize : kChunkSize;
+            for (std::size_t i = 0; i < end; ++i)
+            {
+                T *p = chunk[i].load(std::memory_order_acquire);
+                if (p)
+                {
+                    f(p);
+                }
+            }
+        }
+    }
+
+    /// Forgets every entry. Not thread-safe; the registry must be quiescent.
+    void clear()
+    {
+        for (std::size_t c = 0; c < kMaxChunks; ++c)
+        {
+            delete[] directory[c].exchange(nullptr, std::memory_order_relaxed);
+        }
+        for (std::size_t s = 0; s < kShards; ++s)
+        {
+            shards[s].slots.clear();
+        }
+        freeSlots.clear();
+        highWater.store(0, std::memory_order_release);
+        live.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static const std::size_t kChunkBits = 12;
+    static const std::size_t kChunkSize = std::size_t(1) << kChunkBits;
+    static const std::size_t kMaxChunks = 4096;    // 16M entries
+    static const std::size_t kShards = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<T *, std::size_t> slots;
+    };
+
+    Shard &shardOf(const T *p) const
+    {
+        std::uintptr_t h = reinterpret_cast<std::uintptr_t>(p);
+        h = (h >> 4) ^ (h >> 12);
+        return shards[h % kShards];
+    }
+
+    std::atomic<T *> &slotAt(std::size_t slot) const
+    {
+        return directory[slot >> kChunkBits].load(std::memory_order_acquire)[slot & (kChunkSize - 1)];
+    }
+
+    /// A free slot, reused or appended; the chunk is published before highWater.
+    std::size_t claimSlot()
+    {
+        std::lock_guard<std::mutex> guard(slotsMutex);
+        if (!freeSlots.empty())
+        {
+            std::size_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+        std::size_t slot = highWater.load(std::memory_order_relaxed);
+        if (slot >> kChunkBits >= kMaxChunks)
+        {
+            throw std::length_error("ConcurrentRegistry: too many entries");
+        }
+        if (!directory[slot >> kChunkBits].load(std::memory_order_relaxed))
+        {
+            std::atomic<T *> *chunk = new std::atomic<T *>[kChunkSize];
+            for (std::size_t i = 0; i < kChunkSize; ++i)
+            {
+                chunk[i].store(nullptr, std::memory_order_relaxed);
+            }
+            directory[slot >> kChunkBits].store(chunk, std::memory_order_release);
+        }
+        highWater.store(slot + 1, std::memory_order_release);
+        return slot;
+    }
+
+    std::unique_ptr<std::atomic<std::atomic<T *> *>[]> directory;
+    std::unique_ptr<Shard[]> shards;
+    std::mutex slotsMutex;
+    std::vector<std::size_t> freeSlots;
+    std::atomic<std::size_t> highWater;
+    std::atomic<std::size_t> live;
+};
+
+/**
+ * @class ConcurrentIndex
+ * @brief Sharded map from a key to the objects registered under it
+ *
+ * Lookups and updates lock only the shard the key hashes to, with the same
+ * shard count as ConcurrentRegistry. Several objects may share a key; the
+ * one inserted first is found until it is removed.
+ */
+template <typename Key, typename T>
+class ConcurrentIndex
+{
+public:
+    ConcurrentIndex() : shards(new Shard[kShards]) {}
+
+    ConcurrentIndex(const ConcurrentIndex &) = delete;
+    ConcurrentIndex &operator=(const ConcurrentIndex &) = delete;
+
+    void insert(const Key &key, T *p)
+    {
+        Shard &shard = shardOf(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        shard.entries[key].push_back(p);
+    }
+
+    /// Removes p from key. Returns false if p was not indexed under key.
+    bool remove(const Key &key, T *p)
+    {
+        Shard &shard = shardOf(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end())
+        {
+            return false;
+        }
+        std::vector<T *> &list = it->second;
+        for (std::size_t i = 0; i < list.size(); ++i)
+        {
+            if (list[i] == p)
+            {
+                list.erase(list.begin() + i);
+                if (list.empty())
+                {
+                    shard.entries.erase(it);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// The first object indexed under key, or nullptr.
+    T *find(const Key &key) const
+    {
+        Shard &shard = shardOf(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        auto it = shard.entries.find(key);
+        return it == shard.entries.end() ? nullptr : it->second.front();
+    }
+
+    /// Forgets every entry. Not thread-safe; the index must be quiescent.
+    void clear()
+    {
+        for (std::size_t s = 0; s < kShards; ++s)
+        {
+            shards[s].entries.clear();
+        }
+    }
+
+private:
+    static const std::size_t kShards = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<Key, std::vector<T *>> entries;
+    };
+
+    Shard &shardOf(const Key &key) const
+    {
+        std::size_t h = std::hash<Key>()(key);
+        return shards[(h ^ (h >> 16)) % kShards];
+    }
+
+    std::unique_ptr<Shard[]> shards;
+};
+
+#endif // CONCURRENTREGISTRY_H
@@ -5,72 +5,385 @@
  * This class implements a dynamic data race detector for multi-threaded programs
  * using the lockset algorithm. It tracks thread access patterns to shared variables
  * and detects potential data races.
+ *
+ * All callbacks may be invoked concurrently from any number of application
+ * threads. Per-variable metadata is guarded by a striped lock table,
+ * registration uses lock-free registries and statistics are counted per
+ * thread (see DetectorStats.h), so there is no detector-wide lock or
+ * shared counter on the hot path.
+ *
+ * Raw memory can be tracked without SharedVariable objects through
+ * onMemoryAccess, which keeps its state in address-keyed shadow cells (see
+ * ShadowMemory.h) updated with a single compare-and-swap per granule.
+ *
+ * In DetectorMode::Record the callbacks only append binary trace records
+ * (see TraceRecorder.h) and leave the analysis for later. DetectorMode::Stream
+ * pushes the same records into shared-memory rings (see ShmChannel.h) read by
+ * a lockset-daemon process, which replays them into its own detector.
+ *
+ * In DetectorMode::Async variable accesses are queued to analyzer threads
+ * that each own a partition of the variables (see AsyncPipeline.h). Lock
+ * events still update the thread's lockset inline, and every queued access
+ * carries the lockset held at that moment. Race counts are complete after
+ * flush(), which barrierWait and locksetMainEnd call.
+ *
+ * With DetectorEngine::Hybrid a lockset violation on a SharedVariable is
+ * only reported if the two accesses are also unordered by happens-before.
+ * Lock release/acquire pairs, onThreadFork/onThreadJoin and
+ * barrierWait(Thread *) are the happens-before edges (see VectorClock.h).
+ *
+ * Thread, Lock and SharedVariable records made with createThread,
+ * createLock and createSharedVariable are owned by the detector. They live
+ * in slabs carved from one arena (see Arena.h), which locksetMainStart
+ * preallocates and the next locksetMainStart tears down at once. Thread
+ * records are cache-line aligned. The copies that stand in for unregistered
+ * threads come from the same slab.
+ *
+ * Registered threads occupy slots of a fixed-size ThreadSlotTable, and the
+ * registering thread becomes the detector's current thread for its
+ * thread_local handle. The overloads without a Thread argument act on it.
+ * registerThread(int) creates a detector-owned record. Since such a record
+ * outlives unregisterThread, unregistering it does not have to hand the
+ * variables it accessed a copy.
+ *
+ * With setLatencyTracking(true) every callback times itself into
+ * histograms kept per thread slot (see LatencyHistogram.h), so threads
+ * record without sharing a cache line. getLatencySnapshot merges them.
+ * Threads without a slot are not timed, and neither are races found on
+ * the analyzer threads of DetectorMode::Async.
  */
 
 #ifndef DATARACEDETECTOR_H
 #define DATARACEDETECTOR_H
 
-#include <set>
 #include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <pthread.h>
+#include "Arena.h"
+#include "AsyncPipeline.h"
+#include "ConcurrentRegistry.h"
+#include "DetectorPolicy.h"
+#include "DetectorStats.h"
+#include "LatencyHistogram.h"
+#include "StripedLock.h"
 #include "Thread.h"
+#include "ThreadSlotTable.h"
 #include "Lock.h"
+#include "RaceTable.h"
 #include "SharedVariable.h"
+#include "ShadowMemory.h"
+#include "TraceFormat.h"
+#include "VectorClock.h"
 #include "Accesstype.h"
 
 /**
- * @class DataRaceDetector
+ * @enum DetectorMode
+ * @brief What the detector does with the events it receives
+ *
+ * - Online: Run the lockset algorithm as events arrive (default)
+ * - Record: Append events to a trace directory for offline analysis
+ * - Stream: Push events to a lockset-daemon through shared memory
+ * - Async: Queue variable accesses to partitioned analyzer threads
+ */
+enum class DetectorMode
+{
+    Online,
+    Record,
+    Stream,
+    Async
+};
+
+/**
+ * @enum DetectorEngine
+ * @brief How the online analysis decides that a SharedVariable access races
+ *
+ * - Lockset: Eraser; no lock held at every access since the variable became
+ *   shared, i.e. its candidate set C(v) is empty
+ * - Hybrid: Eraser, and no happens-before order between the two accesses.
+ *   Barriers passed with barrierWait(Thread *) order the phases instead
+ *   of resetting variables to Clean.
+ *
+ * The hybrid checks run only in DetectorMode::Online. Memory tracked
+ * through onMemoryAccess and the other modes use the lockset engine.
+ */
+enum class DetectorEngine
+{
+    Lockset,
+    Hybrid
+};
+
+/**
+ * @class BasicDataRaceDetector
  * @brief Implements the Eraser lockset algorithm for data race detection
  * 
  * This detector monitors thread access to shared variables and verifies that
  * all accesses are properly protected by locks. It maintains locksets for each
  * thread and detects when concurrent accesses occur without common locks.
+ *
+ * @tparam Policy Compile-time behaviour (see DetectorPolicy.h). Tracing above
+ *         Policy::maxLogLevel, null-pointer checks and statistics counters are
+ *         removed from the generated code when the policy disables them.
  */
-class DataRaceDetector
+template <typename Policy>
+class BasicDataRaceDetector
 {
 public:
-    DataRaceDetector();
-    ~DataRaceDetector();
+    /// raceSlots sizes the table of distinct races (see RaceTable.h).
+    explicit BasicDataRaceDetector(std::size_t raceSlots = RaceTable::kDefaultSlots);
+    ~BasicDataRaceDetector();
     void onLockAcquire(Thread *t, Lock *l, bool writeMode, SharedVariable *v);
     void onLockRelease(Thread *t, Lock *l, SharedVariable *v);
+    // Lock events for code tracked only through onMemoryAccess
+    void onLockAcquire(Thread *t, Lock *l, bool writeMode);
+    void onLockRelease(Thread *t, Lock *l);
     void onSharedVariableAccess(Thread *t, SharedVariable *v, AccessType type);
+    void onMemoryAccess(Thread *t, const void *addr, std::size_t size, AccessType type);
+    /// Forgets the accesses to [addr, addr + size), which start over as
+    /// Virgin: call it when memory is freed or a thread's stack is reused.
+    /// Not recorded or streamed.
+    void onMemoryFree(const void *addr, std::size_t size);
+    // The same events for the calling thread (see registerThread)
+    void onLockAcquire(Lock *l, bool writeMode, SharedVariable *v);
+    void onLockRelease(Lock *l, SharedVariable *v);
+    void onLockAcquire(Lock *l, bool writeMode);
+    void onLockRelease(Lock *l);
+    void onSharedVariableAccess(SharedVariable *v, AccessType type);
+    void onMemoryAccess(const void *addr, std::size_t size, AccessType type);
+    /// Claims a slot for t and makes it the calling thread's current thread.
     void registerThread(Thread *t);
+    /// Registers a detector-owned record, valid until the next locksetMainStart.
+    Thread *registerThread(int id);
     void unregisterThread(Thread *t);
+    /// Unregisters the calling thread's current thread.
+    void unregisterThread();
+    /// The calling thread's registered Thread, or nullptr.
+    Thread *currentThread() const;
+    /// Registered threads.
+    std::size_t getNumThreads() const;
+    /// Idempotent: registering a variable again has no effect.
     void registerSharedVariable(SharedVariable *v);
+    /// Forgets v; call it before a registered variable is destroyed. Waits
+    /// for queued asynchronous events, which may still refer to v.
+    void unregisterSharedVariable(SharedVariable *v);
+    /// The registered variable with the given id (SharedVariable::getNameId)
+    /// or name, or nullptr. By name, the first variable registered wins.
+    SharedVariable *findSharedVariable(std::uint32_t id);
+    SharedVariable *findSharedVariable(const std::string &name);
+    /// Registered variables, each counted once.
+    std::size_t getNumSharedVariables() const;
     void initializeBarrier(pthread_barrier_t *barrier, const pthread_barrierattr_t *attr, int count);
     void barrierWait();
+    /// Hybrid engine: a happens-before join of every thread at the barrier.
+    /// All threads of a barrier must use the same overload.
+    void barrierWait(Thread *t);
+    // Happens-before edges for the hybrid engine; childId is the Thread id
+    // the child registers with
+    void onThreadFork(Thread *parent, int childId);
+    void onThreadJoin(Thread *parent, int childId);
+    /// Resets every variable to Clean; done by the last thread through a barrier.
+    /// Online this only starts a new barrier generation, in constant time.
+    void onBarrierReset();
     void locksetMainStart();
     void locksetMainEnd();
     void locksetThreadStart();
     void locksetThreadEnd();
     void reportDataRace(Thread *t, SharedVariable *v);
+
+    // Detector-owned records; valid until the next locksetMainStart
+    Thread *createThread(int id);
+    Lock *createLock(int id);
+    /// Returns a lock made with createLock; no thread may hold it.
+    void destroyLock(Lock *l);
+    SharedVariable *createSharedVariable(const std::string &name);
+    /// Arena size preallocated by the next locksetMainStart.
+    void setArenaSize(std::size_t bytes);
+    /// Bytes of the arena in use, and preallocated or grown.
+    std::size_t getArenaUsed() const;
+    std::size_t getArenaCapacity() const;
+
+    // Trace recording
+    bool startRecording(const std::string &directory);
+    void stopRecording();
+
+    // Streaming to lockset-daemon
+    bool startStreaming(const std::string &name);
+    void stopStreaming();
+
+    // Asynchronous analysis on `analyzers` threads
+    bool startAsync(unsigned analyzers);
+    void stopAsync();
+    /// Waits until the calling thread's queued events have been analyzed.
+    void flush();
+
+    /// Adaptive sampling of variable accesses (see SharedVariable). Lock
+    /// events are always processed, so locksets stay exact.
+    void setSampling(bool enabled);
+    bool isSampling() const;
+    /// Retirement of racy variables (on by default): once a race has been
+    /// reported on a SharedVariable whose candidate set is empty, its later
+    /// accesses in this session return after one test. Repeats of its
+    /// races are then no longer counted.
+    void setRetirement(bool enabled);
+    bool isRetiring() const;
+    /// Per-callback latency histograms. While off, a callback pays one
+    /// relaxed load for them.
+    void setLatencyTracking(bool enabled);
+    bool isLatencyTracking() const;
+    /// Every thread's histograms merged; may be taken while threads record.
+    LatencySnapshot getLatencySnapshot() const;
+    /// Set before any thread reports events.
+    void setEngine(DetectorEngine engine);
+    DetectorEngine getEngine() const;
+    DetectorMode getMode() const;
     
-    // Statistics getters
-    int getNumAccesses() const;
-    int getNumLockAcquisitions() const;
-    int getNumLockReleases() const;
-    int getNumDataRaces() const;
+    /// Every counter summed over all threads (see DetectorStats.h). The
+    /// getters below each sum only the counter they return.
+    DetectorStats snapshot() const;
+    /// Variable and memory accesses.
+    std::uint64_t getNumAccesses() const;
+    std::uint64_t getNumLockAcquisitions() const;
+    std::uint64_t getNumLockReleases() const;
+    /// Distinct races (see RaceTable.h); each is reported once.
+    std::uint64_t getNumDataRaces() const;
+    /// Every racing access, repeats included.
+    std::uint64_t getNumRaceOccurrences() const;
+    /// Distinct races with occurrence counts and first/last times.
+    std::vector<RaceRecord> getRaceReports() const;
+    // Variable accesses analyzed and skipped while sampling
+    std::uint64_t getNumSampledAccesses() const;
+    std::uint64_t getNumSkippedAccesses() const;
 
 private:
+    typedef PolicyLogger<Policy> Log;
+
     pthread_barrier_t barrier;
     int barrierCount;
-    bool dataRaceDetected;
+    std::atomic<int> barrierArrivals;
+    /// Barriers passed this run; variables catch up lazily (see enterGeneration).
+    std::atomic<std::uint32_t> barrierGeneration;
+    std::atomic<bool> dataRaceDetected;
+    std::atomic<DetectorMode> mode;
     
     // Tracking data
-    int numAccesses;
-    int numLockAcquisitions;
-    int numLockReleases;
-    int numDataRaces;
+    StatTable stats;
+    std::atomic<bool> sampling;
+    std::atomic<bool> retirement;
+    std::atomic<DetectorEngine> engine;
+    std::atomic<bool> latencyTracking;
+    /// Indexed by thread slot; created by the first thread in the slot to record.
+    std::unique_ptr<std::atomic<LatencyRecorder *>[]> latencyRecorders;
 
-    
+    ThreadSlotTable threads;
+    /// Identifies this detector and run to the thread_local handles.
+    std::atomic<std::uint64_t> session;
+    ConcurrentRegistry<SharedVariable> sharedVariables;
+    ConcurrentIndex<std::uint32_t, SharedVariable> variablesById;
+    ConcurrentIndex<std::string, SharedVariable> variablesByName;
+    StripedLockTable variableLocks;
+    ShadowMemory shadow;
+    RaceTable raceTable;
+    std::unique_ptr<AsyncPipeline> pipeline;
+    /// Barrier generation each analyzer has reached; its Reset events advance
+    /// it in queue order, and variables catch up lazily as in the sync path.
+    std::unique_ptr<std::uint32_t[]> analyzerGenerations;
+    // Declared before the slabs, so objects are destroyed before their memory
+    std::size_t arenaBytes;
+    Arena arena;
+    Slab<Thread, Arena::kCacheLine> threadSlab;
+    Slab<Lock> lockSlab;
+    Slab<SharedVariable> variableSlab;
+    // Hybrid engine: clocks handed from fork to child and from child to join
+    std::mutex threadClocksMutex;
+    std::unordered_map<int, VectorClock> forkClocks;
+    std::unordered_map<int, VectorClock> exitClocks;
+    std::mutex barrierClockMutex;
+    VectorClock barrierClock;
+    // Hybrid engine: a thread's clock index is its slot. The clock its last
+    // holder reached is kept, and the next holder starts above it.
+    std::unique_ptr<std::atomic<std::uint64_t>[]> slotClocks;
+    std::atomic<std::uint32_t> spareClockIndex;
+    bool recording() const
+    {
+        DetectorMode m = mode.load(std::memory_order_relaxed);
+        return m == DetectorMode::Record || m == DetectorMode::Stream;
+    }
+    bool async() const { return mode.load(std::memory_order_relaxed) == DetectorMode::Async; }
+    bool hybrid() const
+    {
+        return engine.load(std::memory_order_relaxed) == DetectorEngine::Hybrid &&
+               mode.load(std::memory_order_relaxed) == DetectorMode::Online;
+    }
+    /// Times the enclosing scope into t's histogram of event, if tracking is on.
+    class LatencyScope
+    {
+    public:
+        LatencyScope(BasicDataRaceDetector *detector, Thread *t, LatencyEvent event)
+            : detector(detector), thread(t), event(event),
+              start(detector->latencyTracking.load(std::memory_order_relaxed) ? LatencyHistogram::now() : 0)
+        {
+        }
+        ~LatencyScope()
+        {
+            if (start)
+            {
+                detector->recordLatency(thread, event, LatencyHistogram::now() - start);
+            }
+        }
 
+    private:
+        BasicDataRaceDetector *detector;
+        Thread *thread;
+        LatencyEvent event;
+        std::uint64_t start;
+    };
+    void recordLatency(Thread *t, LatencyEvent event, std::uint64_t ns);
+    /// Counters of the thread in t's slot, or the shared block if it has none.
+    StatBlock &statsOf(Thread *t) { return stats.forSlot(t ? t->getSlot() : ThreadSlotTable::kNoSlot); }
+    /// currentThread(), logging an error if there is none.
+    Thread *callingThread() const;
+    /// Applies the barrier resets v has missed up to generation. Called with
+    /// v's metadata locked.
+    void enterGeneration(SharedVariable *v, std::uint32_t generation, StatBlock &counts);
+    /// Gives t its clock on first use by the hybrid engine.
+    void ensureClock(Thread *t)
+    {
+        if (!t->hasClock())
+        {
+            startClock(t);
+        }
+    }
+    void startClock(Thread *t);
+    void acquireClock(Thread *t, Lock *l);
+    void releaseClock(Thread *t, Lock *l);
+    void emit(TraceEventKind kind, std::uint32_t thread, std::uint64_t object,
+              std::uint32_t extra = kTraceNone, std::uint16_t flags = 0);
+    bool hasCommonLocks(const Lockset *a, const Lockset *b);
+    /// The locks that protect an access: a write counts only locks held in write mode.
+    static const Lockset *locksetFor(const Thread *t, AccessType type)
+    {
+        return type == AccessType::WRITE ? t->getWriteLockset() : t->getLockset();
+    }
+    void analyzeAccess(Thread *t, SharedVariable *v, AccessType type, const Lockset *held, bool snapshots,
+                       std::uint32_t generation, StatBlock &counts);
+    void analyze(unsigned partition, const AsyncEvent &event);
+    int accessCell(std::atomic<std::uint64_t> &cell, Thread *t, AccessType type, ShadowCell &previous,
+                   StatBlock &counts);
+    /// Counts a race occurrence; true if it is the first of its kind.
+    bool countRace(const RaceKey &key, StatBlock &counts);
+    /// Forgets every aggregated race and the variable names they kept.
+    void clearRaces();
+};
 
+extern template class BasicDataRaceDetector<VerbosePolicy>;
+extern template class BasicDataRaceDetector<ProductionPolicy>;
 
-    std::set<Thread *> threads;
-    std::vector<SharedVariable *> sharedVariables;
-    std::vector<pthread_mutex_t *> mutexes;
-    std::set<Lock *> intersect(const std::set<Lock *> &set1, const std::set<Lock *> &set2);
-    bool hasCommonLocks(const Thread *t1, const Thread *t2);
-};
+/// The detector used by the examples: VerbosePolicy, or ProductionPolicy in `make release`.
+typedef BasicDataRaceDetector<DefaultPolicy> DataRaceDetector;
 
 #endif // DATARACEDETECTOR_H
\ No newline at end of file
@@ -0,0 +1,70 @@
+/**
+ * @file DetectorPolicy.h
+ * @brief Compile-time policies selecting logging, checking and statistics behaviour
+ *
+ * A policy is a struct with three static constants:
+ * - maxLogLevel: most verbose LogLevel that is compiled in; events above it
+ *   are removed entirely, regardless of the runtime Logger level
+ * - checkNullPointers: whether public entry points validate their pointers
+ * - collectStats: whether access and lock counters are maintained
+ *
+ * The detector, Thread, Lock and SharedVariable are explicitly instantiated
+ * for the policies below in their .cpp files; a custom policy needs the same
+ * explicit instantiations added there.
+ */
+
+#ifndef DETECTORPOLICY_H
+#define DETECTORPOLICY_H
+
+#include "Logger.h"
+
+/**
+ * @struct VerbosePolicy
+ * @brief Full tracing, null-pointer checks and statistics (the historic behaviour)
+ */
+struct VerbosePolicy
+{
+    static constexpr LogLevel maxLogLevel = LogLevel::Trace;
+    static constexpr bool checkNullPointers = true;
+    static constexpr bool collectStats = true;
+};
+
+/**
+ * @struct ProductionPolicy
+ * @brief Race reports only, no pointer validation and no per-event counters
+ *
+ * Callers must pass valid pointers. The race count is still maintained.
+ */
+struct ProductionPolicy
+{
+    static constexpr LogLevel maxLogLevel = LogLevel::Race;
+    static constexpr bool checkNullPointers = false;
+    static constexpr bool collectStats = false;
+};
+
+// `make release` defines LOCKSET_PRODUCTION so that the plain
+// DataRaceDetector, Thread, Lock and SharedVariable APIs use ProductionPolicy.
+#ifdef LOCKSET_PRODUCTION
+typedef ProductionPolicy DefaultPolicy;
+#else
+typedef VerbosePolicy DefaultPolicy;
+#endif
+
+/**
+ * @struct PolicyLogger
+ * @brief Forwards to Logger only for events the policy compiles in
+ */
+template <typename Policy>
+struct PolicyLogger
+{
+    template <typename... Args>
+    static void log(LogEvent event, Args... args)
+    {
+        if (Logger::levelOf(event) <= Policy::maxLogLevel)
+        {
+            Logger::log(event, args...);
+        }
+    }
+};
+
+#endif // DETECTORPOLICY_H
@@ -0,0 +1,140 @@
+/**
+ * @file DetectorStats.h
+ * @brief Per-thread 64-bit event counters and their aggregated snapshot
+ *
+ * Every registered thread slot has its own block of counters, padded to
+ * whole cache lines, so threads counting events never write to a line
+ * another thread writes. A counter is bumped with one relaxed fetch_add,
+ * which costs a few cycles on a line no other core touches. Threads
+ * without a slot share one extra block, and asynchronous analyzers have
+ * blocks of their own.
+ *
+ * Nothing is aggregated while events are counted. DetectorStats is the
+ * sum over all blocks at the time it is taken, and the detector's
+ * statistics getters each sum the one counter they report.
+ */
+
+#ifndef DETECTORSTATS_H
+#define DETECTORSTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "SharedVariable.h"
+
+/// Number of values of State.
+const std::size_t kStateCount = static_cast<std::size_t>(State::Empty) + 1;
+
+/**
+ * @enum StatCounter
+ * @brief Events counted per thread
+ *
+ * The counters up to SkippedAccesses are listed once; TransitionsTo is the
+ * first of kStateCount counters, one per State.
+ */
+enum class StatCounter : std::uint8_t
+{
+    VariableAccesses,   ///< onSharedVariableAccess calls analyzed or queued
+    MemoryAccesses,     ///< onMemoryAccess calls
+    LockAcquisitions,
+    LockReleases,
+    BarrierWaits,       ///< Threads passing barrierWait
+    ConflictChecks,     ///< Locksets compared with another thread's access
+    RaceOccurrences,    ///< Racing accesses, repeats included
+    DataRaces,          ///< Distinct races (see RaceTable.h)
+    SampledAccesses,    ///< Accesses analyzed while sampling
+    SkippedAccesses,    ///< Accesses skipped while sampling
+    TransitionsTo       ///< Accesses that moved a variable or granule into a new State
+};
+
+const std::size_t kStatCounters = static_cast<std::size_t>(StatCounter::TransitionsTo) + kStateCount;
+
+/**
+ * @struct DetectorStats
+ * @brief Totals of every counter, as returned by BasicDataRaceDetector::snapshot
+ *
+ * Counters the policy does not collect (accesses, lock events, barrier
+ * waits, conflict checks and transitions without Policy::collectStats)
+ * stay 0. Races and sampling are counted under every policy.
+ */
+struct DetectorStats
+{
+    std::uint64_t variableAccesses;
+    std::uint64_t memoryAccesses;
+    std::uint64_t lockAcquisitions;
+    std::uint64_t lockReleases;
+    std::uint64_t barrierWaits;
+    std::uint64_t conflictChecks;
+    std::uint64_t raceOccurrences;
+    std::uint64_t dataRaces;
+    std::uint64_t sampledAccesses;
+    std::uint64_t skippedAccesses;
+    std::uint64_t transitions[kStateCount];
+    /// Races reported without deduplication because the race table was full.
+    std::uint64_t raceTableOverflows;
+    /// Locksets replaced by the unknown lockset because the table was full (whole process).
+    std::uint64_t locksetOverflows;
+    /// Trace and stream records this process could not write (whole process).
+    std::uint64_t droppedEvents;
+
+    std::uint64_t accesses() const { return variableAccesses + memoryAccesses; }
+    std::uint64_t transitionsTo(State s) const { return transitions[static_cast<std::size_t>(s)]; }
+};
+
+/**
+ * @struct StatBlock
+ * @brief One thread's counters, a whole number of cache lines long
+ */
+struct StatBlock
+{
+    static const std::size_t kCacheLine = 64;
+    static const std::size_t kWords = (kStatCounters * 8 + kCacheLine - 1) / kCacheLine * kCacheLine / 8;
+
+    std::atomic<std::uint64_t> counters[kWords];
+
+    void add(StatCounter c, std::uint64_t n = 1)
+    {
+        counters[static_cast<std::size_t>(c)].fetch_add(n, std::memory_order_relaxed);
+    }
+    void transition(State to)
+    {
+        counters[static_cast<std::size_t>(StatCounter::TransitionsTo) + static_cast<std::size_t>(to)].fetch_add(
+            1, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @class StatTable
+ * @brief Cache-line aligned StatBlocks for thread slots, slotless threads and analyzers
+ */
+class StatTable
+{
+public:
+    /// Blocks shared round-robin by analyzer partitions.
+    static const std::size_t kAnalyzerBlocks = 64;
+
+    explicit StatTable(std::size_t slots);
+    ~StatTable();
+
+    /// The block of a thread slot; any slot number past the table is slotless.
+    StatBlock &forSlot(std::uint32_t slot) { return blocks[slot < slots ? slot : slots]; }
+    StatBlock &forAnalyzer(unsigned partition) { return blocks[slots + 1 + partition % kAnalyzerBlocks]; }
+
+    /// Sum of one counter over every block.
+    std::uint64_t total(StatCounter c) const;
+    /// Sums of all counters; the fields filled from elsewhere are left 0.
+    DetectorStats sum() const;
+
+    /// Zeroes every counter. Counting threads may lose or keep their last events.
+    void clear();
+
+private:
+    StatTable(const StatTable &) = delete;
+    StatTable &operator=(const StatTable &) = delete;
+
+    std::size_t slots;
+    std::size_t count;
+    StatBlock *blocks;
+};
+
+#endif // DETECTORSTATS_H
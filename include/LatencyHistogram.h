@@ -0,0 +1,146 @@
+/**
+ * @file LatencyHistogram.h
+ * @brief Log-bucketed latency histograms written by one thread and merged on demand
+ *
+ * Values are nanoseconds. Values below 16 have a bucket each; above that,
+ * every power of two is split into 16 buckets, so a bucket is at most 1/16
+ * of its lower bound wide (HDR histogram style, 4 significant bits).
+ * Values from 2^40 ns, about 18 minutes, share the last bucket.
+ *
+ * A histogram has a single writer. Its counters are atomics updated with a
+ * plain load and store, so recording costs no locked instruction, and a
+ * thread merging it concurrently reads counts that are at most a few
+ * events behind.
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @enum LatencyEvent
+ * @brief Detector callbacks whose latency is recorded
+ */
+enum class LatencyEvent : std::uint8_t
+{
+    VariableAccess,   ///< onSharedVariableAccess
+    MemoryAccess,     ///< onMemoryAccess
+    LockAcquire,      ///< onLockAcquire
+    LockRelease,      ///< onLockRelease
+    BarrierWait,      ///< barrierWait, including the time spent waiting
+    RaceReport        ///< Counting and reporting one race, within an access
+};
+
+const std::size_t kLatencyEvents = 6;
+
+const char *latencyEventName(LatencyEvent event);
+
+/**
+ * @struct LatencySummary
+ * @brief Percentiles of one histogram; each is the upper bound of its bucket
+ */
+struct LatencySummary
+{
+    std::uint64_t count;
+    double mean;
+    std::uint64_t p50;
+    std::uint64_t p99;
+    std::uint64_t p999;
+    std::uint64_t max;
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Fixed-size histogram of nanosecond durations
+ */
+class LatencyHistogram
+{
+public:
+    static const int kSubBucketBits = 4;
+    static const std::size_t kSubBuckets = 1u << kSubBucketBits;
+    static const int kMaxExponent = 40;
+    static const std::size_t kBuckets = (kMaxExponent - kSubBucketBits + 1) * kSubBuckets;
+
+    LatencyHistogram();
+
+    /// Single writer only.
+    void record(std::uint64_t ns)
+    {
+        bump(buckets[bucketOf(ns)], 1);
+        bump(total, 1);
+        bump(sum, ns);
+        if (ns > maximum.load(std::memory_order_relaxed))
+        {
+            maximum.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    /// Adds other's counts; this histogram must not be recorded into meanwhile.
+    void add(const LatencyHistogram &other);
+    void clear();
+
+    std::uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    /// Upper bound of the bucket holding the q-quantile, at most the maximum.
+    std::uint64_t valueAt(double q) const;
+    LatencySummary summary() const;
+
+    static std::size_t bucketOf(std::uint64_t ns)
+    {
+        if (ns < kSubBuckets)
+        {
+            return static_cast<std::size_t>(ns);
+        }
+        int exponent = 63 - __builtin_clzll(ns);
+        if (exponent >= kMaxExponent)
+        {
+            return kBuckets - 1;
+        }
+        int shift = exponent - kSubBucketBits;
+        return static_cast<std::size_t>(shift + 1) * kSubBuckets + ((ns >> shift) & (kSubBuckets - 1));
+    }
+    static std::uint64_t upperBound(std::size_t bucket);
+
+    /// Monotonic nanoseconds for timing callbacks.
+    static std::uint64_t now();
+
+private:
+    static void bump(std::atomic<std::uint64_t> &counter, std::uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    std::atomic<std::uint64_t> buckets[kBuckets];
+    std::atomic<std::uint64_t> total;
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> maximum;
+};
+
+/**
+ * @struct LatencyRecorder
+ * @brief One histogram per LatencyEvent, owned by one thread slot
+ */
+struct LatencyRecorder
+{
+    LatencyHistogram events[kLatencyEvents];
+
+    LatencyHistogram &operator[](LatencyEvent event) { return events[static_cast<std::size_t>(event)]; }
+};
+
+/**
+ * @struct LatencySnapshot
+ * @brief Merged latency of every thread, per callback
+ */
+struct LatencySnapshot
+{
+    LatencySummary events[kLatencyEvents];
+
+    const LatencySummary &operator[](LatencyEvent event) const { return events[static_cast<std::size_t>(event)]; }
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -8,7 +8,11 @@
 
 #include "Thread.h"
 #include "SharedVariable.h"
+#include "DetectorPolicy.h"
+#include "VectorClock.h"
 #include <set>
+#include <atomic>
+#include <cstdint>
 
 class Thread;
 class SharedVariable;
@@ -18,25 +22,46 @@ class SharedVariable;
  * @brief Represents a synchronization lock that can be acquired by threads
  * 
  * Tracks which thread currently holds the lock and which shared variable
- * it protects.
+ * it protects. The fields are atomic because several threads may report
+ * acquisitions of the same lock concurrently.
+ *
+ * Each Lock also receives a dense index at construction, which identifies
+ * it in Locksets and is its bit position in LockBitset. A destroyed lock
+ * gives its index back; indices are reused oldest first, so they stay below
+ * the largest number of locks alive at once.
+ *
+ * The hybrid engine keeps the join of the clocks of all releases of the lock
+ * in getClock(); the detector guards it with the lock's stripe.
  */
 class Lock
 {
 public:
     Lock(int id);
+    ~Lock();
+    template <typename Policy = DefaultPolicy>
     void acquire(Thread *t, bool writeMode, SharedVariable *v);
+    template <typename Policy = DefaultPolicy>
     void release(Thread *t);
     bool isLocked() const;
     Thread *getHoldingThread() const;
     SharedVariable *getSharedVariable() const;
     void setSharedVariable(SharedVariable *v);
     int getId() const;
+    std::uint32_t getDenseIndex() const;
+    /// The live Lock with the given dense index, or nullptr.
+    static Lock *byDenseIndex(std::uint32_t index);
+    VectorClock &getClock();
 
 private:
     int id;
-    bool is_locked;
-    Thread *holding_thread;
-    SharedVariable *shared_variable;
+    std::uint32_t denseIndex;
+    std::atomic<bool> is_locked;
+    std::atomic<Thread *> holding_thread;
+    std::atomic<SharedVariable *> shared_variable;
+    VectorClock clock;
+
+    Lock(const Lock &) = delete;
+    Lock &operator=(const Lock &) = delete;
 };
 
 #endif
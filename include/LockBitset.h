@@ -0,0 +1,222 @@
+/**
+ * @file LockBitset.h
+ * @brief Fixed-width lock bitsets indexed by dense lock index, with SIMD kernels
+ *
+ * Every Lock gets a small dense index when it is constructed. A LockBitset
+ * stores up to 256 indices inline (one, two or four 64-bit words) and spills
+ * to a heap array for programs with more locks. The AND and AND+test kernels
+ * use AVX2 when the translation unit is compiled with it (make
+ * SIMD_FLAGS=-mavx2), SSE2 on any x86-64 target, and plain 64-bit words
+ * otherwise.
+ */
+
+#ifndef LOCKBITSET_H
+#define LOCKBITSET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace bitset_kernels
+{
+
+/// Name of the widest kernel compiled in, for benchmark output.
+inline const char *kernelName()
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+/// Returns true if a and b have at least one bit in common in their first n words.
+inline bool intersects(const std::uint64_t *a, const std::uint64_t *b, std::size_t n)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        if (!_mm256_testz_si256(x, x))
+        {
+            return true;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i x = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF)
+        {
+            return true;
+        }
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        if (a[i] & b[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// dst = a & b over n words.
+inline void andInto(std::uint64_t *dst, const std::uint64_t *a, const std::uint64_t *b, std::size_t n)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), x);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i x = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), x);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        dst[i] = a[i] & b[i];
+    }
+}
+
+} // namespace bitset_kernels
+
+/**
+ * @class LockBitset
+ * @brief Set of dense lock indices; inline up to 256 bits, heap-backed beyond
+ */
+class LockBitset
+{
+public:
+    static const std::size_t kInlineWords = 4;
+
+    LockBitset() : words(inlineWords), wordCount(0)
+    {
+        clearInline();
+    }
+
+    explicit LockBitset(const std::vector<std::uint32_t> &indices) : LockBitset()
+    {
+        std::uint32_t maxIndex = 0;
+        for (std::uint32_t i : indices)
+        {
+            maxIndex = i > maxIndex ? i : maxIndex;
+        }
+        if (!indices.empty())
+        {
+            resize(maxIndex / 64 + 1);
+        }
+        for (std::uint32_t i : indices)
+        {
+            words[i / 64] |= std::uint64_t(1) << (i % 64);
+        }
+    }
+
+    LockBitset(const LockBitset &other) : LockBitset()
+    {
+        resize(other.wordCount);
+        for (std::size_t i = 0; i < wordCount; ++i)
+        {
+            words[i] = other.words[i];
+        }
+    }
+
+    /// The intersection of a and b, computed with the AND kernel.
+    LockBitset(const LockBitset &a, const LockBitset &b) : LockBitset()
+    {
+        resize(a.wordCount < b.wordCount ? a.wordCount : b.wordCount);
+        bitset_kernels::andInto(words, a.words, b.words, wordCount);
+    }
+
+    LockBitset &operator=(const LockBitset &other)
+    {
+        if (this != &other)
+        {
+            resize(other.wordCount);
+            for (std::size_t i = 0; i < wordCount; ++i)
+            {
+                words[i] = other.words[i];
+            }
+        }
+        return *this;
+    }
+
+    bool test(std::uint32_t index) const
+    {
+        std::size_t w = index / 64;
+        return w < wordCount && (words[w] >> (index % 64)) & 1;
+    }
+
+    bool intersects(const LockBitset &other) const
+    {
+        std::size_t n = wordCount < other.wordCount ? wordCount : other.wordCount;
+        return bitset_kernels::intersects(words, other.words, n);
+    }
+
+    /// Appends the indices in the set to out, ascending.
+    void appendIndices(std::vector<std::uint32_t> &out) const
+    {
+        for (std::size_t w = 0; w < wordCount; ++w)
+        {
+            for (std::uint64_t bits = words[w]; bits; bits &= bits - 1)
+            {
+                out.push_back(static_cast<std::uint32_t>(w * 64 + __builtin_ctzll(bits)));
+            }
+        }
+    }
+
+    std::size_t getWordCount() const { return wordCount; }
+    bool isInline() const { return words == inlineWords; }
+
+private:
+    void clearInline()
+    {
+        for (std::size_t i = 0; i < kInlineWords; ++i)
+        {
+            inlineWords[i] = 0;
+        }
+    }
+
+    void resize(std::size_t count)
+    {
+        wordCount = count;
+        if (count <= kInlineWords)
+        {
+            words = inlineWords;
+            clearInline();
+            heapWords.clear();
+        }
+        else
+        {
+            heapWords.assign(count, 0);
+            words = heapWords.data();
+        }
+    }
+
+    std::uint64_t inlineWords[kInlineWords];
+    std::vector<std::uint64_t> heapWords;
+    std::uint64_t *words;
+    std::size_t wordCount;
+};
+
+#endif // LOCKBITSET_H
@@ -0,0 +1,174 @@
+/**
+ * @file Lockset.h
+ * @brief Hash-consed immutable locksets and the process-wide table that interns them
+ *
+ * Every distinct set of locks exists exactly once as a Lockset with a small
+ * integer id. Threads publish their current lockset as a pointer to such an
+ * object, so readers never see a set being modified, and set operations can
+ * be memoized by id.
+ */
+
+#ifndef LOCKSET_H
+#define LOCKSET_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Arena.h"
+#include "LockBitset.h"
+
+class Lock;
+
+/**
+ * @enum LocksetRepresentation
+ * @brief How LocksetTable computes intersections that are not yet memoized
+ *
+ * - Sorted: merge of the index-ordered lock arrays (default)
+ * - Bitset: AND+test of the dense-index bitsets with SIMD kernels
+ */
+enum class LocksetRepresentation
+{
+    Sorted,
+    Bitset
+};
+
+/**
+ * @class Lockset
+ * @brief Immutable, interned set of locks ordered by dense lock index
+ *
+ * Instances are only created by LocksetTable and are never destroyed, so a
+ * const Lockset* can be shared freely between threads. A lockset is the
+ * ordered array of its locks' dense indices; it holds no Lock pointers, so
+ * it stays valid after its locks are destroyed. A destroyed lock's index is
+ * reused by a later Lock (see Lock.h), which then belongs to the locksets
+ * the old lock was in. The LockBitset of the same indices is built on first
+ * use, which only the Bitset representation makes.
+ *
+ * The unknown lockset (LocksetTable::unknownSet) stands for a set the table
+ * had no id left for. It lists no locks but is not empty: it shares a lock
+ * with every set, so accesses made under it never race.
+ */
+class Lockset
+{
+public:
+    /// Id of the unknown lockset; never returned for an interned set.
+    static const std::uint32_t kUnknownId = 0xFFFFFFFFu;
+
+    std::uint32_t getId() const { return id; }
+    std::size_t size() const { return indices.size(); }
+    bool empty() const { return indices.empty() && id != kUnknownId; }
+    bool unknown() const { return id == kUnknownId; }
+    /// Dense indices of the locks, ascending (see Lock::byDenseIndex).
+    const std::vector<std::uint32_t> &getIndices() const { return indices; }
+    bool contains(const Lock *lock) const;
+    const LockBitset &getBits() const;
+
+    /// Intersection test by merging the sorted arrays.
+    bool intersectsSorted(const Lockset &other) const;
+    /// Intersection test with the bitset kernels.
+    bool intersectsBitset(const Lockset &other) const { return getBits().intersects(other.getBits()); }
+
+private:
+    friend class LocksetTable;
+
+    /// Memoized result of adding or removing the lock with dense index lockIndex.
+    struct Transition
+    {
+        std::uint32_t lockIndex;
+        const Lockset *result;
+    };
+    static const int kTransitionSlots = 4;
+
+    Lockset(std::uint32_t id, std::vector<std::uint32_t> indices);
+
+    std::uint32_t id;
+    std::vector<std::uint32_t> indices;
+    mutable std::atomic<const LockBitset *> bits;
+    mutable std::atomic<const Transition *> added[kTransitionSlots];
+    mutable std::atomic<const Transition *> removed[kTransitionSlots];
+};
+
+/**
+ * @class LocksetTable
+ * @brief Interns locksets and memoizes operations on them
+ *
+ * withLock/withoutLock results are cached on the source lockset, and once
+ * its few slots are taken, in a direct-mapped cache keyed by the lockset
+ * and lock. intersect/hasCommonLock results go in a direct-mapped cache
+ * keyed by the pair of ids. So once a program's locksets have been seen,
+ * acquiring, releasing and checking locks is lock-free and allocation-free,
+ * even when a lockset such as the empty one is left for many locks.
+ *
+ * Lockset and transition nodes are placed in an arena owned by the table,
+ * which is never reset, since the nodes live as long as the process.
+ *
+ * When every id is taken, intern logs an error once, counts the set in
+ * overflows() and returns the unknown lockset. Operations on the unknown
+ * lockset return it again, so a thread that got it keeps it: its accesses
+ * are no longer checked, rather than checked against a wrong set.
+ */
+class LocksetTable
+{
+public:
+    static LocksetTable &instance();
+
+    const Lockset *emptySet() const { return emptyLockset; }
+    const Lockset *unknownSet() const { return unknownLockset; }
+    const Lockset *byId(std::uint32_t id) const;
+    const Lockset *intern(std::vector<Lock *> locks);
+    const Lockset *withLock(const Lockset *set, Lock *lock);
+    const Lockset *withoutLock(const Lockset *set, Lock *lock);
+    const Lockset *intersect(const Lockset *a, const Lockset *b);
+    bool hasCommonLock(const Lockset *a, const Lockset *b);
+
+    std::size_t size() const;
+    /// Locksets that got no id and were replaced by the unknown lockset.
+    std::uint64_t overflows() const { return overflowed.load(std::memory_order_relaxed); }
+
+    void setRepresentation(LocksetRepresentation representation);
+    LocksetRepresentation getRepresentation() const;
+
+private:
+    LocksetTable();
+    LocksetTable(const LocksetTable &) = delete;
+    LocksetTable &operator=(const LocksetTable &) = delete;
+
+    /// Interns the set of sorted, distinct dense indices.
+    const Lockset *internIndices(std::vector<std::uint32_t> indices);
+    const Lockset *computeIntersection(const Lockset *a, const Lockset *b);
+    const Lockset *cachedTransition(std::atomic<const Lockset::Transition *> *slots, std::atomic<std::uint64_t> *overflow,
+                                    const Lockset *set, std::uint32_t lockIndex) const;
+    void cacheTransition(std::atomic<const Lockset::Transition *> *slots, std::atomic<std::uint64_t> *overflow,
+                         const Lockset *set, std::uint32_t lockIndex, const Lockset *result);
+
+    // Ids are packed three to a 64-bit cache entry: [a:21][b:21][result:21][valid:1].
+    static const int kIdBits = 21;
+    static const std::uint32_t kMaxCachedId = (1u << kIdBits) - 1;
+    static const std::size_t kCacheEntries = 4096;
+    /// Transitions whose lockset's slots are full: [set:21][lock index:21][result:21][valid:1].
+    static const std::size_t kTransitionEntries = 8192;
+
+    static const std::size_t kChunkBits = 10;
+    static const std::size_t kChunkSize = std::size_t(1) << kChunkBits;
+    static const std::size_t kMaxChunks = 4096;
+
+    static const std::size_t kNodeArenaBytes = std::size_t(64) << 10;
+
+    Arena nodes;
+    std::mutex internMutex;
+    std::unordered_map<std::uint64_t, std::vector<const Lockset *>> byHash;
+    std::atomic<std::uint32_t> count;
+    std::atomic<LocksetRepresentation> representation;
+    std::atomic<std::atomic<const Lockset *> *> chunks[kMaxChunks];
+    std::atomic<std::uint64_t> pairCache[kCacheEntries];
+    std::atomic<std::uint64_t> addedOverflow[kTransitionEntries];
+    std::atomic<std::uint64_t> removedOverflow[kTransitionEntries];
+    const Lockset *emptyLockset;
+    const Lockset *unknownLockset;
+    std::atomic<std::uint64_t> overflowed;
+};
+
+#endif // LOCKSET_H
@@ -0,0 +1,36 @@
+/**
+ * @file LocksetPreload.h
+ * @brief C interface of liblockset_preload.so for programs that annotate accesses
+ *
+ * liblockset_preload.so tracks the locks, barriers and threads of an
+ * unmodified program through interposed pthread calls. It cannot see
+ * plain loads and stores, so races are found on the memory a program
+ * reports with lockset_preload_access. The functions are declared weak:
+ * a program calling them still runs without the library, and it should
+ * test the function's address before each call.
+ *
+ * @code
+ * if (lockset_preload_access) lockset_preload_access(&counter, sizeof counter, 1);
+ * @endcode
+ */
+
+#ifndef LOCKSETPRELOAD_H
+#define LOCKSETPRELOAD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Reports an access by the calling thread to size bytes at addr.
+__attribute__((weak, visibility("default"))) void lockset_preload_access(const void *addr, size_t size, int isWrite);
+
+/// Distinct races found so far (see RaceTable.h).
+__attribute__((weak, visibility("default"))) unsigned long long lockset_preload_races(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOCKSETPRELOAD_H
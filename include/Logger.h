@@ -0,0 +1,179 @@
+/**
+ * @file Logger.h
+ * @brief Asynchronous binary logger used for all detector trace output
+ *
+ * Application threads append fixed-size binary records (event id plus integer
+ * arguments) to their own lock-free ring buffer. A background thread drains
+ * the rings, formats the records and writes them in large batches, so no
+ * string formatting or stream locking happens on the detection hot path.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @enum LogLevel
+ * @brief Verbosity levels; a level enables itself and every level below it
+ *
+ * - Off: Nothing is logged
+ * - Race: Data race reports only (production)
+ * - Error: Misuse of the detector API (null pointers, bad barrier, ...)
+ * - Info: Registration, barrier and start/finish messages
+ * - Trace: Every lock and access event
+ */
+enum class LogLevel : std::uint8_t
+{
+    Off,
+    Race,
+    Error,
+    Info,
+    Trace
+};
+
+/**
+ * @enum LogEvent
+ * @brief Identifies the message format of a log record
+ *
+ * The high byte encodes the level of the event so that the level check at
+ * the call site is a compile-time constant.
+ */
+enum class LogEvent : std::uint16_t
+{
+    DataRace = 0x100,
+    MemoryRace,
+
+    NullThreadRegister = 0x200,
+    NullThreadUnregister,
+    NullVariableRegister,
+    NullLockAcquire,
+    NullLockRelease,
+    NullAccess,
+    InvalidRaceReport,
+    ReleaseNotOwner,
+    BarrierInvalidParams,
+    BarrierInitFailed,
+    BarrierNotInitialized,
+    NullThreadLockAcquire,
+    NullThreadLockRelease,
+    NullThreadVariableAccess,
+    NullLockThreadAcquire,
+    NullLockThreadRelease,
+    NullMemoryAccess,
+    RaceTableFull,
+    NullThreadSync,
+    ThreadTableFull,
+    UnregisteredThread,
+    LocksetTableFull,
+    ClockIndexOverflow,
+    NullVariableUnregister,
+
+    ThreadRegistered = 0x300,
+    ThreadUnregistered,
+    VariableRegistered,
+    DetectorInitialized,
+    RaceSummaryDetected,
+    RaceSummaryClean,
+    RaceOccurrences,
+    MemoryRaceOccurrences,
+    DetectorFinished,
+    BarrierInitialized,
+    BarrierReached,
+    VariableUnregistered,
+
+    LockAcquired = 0x400,
+    LockReleased,
+    AccessAttempt,
+    VariableState,
+    CurrentlyAccessing,
+    WriteConflict,
+    ReadConflict,
+    Accessed,
+    ResettingVariable,
+    VariableAccess,
+    StateAfterAccess,
+    ThreadLockAcquired,
+    ThreadLockReleased,
+    MemoryAccess,
+    OrderedAccess,
+    ThreadForked,
+    ThreadJoined
+};
+
+/**
+ * @class Logger
+ * @brief Process-wide asynchronous logger with per-thread ring buffers
+ *
+ * The initial level is taken from the LOCKSET_LOG_LEVEL environment variable
+ * (off, race, error, info or trace) and defaults to trace. When a thread's
+ * ring is full the producer waits for the background thread instead of
+ * dropping records, so race reports are never lost.
+ */
+class Logger
+{
+public:
+    static const int kMaxArgs = 4;
+
+    static constexpr LogLevel levelOf(LogEvent event)
+    {
+        return static_cast<LogLevel>(static_cast<std::uint16_t>(event) >> 8);
+    }
+
+    static bool enabled(LogLevel level)
+    {
+        return level <= static_cast<LogLevel>(currentLevel.load(std::memory_order_relaxed));
+    }
+
+    /// Appends a record for event if its level is enabled. All arguments are integers.
+    template <typename... Args>
+    static void log(LogEvent event, Args... args)
+    {
+        static_assert(sizeof...(Args) <= kMaxArgs, "too many log arguments");
+        if (enabled(levelOf(event)))
+        {
+            const std::int64_t values[] = {0, static_cast<std::int64_t>(args)...};
+            append(event, values + 1, sizeof...(Args));
+        }
+    }
+
+    static void setLevel(LogLevel level);
+    static LogLevel getLevel();
+
+    /// Redirects formatted output. Error records go to errorStream.
+    static void setOutput(std::FILE *stream, std::FILE *errorStream);
+
+    /**
+     * Returns a small integer identifying name, used as a %v log argument,
+     * with one reference. Ids are unique among names still referenced; an
+     * id is reused once its last reference is released and every record
+     * logged before that has been written out.
+     */
+    static std::uint32_t internName(const std::string &name);
+
+    /// Adds a reference to an interned name.
+    static void retainName(std::uint32_t id);
+
+    /// Drops a reference to an interned name.
+    static void releaseName(std::uint32_t id);
+
+    /// While held (calls nest), released ids are not reused, so that a trace
+    /// can name every variable it recorded.
+    static void holdNames(bool hold);
+
+    /// Every interned name, indexed by id; ids not in use are empty.
+    static std::vector<std::string> internedNames();
+
+    /// Writes out every record appended before the call. Blocks until done.
+    static void flush();
+
+private:
+    static std::atomic<std::uint8_t> currentLevel;
+    static void append(LogEvent event, const std::int64_t *args, int count);
+};
+
+#endif // LOGGER_H
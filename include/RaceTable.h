@@ -0,0 +1,113 @@
+/**
+ * @file RaceTable.h
+ * @brief Fixed-size, lock-free table that aggregates repeated race reports
+ *
+ * A race is identified by where it happened (variable name id or memory
+ * granule), the two threads, the type of the racing access and the state
+ * it found, and the ids of the two interned locksets. The first occurrence
+ * claims a slot and is reported. Later occurrences only bump the slot's
+ * count and last-seen time, so a racy loop costs one hash, a few atomic
+ * operations and no output per iteration.
+ *
+ * The table is allocated once and never grows. Recording takes no lock and
+ * allocates nothing. When a race finds no free slot within kMaxProbes, it
+ * is counted as an overflow, and the caller reports it as if it were new.
+ */
+
+#ifndef RACETABLE_H
+#define RACETABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Accesstype.h"
+
+enum class State;
+
+/**
+ * @struct RaceKey
+ * @brief Identity of an aggregated race
+ */
+struct RaceKey
+{
+    enum Kind : std::uint8_t
+    {
+        Variable,
+        Memory
+    };
+
+    std::uint64_t location;       ///< Variable name id, or granule address for Memory
+    std::uint32_t thread;         ///< Thread making the racing access
+    std::uint32_t otherThread;    ///< Previous accessor
+    std::uint32_t lockset;        ///< Lockset id of thread at the access
+    std::uint32_t otherLockset;   ///< Lockset id of otherThread, if known
+    AccessType type;
+    State state;                  ///< State the access found
+    Kind kind;
+
+    bool operator==(const RaceKey &other) const;
+};
+
+/**
+ * @struct RaceRecord
+ * @brief One aggregated race, as returned by RaceTable::snapshot
+ */
+struct RaceRecord
+{
+    RaceKey key;
+    std::uint64_t count;
+    std::uint64_t firstSeen;   ///< steady_clock nanoseconds
+    std::uint64_t lastSeen;
+};
+
+/**
+ * @class RaceTable
+ * @brief Open-addressing hash table of RaceRecords with a fixed slot count
+ */
+class RaceTable
+{
+public:
+    enum Outcome
+    {
+        New,       ///< First occurrence; the caller reports it
+        Repeat,    ///< Already known; only counted
+        Overflow   ///< No free slot; not aggregated
+    };
+
+    static const std::size_t kDefaultSlots = 1024;
+    static const int kMaxProbes = 32;
+
+    explicit RaceTable(std::size_t slots = kDefaultSlots);
+
+    Outcome record(const RaceKey &key);
+
+    /// Every aggregated race in slot order. Call only when no thread records.
+    std::vector<RaceRecord> snapshot() const;
+
+    /// Forgets every race. Call only when no thread records.
+    void clear();
+
+    std::uint64_t overflows() const { return overflowed.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::uint64_t> hash;    ///< 0 while free
+        std::atomic<bool> ready;            ///< key is written
+        RaceKey key;
+        std::atomic<std::uint64_t> count;
+        std::atomic<std::uint64_t> firstSeen;
+        std::atomic<std::uint64_t> lastSeen;
+    };
+
+    RaceTable(const RaceTable &) = delete;
+    RaceTable &operator=(const RaceTable &) = delete;
+
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask;
+    std::atomic<std::uint64_t> overflowed;
+};
+
+#endif // RACETABLE_H
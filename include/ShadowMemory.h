@@ -0,0 +1,152 @@
+/**
+ * @file ShadowMemory.h
+ * @brief Address-keyed shadow cells for tracking raw memory without SharedVariable objects
+ *
+ * Every 8-byte granule of application memory maps to one 64-bit shadow cell
+ * holding the lockset state, the last accessing thread, the lockset that
+ * thread held and the generation the cell was written in. The mapping is a fixed two-level table: the upper address bits
+ * select a 4 GiB region whose shadow is reserved with one MAP_NORESERVE mmap
+ * on first touch, and the lower bits index the cell directly. Lookup is two
+ * dependent loads and no hashing; physical pages are only committed for
+ * granules that are actually accessed.
+ */
+
+#ifndef SHADOWMEMORY_H
+#define SHADOWMEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "SharedVariable.h"
+
+/**
+ * @struct ShadowCell
+ * @brief Decoded form of a shadow cell
+ *
+ * Packed layout, low bits first:
+ * [state:3][accessed:1][owner:22][lockset:21][generation:16][unused:1]
+ * owner is the accessing thread's id plus one (0 means none) and lockset the
+ * id of its interned lockset at the time of the access. A zero cell is a
+ * Virgin granule that was never accessed. A cell written in another
+ * generation than ShadowMemory's current one counts as Virgin too.
+ */
+struct ShadowCell
+{
+    static const int kOwnerBits = 22;
+    static const int kLocksetBits = 21;
+    static const int kGenerationBits = 16;
+    static const int kGenerationShift = 4 + kOwnerBits + kLocksetBits;
+    /// Stored for lockset ids too large for the cell; treated as "may hold any lock".
+    static const std::uint32_t kUnknownLockset = (1u << kLocksetBits) - 1;
+
+    State state;
+    bool accessed;
+    int owner;
+    std::uint32_t locksetId;
+    std::uint32_t generation;
+
+    /// Decodes bits as seen in generation: a cell of another one is Virgin.
+    static ShadowCell decode(std::uint64_t bits, std::uint32_t generation)
+    {
+        if (((bits >> kGenerationShift) & ((1u << kGenerationBits) - 1)) != generation)
+        {
+            bits = 0;
+        }
+        ShadowCell c;
+        c.state = static_cast<State>(bits & 0x7);
+        c.accessed = (bits >> 3) & 1;
+        c.owner = static_cast<int>((bits >> 4) & ((1u << kOwnerBits) - 1)) - 1;
+        c.locksetId = static_cast<std::uint32_t>((bits >> (4 + kOwnerBits)) & kUnknownLockset);
+        c.generation = generation;
+        return c;
+    }
+
+    std::uint64_t encode() const
+    {
+        std::uint64_t ownerBits = static_cast<std::uint64_t>(owner + 1) & ((1u << kOwnerBits) - 1);
+        std::uint64_t locksetBits = locksetId < kUnknownLockset ? locksetId : kUnknownLockset;
+        return static_cast<std::uint64_t>(state) |
+               (static_cast<std::uint64_t>(accessed) << 3) |
+               (ownerBits << 4) |
+               (locksetBits << (4 + kOwnerBits)) |
+               (static_cast<std::uint64_t>(generation) << kGenerationShift);
+    }
+};
+
+/**
+ * @class ShadowMemory
+ * @brief Lazily reserved two-level table of shadow cells
+ *
+ * Covers the 47-bit user address space; cellFor returns nullptr for addresses
+ * above it or when a region cannot be reserved, and such accesses are simply
+ * not tracked. Setting LOCKSET_SHADOW_HUGEPAGES=1 asks the kernel to back
+ * shadow regions with transparent huge pages.
+ */
+class ShadowMemory
+{
+public:
+    static const int kGranuleShift = 3;
+    static const int kRegionShift = 32;
+    static const int kAddressBits = 47;
+
+    ShadowMemory();
+    ~ShadowMemory();
+
+    /// Returns the cell for the granule containing addr, reserving its region if needed.
+    std::atomic<std::uint64_t> *cellFor(const void *addr)
+    {
+        std::uintptr_t a = reinterpret_cast<std::uintptr_t>(addr);
+        std::uintptr_t region = a >> kRegionShift;
+        if (region >= kRegions || !regions)
+        {
+            return nullptr;
+        }
+        std::atomic<std::uint64_t> *cells = regions[region].load(std::memory_order_acquire);
+        if (!cells)
+        {
+            cells = mapRegion(region);
+            if (!cells)
+            {
+                return nullptr;
+            }
+        }
+        return cells + ((a & ((std::uintptr_t(1) << kRegionShift) - 1)) >> kGranuleShift);
+    }
+
+    /// Generation that cells are read and written in.
+    std::uint32_t generation() const { return currentGeneration.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Returns every cell to Virgin by starting a new generation
+     *
+     * Constant time: cells are not visited. When the generation counter
+     * wraps, which is once every 2^16 calls, wipe() runs instead, so a cell
+     * last written 2^16 generations ago cannot pass for a current one.
+     * Call only while no cell is being accessed.
+     */
+    void clear();
+    /// Returns every cell to Virgin by dropping the committed shadow pages,
+    /// which also gives their memory back. Visits every reserved region.
+    void wipe();
+    /// Returns the cells of every granule overlapping [addr, addr + size) to
+    /// Virgin. Whole shadow pages are dropped, partial ones zeroed.
+    void clear(const void *addr, std::size_t size);
+
+    /// Number of 4 GiB regions whose shadow has been reserved.
+    std::size_t mappedRegions() const;
+
+private:
+    static const std::size_t kRegions = std::size_t(1) << (kAddressBits - kRegionShift);
+    static const std::size_t kRegionCells = std::size_t(1) << (kRegionShift - kGranuleShift);
+
+    ShadowMemory(const ShadowMemory &) = delete;
+    ShadowMemory &operator=(const ShadowMemory &) = delete;
+
+    std::atomic<std::uint64_t> *mapRegion(std::uintptr_t region);
+
+    std::atomic<std::atomic<std::uint64_t> *> *regions;
+    std::atomic<std::uint32_t> currentGeneration;
+    bool hugePages;
+};
+
+#endif // SHADOWMEMORY_H
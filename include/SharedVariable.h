@@ -6,11 +6,14 @@
 #ifndef SHAREDVARIABLE_H
 #define SHAREDVARIABLE_H
 
+#include <atomic>
 #include <string>
-#include <set>
+#include <cstdint>
 #include "Thread.h"
 #include "Accesstype.h"
+#include "DetectorPolicy.h"
 #include "Lock.h"
+#include "VectorClock.h"
 
 class Thread;
 class Lock;
@@ -39,40 +42,137 @@ enum class State
     Empty
 };
 
+/**
+ * @brief State reached from current after an access of the given type
+ *
+ * Shared by SharedVariable::access and the shadow-memory cells. Clean and
+ * Empty are terminal.
+ */
+State nextState(State current, AccessType type);
+
+/**
+ * @brief Whether an unprotected access of the given type by a second thread
+ *        races with a location in state current
+ */
+bool isConflictingAccess(State current, AccessType type);
+
 /**
  * @class SharedVariable
  * @brief Represents a shared variable that can be accessed by multiple threads
  * 
  * Tracks access patterns, current state, and candidate locks that protect
  * this variable according to the lockset algorithm.
+ *
+ * With adaptive sampling, an access is analyzed once every 2^shift accesses.
+ * shift grows by one after every kSamplesPerBackoff race-free samples, up to
+ * kMaxSampleShift. It drops back to 0 on a race, or when the access is made
+ * under a different lockset than the last sampled one. Accesses under a new
+ * lockset are never skipped.
+ *
+ * getClock() holds the read/write epochs the hybrid engine checks accesses
+ * against (see DetectorEngine).
+ *
+ * A barrier does not touch the variables it resets. The detector bumps its
+ * barrier generation instead, and a variable whose recorded generation is
+ * older becomes Clean when the detector next looks at it.
+ *
+ * The candidate set C(v) is an interned Lockset (see Lockset.h), so
+ * refining it with the locks of an access is one memoized intersection,
+ * whatever the number of threads. Unset, it stands for every lock. A
+ * retired variable is no longer analyzed for the rest of the detector
+ * session it was retired in (see DataRaceDetector::setRetirement).
  */
 class SharedVariable
 {
 private:
     std::string name;
+    std::uint32_t nameId;
     bool is_accessed;
     Thread *accessing_thread;
+    const Lockset *accessing_lockset;   ///< Lockset at the last access (DetectorMode::Async)
     State state;
-    std::set<Lock *> candidateLocks;
+    const Lockset *candidate_locks;     ///< C(v); nullptr until the first refinement
+    std::atomic<std::uint64_t> retired_session;
+
+    // Adaptive sampling (see DataRaceDetector::setSampling)
+    std::atomic<std::int32_t> sample_countdown;
+    std::atomic<const Lockset *> sampled_lockset;
+    std::uint8_t sample_shift;
+    std::uint8_t sample_streak;
+
+    std::uint32_t generation;   ///< Barrier generation the state belongs to
+
+    VariableClock clock;
 
 public:
+    static const std::uint8_t kSamplesPerBackoff = 16;
+    static const std::uint8_t kMaxSampleShift = 10;
+
     SharedVariable(const std::string &name);
     SharedVariable(int id) : SharedVariable(std::to_string(id)) {}
+    ~SharedVariable();
     bool isAccessed() const;
     Thread *getAccessingThread() const;
     Thread *releaseThread(Thread *t);
+    void replaceAccessingThread(Thread *from, Thread *to);
+    const Lockset *getAccessingLockset() const;
+    void setAccessingLockset(const Lockset *set);
+
+    /// Whether an access made holding held may go unanalyzed. Lock-free.
+    bool skipSample(const Lockset *held)
+    {
+        return held == sampled_lockset.load(std::memory_order_relaxed) &&
+               sample_countdown.fetch_sub(1, std::memory_order_relaxed) > 1;
+    }
+    /// Adapts the rate after an analyzed access; called with the variable's metadata locked.
+    void sampled(const Lockset *held, bool raced);
+    /// Current sampling rate is 1 / 2^getSampleShift().
+    unsigned getSampleShift() const;
+    VariableClock &getClock();
+    /// Records the detector's barrier generation without resetting the state.
+    void setGeneration(std::uint32_t current) { generation = current; }
+    /// Moves to barrier generation current, resetting to Clean if it was older. Returns whether it reset.
+    bool enterGeneration(std::uint32_t current)
+    {
+        if (generation == current)
+        {
+            return false;
+        }
+        generation = current;
+        clean();
+        return true;
+    }
+    /// Resets to Clean for a new barrier generation and forgets C(v).
+    void clean()
+    {
+        state = State::Clean;
+        candidate_locks = nullptr;
+    }
     void reset();
     std::string getName() const;
+    std::uint32_t getNameId() const;
+    template <typename Policy = DefaultPolicy>
     void access(Thread *t, AccessType type);
     State getState() const;
     void setState(State newState);
-    std::set<Lock *> &getCandidateLocks();
+    /// C(v), or nullptr while it still stands for every lock.
+    const Lockset *getCandidateLocks() const;
+    /// C(v) = C(v) ∩ held; returns the refined set.
+    const Lockset *refineCandidateLocks(const Lockset *held);
     static std::string stateToString(State state);
     static std::string stateToStringShort(State state);
     void addCandidateLock(Lock *lock);
     void removeCandidateLock(Lock *lock);
+    /// Makes C(v) every lock again.
     void clearCandidateLocks();
     void printCandidateLocks();
+    /// Whether the variable was retired in the given detector session. Lock-free.
+    bool isRetired(std::uint64_t session) const
+    {
+        return retired_session.load(std::memory_order_relaxed) == session;
+    }
+    /// Stops analysis of the variable for the rest of session.
+    void retire(std::uint64_t session) { retired_session.store(session, std::memory_order_relaxed); }
 };
 
 #endif
@@ -0,0 +1,160 @@
+/**
+ * @file ShmChannel.h
+ * @brief Streams detector events to another process through POSIX shared memory
+ *
+ * The analysis process (lockset-daemon) creates a shared-memory object with
+ * a control block and a fixed number of single-producer/single-consumer
+ * rings of TraceRecords (see TraceFormat.h). Every application thread of the
+ * instrumented process claims one ring the first time it streams an event,
+ * and from then on pushing an event is a store into that ring and a release
+ * increment of its tail. The daemon runs the detector on the other side, so
+ * its CPU time, memory and crashes stay out of the instrumented process.
+ *
+ * What a producer does when its ring is full is chosen by the daemon:
+ * - Block: wait until the daemon has made room, checking now and then that
+ *   it still runs; once it is gone the process stops streaming
+ * - Drop: discard the event and count it in the control block
+ * - Spill: append the event to a per-ring spill file and, once the ring has
+ *   room again, push a marker telling the daemon where to read the spilled
+ *   events, so per-thread order is preserved
+ */
+
+#ifndef SHMCHANNEL_H
+#define SHMCHANNEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include "TraceFormat.h"
+
+/**
+ * @enum Backpressure
+ * @brief Producer behaviour when its ring is full
+ */
+enum class Backpressure : std::uint32_t
+{
+    Block,
+    Drop,
+    Spill
+};
+
+/// Ring record kind (outside TraceEventKind) announcing spilled records:
+/// thread is the producer pid, object the file offset and extra the count.
+static const std::uint16_t kShmSpillMarker = 0xFFFF;
+
+/**
+ * @struct ShmRing
+ * @brief One SPSC ring; head is advanced by the daemon, tail by the producer
+ */
+struct ShmRing
+{
+    enum : std::uint32_t
+    {
+        Free,
+        Active,
+        Closed
+    };
+
+    alignas(64) std::atomic<std::uint64_t> head;
+    alignas(64) std::atomic<std::uint64_t> tail;
+    alignas(64) std::atomic<std::uint32_t> state;
+    std::atomic<std::uint64_t> dropped;
+    // records[capacity] follow, capacity being ShmControl::ringCapacity.
+};
+
+/**
+ * @struct ShmControl
+ * @brief Start of the shared-memory object, followed by ringCount rings
+ */
+struct ShmControl
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t ringCount;
+    std::uint32_t ringCapacity;     ///< Records per ring, a power of two
+    std::uint32_t backpressure;     ///< Backpressure
+    std::uint32_t daemonPid;        ///< Process that created the object
+    std::atomic<std::uint32_t> daemonExited;    ///< Set when the daemon shuts down
+    char spillDirectory[256];
+    std::atomic<std::uint32_t> producers;       ///< Producers that ever attached
+    std::atomic<std::uint32_t> activeProducers; ///< Producers still attached
+    std::atomic<std::uint32_t> namesLock;
+    std::atomic<std::uint32_t> namesUsed;       ///< Bytes used in names
+    char names[1 << 20];                        ///< "<id> <name>\n" lines
+
+    static std::size_t ringBytes(std::uint32_t capacity);
+    static std::size_t totalBytes(std::uint32_t rings, std::uint32_t capacity);
+    ShmRing *ring(std::uint32_t index);
+    TraceRecord *records(ShmRing *ring);
+};
+
+/**
+ * @class ShmChannel
+ * @brief Producer side: process-wide connection to a lockset-daemon
+ */
+class ShmChannel
+{
+public:
+    /// Attaches to the daemon's shared memory, waiting up to timeoutMs for it to appear.
+    static bool attach(const std::string &name, int timeoutMs = 5000);
+
+    /// Closes every ring of this process. Call only when no thread is streaming.
+    static void detach();
+
+    static bool attached();
+
+    static void push(TraceEventKind kind, std::uint32_t thread, std::uint64_t object,
+                     std::uint32_t extra = kTraceNone, std::uint16_t flags = 0);
+
+    /// Makes name printable by the daemon as the name of variable id.
+    static void publishName(std::uint32_t id, const std::string &name);
+
+    /// Events dropped by this process (Backpressure::Drop, no free ring, or
+    /// the event a blocked producer was pushing when the daemon went away).
+    static std::uint64_t droppedRecords();
+};
+
+/**
+ * @class ShmChannelServer
+ * @brief Daemon side: owns the shared-memory object and drains the rings
+ */
+class ShmChannelServer
+{
+public:
+    ShmChannelServer();
+    ~ShmChannelServer();
+
+    /// Creates (or replaces) the shared-memory object. Returns false on failure.
+    bool create(const std::string &name, std::uint32_t rings, std::uint32_t capacity,
+                Backpressure backpressure, const std::string &spillDirectory);
+
+    ShmControl *control() const { return ctl; }
+
+    /// Appends up to max available records of ring index to out, replacing
+    /// spill markers with the spilled records. Returns the number of ring
+    /// slots consumed.
+    std::size_t drain(std::uint32_t index, std::deque<TraceRecord> &out, std::size_t max);
+
+    /// Name published for variable id, or "#<id>" if none was.
+    std::string nameOf(std::uint32_t id);
+
+    /// Events dropped by all producers.
+    std::uint64_t droppedRecords() const;
+
+private:
+    ShmChannelServer(const ShmChannelServer &) = delete;
+    ShmChannelServer &operator=(const ShmChannelServer &) = delete;
+
+    void readSpill(const TraceRecord &marker, std::uint32_t index, std::deque<TraceRecord> &out);
+
+    std::string shmName;
+    ShmControl *ctl;
+    std::size_t mappedBytes;
+    std::uint32_t namesParsed;
+    std::unordered_map<std::uint32_t, std::string> names;
+};
+
+#endif // SHMCHANNEL_H
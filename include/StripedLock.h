@@ -0,0 +1,44 @@
+/**
+ * @file StripedLock.h
+ * @brief Fixed table of cache-line padded mutexes selected by address
+ *
+ * Per-variable metadata is protected by one of a fixed number of stripes
+ * instead of a single detector-wide lock, so accesses to different shared
+ * variables proceed in parallel.
+ */
+
+#ifndef STRIPEDLOCK_H
+#define STRIPEDLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @class StripedLockTable
+ * @brief Maps an object address onto one of a fixed set of mutexes
+ */
+class StripedLockTable
+{
+public:
+    static const std::size_t kStripes = 256;
+
+    std::mutex &forAddress(const void *p)
+    {
+        std::uintptr_t h = reinterpret_cast<std::uintptr_t>(p);
+        // Objects are at least 8-byte aligned; mix the upper bits in so that
+        // neighbouring variables land on different stripes.
+        h = (h >> 4) ^ (h >> 12);
+        return stripes[h % kStripes].mutex;
+    }
+
+private:
+    struct alignas(64) Stripe
+    {
+        std::mutex mutex;
+    };
+
+    Stripe stripes[kStripes];
+};
+
+#endif // STRIPEDLOCK_H
@@ -6,7 +6,11 @@
 #ifndef THREAD_H
 #define THREAD_H
 
-#include <set>
+#include <atomic>
+#include "DetectorPolicy.h"
+#include "Lockset.h"
+#include "ThreadSlotTable.h"
+#include "VectorClock.h"
 
 // Forward declaration of the Lock class
 class Lock;
@@ -17,23 +21,91 @@ class Lock;
  * 
  * Tracks which locks a thread currently holds, distinguishing between
  * read locks and write locks for proper lockset algorithm implementation.
+ *
+ * Both locksets are interned, immutable Lockset objects (see Lockset.h).
+ * The owning thread replaces them atomically on acquire and release, so other
+ * threads can read a consistent snapshot without locking. Interned locksets
+ * live forever, so the thread memoizes its last acquire and release step,
+ * and locking the same lock again does not consult the LocksetTable.
+ *
+ * acquireLock/releaseLock take a policy (see DetectorPolicy.h) that decides
+ * whether they validate their argument and trace.
+ *
+ * For the hybrid engine a thread also has a clock index and a vector clock
+ * (see VectorClock.h). The detector assigns them the first time the hybrid
+ * engine needs them (startClock), and tick() advances the thread's own
+ * entry. Until then the clock is empty and the index kNoClockIndex. Only
+ * the owning thread touches the clock.
+ *
+ * While registered, a thread holds a slot of the detector's ThreadSlotTable
+ * (getSlot). Copies do not inherit the slot.
  */
 class Thread {
 public:
-    Thread() : id(0) {}  // Default constructor
-    Thread(int id) : id(id) {}
+    static const std::uint32_t kNoClockIndex = 0xFFFFFFFFu;
+
+    Thread() : Thread(0) {}  // Default constructor
+    Thread(int id)
+        : id(id),
+          locksHeld(LocksetTable::instance().emptySet()),
+          writeLocksHeld(LocksetTable::instance().emptySet()),
+          lastAcquire{nullptr, 0, nullptr},
+          lastRelease{nullptr, 0, nullptr},
+          clockIndex(kNoClockIndex),
+          slot(ThreadSlotTable::kNoSlot),
+          ownedByDetector(false) {}
+    Thread(const Thread &other);
+    Thread &operator=(const Thread &other);
 
     int getId() const;
-    const std::set<Lock*>& getLockset() const;
-    const std::set<Lock*>& getWriteLockset() const;
+    const Lockset* getLockset() const;
+    const Lockset* getWriteLockset() const;
 
+    template <typename Policy = DefaultPolicy>
     void acquireLock(Lock* lock, bool writeMode);
+    template <typename Policy = DefaultPolicy>
     void releaseLock(Lock* lock);
 
+    std::uint32_t getClockIndex() const { return clockIndex; }
+    bool hasClock() const { return clockIndex != kNoClockIndex; }
+    /// Gives the thread clock index index, its own entry starting at first.
+    void startClock(std::uint32_t index, std::uint64_t first)
+    {
+        clockIndex = index;
+        clock.set(index, first);
+    }
+    /// Gives the clock index back; the clock keeps what the thread has seen.
+    void stopClock() { clockIndex = kNoClockIndex; }
+    VectorClock &getClock() { return clock; }
+    const VectorClock &getClock() const { return clock; }
+    /// Starts a new epoch of this thread.
+    void tick() { clock.increment(clockIndex); }
+
+    /// Dense index while registered, ThreadSlotTable::kNoSlot otherwise.
+    std::uint32_t getSlot() const { return slot; }
+    void setSlot(std::uint32_t s) { slot = s; }
+    /// Records the detector creates outlive unregisterThread.
+    bool isOwnedByDetector() const { return ownedByDetector; }
+    void setOwnedByDetector(bool owned) { ownedByDetector = owned; }
+
 private:
+    /// from with the lock of dense index lockIndex added (or removed) is to.
+    struct LocksetStep
+    {
+        const Lockset *from;
+        std::uint32_t lockIndex;
+        const Lockset *to;
+    };
+
     int id;
-    std::set<Lock*> locksHeld;     
-    std::set<Lock*> writeLocksHeld; 
+    std::atomic<const Lockset*> locksHeld;
+    std::atomic<const Lockset*> writeLocksHeld;
+    LocksetStep lastAcquire;
+    LocksetStep lastRelease;
+    std::uint32_t clockIndex;
+    VectorClock clock;
+    std::uint32_t slot;
+    bool ownedByDetector;
 };
 
 #endif // THREAD_H
@@ -0,0 +1,81 @@
+/**
+ * @file ThreadSlotTable.h
+ * @brief Fixed-capacity table of registered threads with small, reusable indices
+ *
+ * A registered thread occupies one slot. Its slot number is a dense index
+ * below kCapacity, so per-thread data can be kept in arrays and bitsets
+ * indexed by it. Slots are claimed and released through an occupancy
+ * bitmap: claiming the lowest free slot is one compare-and-swap unless
+ * another thread claims a slot in the same word at the same time, and
+ * releasing is one atomic AND. A released slot is the first to be reused.
+ */
+
+#ifndef THREADSLOTTABLE_H
+#define THREADSLOTTABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class Thread;
+
+/**
+ * @class ThreadSlotTable
+ * @brief Lock-free slot allocator mapping slot numbers to Thread records
+ */
+class ThreadSlotTable
+{
+public:
+    static const std::uint32_t kCapacity = 1024;
+    static const std::uint32_t kNoSlot = 0xFFFFFFFFu;
+
+    ThreadSlotTable();
+
+    /// Claims the lowest free slot for t. Returns kNoSlot when the table is full.
+    std::uint32_t claim(Thread *t);
+
+    /// Frees slot; the Thread it held is no longer listed.
+    void release(std::uint32_t slot);
+
+    Thread *at(std::uint32_t slot) const
+    {
+        return slot < kCapacity ? slots[slot].load(std::memory_order_acquire) : nullptr;
+    }
+
+    /// Occupied slots.
+    std::size_t size() const;
+
+    /// Calls f on every registered thread. Safe to run concurrently with claim/release.
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (std::uint32_t w = 0; w < kWords; ++w)
+        {
+            std::uint64_t bits = used[w].load(std::memory_order_acquire);
+            while (bits)
+            {
+                std::uint32_t slot = w * 64 + static_cast<std::uint32_t>(__builtin_ctzll(bits));
+                bits &= bits - 1;
+                Thread *t = slots[slot].load(std::memory_order_acquire);
+                if (t)
+                {
+                    f(t);
+                }
+            }
+        }
+    }
+
+    /// Frees every slot. The table must be quiescent.
+    void clear();
+
+private:
+    static const std::uint32_t kWords = kCapacity / 64;
+
+    ThreadSlotTable(const ThreadSlotTable &) = delete;
+    ThreadSlotTable &operator=(const ThreadSlotTable &) = delete;
+
+    std::atomic<std::uint64_t> used[kWords];
+    std::atomic<Thread *> slots[kCapacity];
+};
+
+#endif // THREADSLOTTABLE_H
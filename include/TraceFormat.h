@@ -0,0 +1,122 @@
+/**
+ * @file TraceFormat.h
+ * @brief On-disk format of recorded detector event traces (version 1)
+ *
+ * A trace is a directory. Every recording OS thread writes its own sequence
+ * of segment files named
+ *
+ *     thread-<writer>-<segment>.trace
+ *
+ * where writer numbers the recording threads from 0 and segment numbers that
+ * thread's files from 0. Each segment is a TraceSegmentHeader followed by
+ * recordCount TraceRecords, all little-endian and naturally aligned. A
+ * segment whose process died before it was sealed has recordCount 0 and is
+ * zero-filled after its last record; readers should stop at the first record
+ * whose kind is TraceEventKind::End.
+ *
+ * The directory also contains names.txt, one "<id> <name>" line per
+ * interned shared variable name, so tools can print variables the way the
+ * online detector does.
+ *
+ * This header has no dependencies beyond <cstdint> so other tools can use it
+ * directly.
+ */
+
+#ifndef TRACEFORMAT_H
+#define TRACEFORMAT_H
+
+#include <cstdint>
+
+static const char kTraceMagic[8] = {'L', 'S', 'T', 'R', 'A', 'C', 'E', '\0'};
+static const std::uint32_t kTraceVersion = 1;
+
+/// Value of TraceRecord::thread and TraceRecord::extra when there is none.
+static const std::uint32_t kTraceNone = 0xFFFFFFFFu;
+
+/**
+ * @enum TraceEventKind
+ * @brief Event stored in a TraceRecord and the meaning of its fields
+ *
+ * | kind             | object               | extra                    | flags bit 0 |
+ * |------------------|----------------------|--------------------------|-------------|
+ * | ThreadRegister   | -                    | -                        | -           |
+ * | ThreadUnregister | -                    | -                        | -           |
+ * | VariableRegister | variable name id     | -                        | -           |
+ * | LockAcquire      | lock id              | variable name id or none | write mode  |
+ * | LockRelease      | lock id              | variable name id or none | -           |
+ * | VariableAccess   | variable name id     | -                        | WRITE       |
+ * | MemoryAccess     | address              | access size in bytes     | WRITE       |
+ * | BarrierWait      | -                    | barrier thread count     | -           |
+ * | BarrierReset     | -                    | -                        | -           |
+ * | MainStart        | -                    | -                        | -           |
+ * | MainEnd          | -                    | -                        | -           |
+ *
+ * BarrierWait is written by every thread before it blocks; its thread field
+ * is none because barrierWait() takes no Thread. BarrierReset is written by
+ * the one thread pthread_barrier_wait elects after the barrier opens and
+ * marks the point where the online detector resets every variable.
+ */
+enum class TraceEventKind : std::uint16_t
+{
+    End = 0,
+    ThreadRegister,
+    ThreadUnregister,
+    VariableRegister,
+    LockAcquire,
+    LockRelease,
+    VariableAccess,
+    MemoryAccess,
+    BarrierWait,
+    BarrierReset,
+    MainStart,
+    MainEnd
+};
+
+/**
+ * @enum TraceClock
+ * @brief Source of TraceRecord::timestamp
+ *
+ * - Tsc: x86 time-stamp counter ticks (invariant TSC assumed)
+ * - SteadyNanoseconds: std::chrono::steady_clock nanoseconds
+ */
+enum class TraceClock : std::uint32_t
+{
+    Tsc = 0,
+    SteadyNanoseconds = 1
+};
+
+/**
+ * @struct TraceSegmentHeader
+ * @brief First 64 bytes of every segment file
+ */
+struct TraceSegmentHeader
+{
+    char magic[8];              ///< kTraceMagic
+    std::uint32_t version;      ///< kTraceVersion
+    std::uint32_t recordSize;   ///< sizeof(TraceRecord)
+    std::uint32_t writer;       ///< Recording thread number
+    std::uint32_t segment;      ///< Sequence number within the writer
+    std::uint64_t recordCount;  ///< Valid records; 0 if the segment was never sealed
+    std::uint32_t clock;        ///< TraceClock
+    std::uint32_t reserved[7];
+};
+
+/**
+ * @struct TraceRecord
+ * @brief One fixed-size event; see TraceEventKind for the field meanings
+ */
+struct TraceRecord
+{
+    std::uint64_t timestamp;
+    std::uint64_t object;
+    std::uint32_t thread;   ///< Thread::getId() of the acting thread, or kTraceNone
+    std::uint32_t extra;
+    std::uint16_t kind;     ///< TraceEventKind
+    std::uint16_t flags;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(TraceSegmentHeader) == 64, "trace segment header must be 64 bytes");
+static_assert(sizeof(TraceRecord) == 32, "trace records must be 32 bytes");
+
+#endif // TRACEFORMAT_H
@@ -0,0 +1,51 @@
+/**
+ * @file TraceRecorder.h
+ * @brief Appends detector events to per-thread memory-mapped trace segments
+ *
+ * Recording is the cheap alternative to online detection: each event becomes
+ * one 32-byte TraceRecord stored into the calling thread's mapped segment
+ * file, with no locking, formatting or system call. Segment files are
+ * created, prefaulted and sealed on a recorder thread; a thread whose
+ * segment fills up only swaps in the spare prepared for it. The traces are
+ * analyzed later; the format is in TraceFormat.h.
+ */
+
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "TraceFormat.h"
+
+/**
+ * @class TraceRecorder
+ * @brief Process-wide trace recorder; one trace directory at a time
+ */
+class TraceRecorder
+{
+public:
+    /// Segment file size including its header.
+    static const std::size_t kSegmentBytes = std::size_t(4) << 20;
+
+    /// Starts writing segments into directory, creating it if needed. Returns false on failure.
+    static bool start(const std::string &directory);
+
+    /// Seals every segment and writes names.txt. Call only when no thread is recording.
+    static void stop();
+
+    static bool active();
+
+    static void record(TraceEventKind kind, std::uint32_t thread, std::uint64_t object,
+                       std::uint32_t extra = kTraceNone, std::uint16_t flags = 0);
+
+    /// Records dropped because a segment could not be created.
+    static std::uint64_t droppedRecords();
+
+    /// Current value of the clock used for record timestamps.
+    static std::uint64_t now();
+
+    static TraceClock clock();
+};
+
+#endif // TRACERECORDER_H
@@ -0,0 +1,304 @@
+/**
+ * @file Tracked.h
+ * @brief Header-only wrappers that report their own accesses and lock operations
+ *
+ * Tracked<T> reports every read and write of the value it holds, and
+ * TrackedMutex<M> every acquisition and release of the mutex it wraps, to
+ * the detector installed with setTrackingDetector. Events are reported for
+ * the calling thread through the detector's thread_local current thread
+ * (see registerThread), so no Thread* is passed around. Nothing is reported
+ * while no detector is installed or the calling thread is not registered.
+ *
+ * @code
+ * DataRaceDetector drd;
+ * setTrackingDetector(&drd);
+ * Tracked<long> counter;
+ * TrackedMutex<std::mutex> counterMutex;
+ *
+ * // on each thread
+ * drd.registerThread(id);
+ * {
+ *     std::lock_guard<TrackedMutex<std::mutex>> guard(counterMutex);
+ *     counter = counter + 1;
+ * }
+ * @endcode
+ *
+ * TrackedMutex<M> has the interface of M: lock/try_lock/unlock acquire in
+ * write mode, and lock_shared/try_lock_shared/unlock_shared, which exist
+ * when M has them (std::shared_mutex in C++17), in read mode. It works with
+ * std::lock_guard, std::unique_lock and std::lock. TrackedScopedLock locks
+ * several mutexes at once without deadlock, like C++17 std::scoped_lock.
+ *
+ * Building with LOCKSET_NO_TRACKING removes the reporting. Tracked<T> and
+ * TrackedMutex<M> then hold only a T and an M, and every member is an
+ * inline forward to them, so they compile to the same code as the plain
+ * types and the wrappers can stay in shipping builds. `make tracked-codegen`
+ * checks this on the functions of examples/tracked_benchmark.cpp.
+ */
+
+#ifndef TRACKED_H
+#define TRACKED_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <tuple>
+#include "DataRaceDetector.h"
+
+/// The detector that Tracked and TrackedMutex of one Detector type report to.
+template <typename Detector>
+struct TrackingTarget
+{
+    static std::atomic<Detector *> &slot()
+    {
+        // Constant-initialized, so reading it needs no guard.
+        static std::atomic<Detector *> detector(nullptr);
+        return detector;
+    }
+};
+
+/// Installs d for every Tracked and TrackedMutex of its type; nullptr stops reporting.
+template <typename Detector>
+void setTrackingDetector(Detector *d)
+{
+    TrackingTarget<Detector>::slot().store(d, std::memory_order_release);
+}
+
+namespace tracking_detail
+{
+
+/// The Lock record of a TrackedMutex; empty when tracking is compiled out.
+template <bool Enabled>
+class LockRecord
+{
+};
+
+template <>
+class LockRecord<true>
+{
+protected:
+    LockRecord() : record(nextId()) {}
+    Lock *lockRecord() { return &record; }
+
+private:
+    static int nextId()
+    {
+        static std::atomic<int> next(1);
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Lock record;
+};
+
+#ifdef LOCKSET_NO_TRACKING
+const bool kEnabled = false;
+#else
+const bool kEnabled = true;
+#endif
+
+/// Unlocks the first I mutexes of a tuple, last one first.
+template <std::size_t I, typename Tuple>
+struct UnlockAll
+{
+    static void run(Tuple &mutexes)
+    {
+        std::get<I - 1>(mutexes).unlock();
+        UnlockAll<I - 1, Tuple>::run(mutexes);
+    }
+};
+
+template <typename Tuple>
+struct UnlockAll<0, Tuple>
+{
+    static void run(Tuple &) {}
+};
+
+inline void lockAll() {}
+
+template <typename M>
+void lockAll(M &m)
+{
+    m.lock();
+}
+
+template <typename M1, typename M2, typename... Rest>
+void lockAll(M1 &m1, M2 &m2, Rest &...rest)
+{
+    std::lock(m1, m2, rest...);
+}
+
+} // namespace tracking_detail
+
+/**
+ * @class Tracked
+ * @brief A value whose reads and writes are reported as memory accesses
+ *
+ * get() and the conversion to T are reads, set() and assignment writes.
+ * Construction is not reported. The value's address is the location, so
+ * a Tracked<T> races like the T it replaces.
+ */
+template <typename T, typename Detector = DataRaceDetector>
+class Tracked
+{
+public:
+    Tracked() : value() {}
+    Tracked(const T &v) : value(v) {}
+    Tracked(const Tracked &other) : value(other.get()) {}
+
+    T get() const
+    {
+        report(AccessType::READ);
+        return value;
+    }
+
+    void set(const T &v)
+    {
+        report(AccessType::WRITE);
+        value = v;
+    }
+
+    operator T() const { return get(); }
+
+    Tracked &operator=(const T &v)
+    {
+        set(v);
+        return *this;
+    }
+
+    Tracked &operator=(const Tracked &other)
+    {
+        set(other.get());
+        return *this;
+    }
+
+private:
+    void report(AccessType type) const
+    {
+#ifndef LOCKSET_NO_TRACKING
+        if (Detector *d = TrackingTarget<Detector>::slot().load(std::memory_order_acquire))
+        {
+            d->onMemoryAccess(&value, sizeof value, type);
+        }
+#else
+        (void)type;
+#endif
+    }
+
+    T value;
+};
+
+/**
+ * @class TrackedMutex
+ * @brief A mutex whose acquisitions and releases are reported as lock events
+ *
+ * The detector sees a lock only once it is held, and a release before the
+ * mutex is let go, so no other thread can interleave an acquisition.
+ */
+template <typename M, typename Detector = DataRaceDetector>
+class TrackedMutex : private tracking_detail::LockRecord<tracking_detail::kEnabled>
+{
+public:
+    TrackedMutex() {}
+
+    void lock()
+    {
+        mutex.lock();
+        acquired(true);
+    }
+
+    bool try_lock()
+    {
+        bool locked = mutex.try_lock();
+        if (locked)
+        {
+            acquired(true);
+        }
+        return locked;
+    }
+
+    void unlock()
+    {
+        releasing();
+        mutex.unlock();
+    }
+
+    void lock_shared()
+    {
+        mutex.lock_shared();
+        acquired(false);
+    }
+
+    bool try_lock_shared()
+    {
+        bool locked = mutex.try_lock_shared();
+        if (locked)
+        {
+            acquired(false);
+        }
+        return locked;
+    }
+
+    void unlock_shared()
+    {
+        releasing();
+        mutex.unlock_shared();
+    }
+
+    /// The wrapped mutex; locking it directly bypasses the detector.
+    M &native() { return mutex; }
+
+private:
+    TrackedMutex(const TrackedMutex &) = delete;
+    TrackedMutex &operator=(const TrackedMutex &) = delete;
+
+    void acquired(bool writeMode)
+    {
+#ifndef LOCKSET_NO_TRACKING
+        if (Detector *d = TrackingTarget<Detector>::slot().load(std::memory_order_acquire))
+        {
+            d->onLockAcquire(this->lockRecord(), writeMode);
+        }
+#else
+        (void)writeMode;
+#endif
+    }
+
+    void releasing()
+    {
+#ifndef LOCKSET_NO_TRACKING
+        if (Detector *d = TrackingTarget<Detector>::slot().load(std::memory_order_acquire))
+        {
+            d->onLockRelease(this->lockRecord());
+        }
+#endif
+    }
+
+    M mutex;
+};
+
+/**
+ * @class TrackedScopedLock
+ * @brief Holds any number of mutexes for a scope, locked without deadlock
+ *
+ * Two or more mutexes are locked with std::lock; they are unlocked in
+ * reverse order. With TrackedMutex arguments each lock is reported.
+ */
+template <typename... Mutexes>
+class TrackedScopedLock
+{
+public:
+    explicit TrackedScopedLock(Mutexes &...m) : mutexes(m...) { tracking_detail::lockAll(m...); }
+
+    ~TrackedScopedLock()
+    {
+        tracking_detail::UnlockAll<sizeof...(Mutexes), std::tuple<Mutexes &...>>::run(mutexes);
+    }
+
+private:
+    TrackedScopedLock(const TrackedScopedLock &) = delete;
+    TrackedScopedLock &operator=(const TrackedScopedLock &) = delete;
+
+    std::tuple<Mutexes &...> mutexes;
+};
+
+#endif // TRACKED_H
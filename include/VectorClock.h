@@ -0,0 +1,103 @@
+/**
+ * @file VectorClock.h
+ * @brief Vector clocks and FastTrack-style epochs for the hybrid engine
+ *
+ * A Thread under the hybrid engine has a clock index and a VectorClock
+ * whose own entry it advances at every release. An epoch c@t packs one entry of a clock into
+ * a single 64-bit word. A variable usually needs only the epoch of its last
+ * write and of its last read. Checking an access against them is two
+ * comparisons and allocates nothing. A full vector of read times is
+ * allocated only while reads by several threads are unordered with each
+ * other, and dropped again at the next write.
+ */
+
+#ifndef VECTORCLOCK_H
+#define VECTORCLOCK_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// c@t: [clock index:24][clock:40]. kNoEpoch (0@0) precedes everything.
+typedef std::uint64_t Epoch;
+
+const Epoch kNoEpoch = 0;
+const unsigned kEpochClockBits = 40;
+/// Largest clock index an epoch can hold.
+const std::uint32_t kMaxEpochIndex = (1u << (64 - kEpochClockBits)) - 1;
+
+inline Epoch makeEpoch(std::uint32_t index, std::uint64_t clock)
+{
+    return (static_cast<Epoch>(index) << kEpochClockBits) | clock;
+}
+
+inline std::uint32_t epochIndex(Epoch e)
+{
+    return static_cast<std::uint32_t>(e >> kEpochClockBits);
+}
+
+inline std::uint64_t epochClock(Epoch e)
+{
+    return e & ((Epoch(1) << kEpochClockBits) - 1);
+}
+
+/**
+ * @class VectorClock
+ * @brief Map from clock index to clock; missing entries are 0
+ */
+class VectorClock
+{
+public:
+    std::uint64_t get(std::uint32_t index) const
+    {
+        return index < clocks.size() ? clocks[index] : 0;
+    }
+
+    void set(std::uint32_t index, std::uint64_t clock);
+    void increment(std::uint32_t index) { set(index, get(index) + 1); }
+
+    Epoch epochOf(std::uint32_t index) const { return makeEpoch(index, get(index)); }
+
+    /// Pointwise maximum with other.
+    void join(const VectorClock &other);
+
+    /// Whether the event at e happens before the point this clock describes.
+    bool covers(Epoch e) const { return epochClock(e) <= get(epochIndex(e)); }
+
+    /// Whether every entry of other is covered by this clock.
+    bool covers(const VectorClock &other) const;
+
+    void clear() { clocks.clear(); }
+
+private:
+    std::vector<std::uint64_t> clocks;
+};
+
+/**
+ * @class VariableClock
+ * @brief Last-write epoch and last-read epoch(s) of one variable
+ *
+ * read() and write() check the access of the thread whose clock is given
+ * against the earlier accesses, record it and return true if it is
+ * unordered with an earlier conflicting access. Calls must be serialized
+ * per variable.
+ */
+class VariableClock
+{
+public:
+    VariableClock() : writeEpoch(kNoEpoch), readEpoch(kNoEpoch) {}
+
+    bool read(const VectorClock &clock, std::uint32_t index);
+    bool write(const VectorClock &clock, std::uint32_t index);
+
+    /// Whether reads are currently tracked in a full vector clock.
+    bool isReadShared() const { return readers != nullptr; }
+    void reset();
+
+private:
+    Epoch writeEpoch;
+    Epoch readEpoch;                         ///< Unused while readers is set
+    std::unique_ptr<VectorClock> readers;    ///< Read-shared: every reader's last read
+};
+
+#endif // VECTORCLOCK_H
@@ -0,0 +1,124 @@
+/**
+ * @file Arena.cpp
+ * @brief Implementation of the Arena bump allocator
+ */
+
+#include "../include/Arena.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace
+{
+// Chunk header rounded up so the data starts on a cache line.
+const std::size_t kHeaderBytes = Arena::kCacheLine;
+
+char *dataOf(void *chunk)
+{
+    return static_cast<char *>(chunk) + kHeaderBytes;
+}
+}
+
+Arena::Arena(std::size_t bytes) : chunkBytes(bytes), current(newChunk(bytes, nullptr)) {}
+
+Arena::~Arena()
+{
+    release();
+}
+
+Arena::Chunk *Arena::newChunk(std::size_t size, Chunk *next)
+{
+    static_assert(sizeof(Chunk) <= kHeaderBytes, "chunk header must fit in one cache line");
+    void *memory = nullptr;
+    if (posix_memalign(&memory, kCacheLine, kHeaderBytes + size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    Chunk *chunk = new (memory) Chunk;
+    chunk->next = next;
+    chunk->size = size;
+    chunk->offset.store(0, std::memory_order_relaxed);
+    return chunk;
+}
+
+void *Arena::allocate(std::size_t size, std::size_t align)
+{
+    if (size == 0)
+    {
+        size = 1;
+    }
+    for (;;)
+    {
+        Chunk *chunk = current.load(std::memory_order_acquire);
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(dataOf(chunk));
+        std::size_t offset = chunk->offset.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            std::size_t start = ((base + offset + align - 1) & ~(align - 1)) - base;
+            if (start + size > chunk->size)
+            {
+                break;
+            }
+            if (chunk->offset.compare_exchange_weak(offset, start + size, std::memory_order_relaxed))
+            {
+                return dataOf(chunk) + start;
+            }
+        }
+
+        // The chunk is full. The first thread to get here adds the next one;
+        // the rest retry in it. The tail of the full chunk stays unused.
+        std::lock_guard<std::mutex> guard(growMutex);
+        if (current.load(std::memory_order_relaxed) == chunk)
+        {
+            current.store(newChunk(std::max(chunkBytes, size + align), chunk), std::memory_order_release);
+        }
+    }
+}
+
+void Arena::release()
+{
+    Chunk *chunk = current.exchange(nullptr, std::memory_order_acq_rel);
+    while (chunk)
+    {
+        Chunk *next = chunk->next;
+        chunk->~Chunk();
+        std::free(chunk);
+        chunk = next;
+    }
+}
+
+void Arena::reset(std::size_t bytes)
+{
+    release();
+    chunkBytes = bytes;
+    current.store(newChunk(bytes, nullptr), std::memory_order_release);
+}
+
+std::size_t Arena::capacity() const
+{
+    std::size_t total = 0;
+    for (Chunk *chunk = current.load(std::memory_order_acquire); chunk; chunk = chunk->next)
+    {
+        total += chunk->size;
+    }
+    return total;
+}
+
+std::size_t Arena::used() const
+{
+    std::size_t total = 0;
+    for (Chunk *chunk = current.load(std::memory_order_acquire); chunk; chunk = chunk->next)
+    {
+        total += chunk->offset.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::size_t Arena::chunks() const
+{
+    std::size_t n = 0;
+    for (Chunk *chunk = current.load(std::memory_order_acquire); chunk; chunk = chunk->next)
+    {
+        ++n;
+    }
+    return n;
+}
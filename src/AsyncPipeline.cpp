@@ -0,0 +1,200 @@
+/**
+ * @file AsyncPipeline.cpp
+ * @brief Implementation of the partitioned analyzer pipeline
+ */
+
+#include "../include/AsyncPipeline.h"
+#include <atomic>
+#include <unordered_map>
+
+namespace
+{
+
+std::atomic<std::uint64_t> nextSession(1);
+
+/// Pipelines still accepting events, so exiting threads can flush into them.
+std::mutex &liveMutex()
+{
+    static std::mutex *mutex = new std::mutex();
+    return *mutex;
+}
+
+std::unordered_map<std::uint64_t, AsyncPipeline *> &livePipelines()
+{
+    static std::unordered_map<std::uint64_t, AsyncPipeline *> *live =
+        new std::unordered_map<std::uint64_t, AsyncPipeline *>();
+    return *live;
+}
+
+} // namespace
+
+/// The calling thread's buffers for the pipeline it last used.
+struct AsyncPipeline::LocalBuffers
+{
+    std::uint64_t session;
+    std::vector<std::vector<AsyncEvent>> buffers;
+
+    LocalBuffers() : session(0) {}
+
+    ~LocalBuffers()
+    {
+        // A thread that exits without flushing still gets its events analyzed.
+        std::lock_guard<std::mutex> guard(liveMutex());
+        auto it = livePipelines().find(session);
+        if (it != livePipelines().end())
+        {
+            for (unsigned p = 0; p < buffers.size(); ++p)
+            {
+                it->second->submit(p, buffers[p]);
+            }
+        }
+    }
+};
+
+AsyncPipeline::AsyncPipeline(unsigned partitions, Handler handler)
+    : handler(std::move(handler)), session(nextSession.fetch_add(1, std::memory_order_relaxed))
+{
+    if (partitions == 0)
+    {
+        partitions = 1;
+    }
+    for (unsigned p = 0; p < partitions; ++p)
+    {
+        queues.emplace_back(new Queue());
+        queues.back()->submitted = 0;
+        queues.back()->processed = 0;
+        queues.back()->stopping = false;
+    }
+    for (unsigned p = 0; p < partitions; ++p)
+    {
+        queues[p]->analyzer = std::thread(&AsyncPipeline::analyze, this, p);
+    }
+    std::lock_guard<std::mutex> guard(liveMutex());
+    livePipelines()[session] = this;
+}
+
+AsyncPipeline::~AsyncPipeline()
+{
+    {
+        std::lock_guard<std::mutex> guard(liveMutex());
+        livePipelines().erase(session);
+    }
+    flush();
+    for (auto &q : queues)
+    {
+        {
+            std::lock_guard<std::mutex> guard(q->mutex);
+            q->stopping = true;
+        }
+        q->ready.notify_one();
+    }
+    for (auto &q : queues)
+    {
+        q->analyzer.join();
+    }
+}
+
+std::vector<std::vector<AsyncEvent>> &AsyncPipeline::localBuffers()
+{
+    static thread_local LocalBuffers local;
+    if (local.session != session)
+    {
+        // Events still buffered for an earlier pipeline were not flushed
+        // before it stopped and are discarded.
+        local.session = session;
+        local.buffers.assign(queues.size(), std::vector<AsyncEvent>());
+        for (auto &b : local.buffers)
+        {
+            b.reserve(kBatchEvents);
+        }
+    }
+    return local.buffers;
+}
+
+void AsyncPipeline::append(const AsyncEvent &event)
+{
+    unsigned p = partitionOf(event.variable);
+    std::vector<AsyncEvent> &buffer = localBuffers()[p];
+    buffer.push_back(event);
+    if (buffer.size() >= kBatchEvents)
+    {
+        submit(p, buffer);
+    }
+}
+
+void AsyncPipeline::flush()
+{
+    std::vector<std::vector<AsyncEvent>> &buffers = localBuffers();
+    for (unsigned p = 0; p < buffers.size(); ++p)
+    {
+        submit(p, buffers[p]);
+    }
+}
+
+void AsyncPipeline::broadcast(const AsyncEvent &event)
+{
+    flush();
+    for (unsigned p = 0; p < queues.size(); ++p)
+    {
+        std::vector<AsyncEvent> batch(1, event);
+        submit(p, batch);
+    }
+}
+
+void AsyncPipeline::drain()
+{
+    for (auto &q : queues)
+    {
+        std::unique_lock<std::mutex> lock(q->mutex);
+        std::uint64_t target = q->submitted;
+        q->done.wait(lock, [&] { return q->processed >= target; });
+    }
+}
+
+void AsyncPipeline::submit(unsigned partition, std::vector<AsyncEvent> &batch)
+{
+    if (batch.empty())
+    {
+        return;
+    }
+    Queue &q = *queues[partition];
+    {
+        std::lock_guard<std::mutex> guard(q.mutex);
+        q.batches.push_back(std::move(batch));
+        ++q.submitted;
+    }
+    q.ready.notify_one();
+    batch.clear();
+    batch.reserve(kBatchEvents);
+}
+
+void AsyncPipeline::analyze(unsigned partition)
+{
+    Queue &q = *queues[partition];
+    std::vector<std::vector<AsyncEvent>> work;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(q.mutex);
+            q.processed += work.size();
+            if (!work.empty())
+            {
+                q.done.notify_all();
+            }
+            work.clear();
+            q.ready.wait(lock, [&] { return !q.batches.empty() || q.stopping; });
+            if (q.batches.empty())
+            {
+                return;
+            }
+            work.swap(q.batches);
+        }
+        for (const auto &batch : work)
+        {
+            for (const AsyncEvent &event : batch)
+            {
+                handler(partition, event);
+            }
+        }
+    }
+}
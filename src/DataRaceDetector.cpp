@@ -1,320 +1,1565 @@
 #include "../include/DataRaceDetector.h"
-#include <iostream>
-#include <algorithm>
+#include "../include/Logger.h"
+#include "../include/ShmChannel.h"
+#include "../include/TraceRecorder.h"
+#include <mutex>
 
-DataRaceDetector::DataRaceDetector() 
-    : dataRaceDetected(false), 
-      barrierCount(0), 
-      numAccesses(0), 
-      numLockAcquisitions(0), 
-      numLockReleases(0), 
-      numDataRaces(0)
+namespace
 {
+// Sessions are never reused, so a handle left by an earlier detector at the
+// same address, or by an earlier run, never matches.
+std::atomic<std::uint64_t> nextSession(1);
+
+struct CurrentThread
+{
+    std::uint64_t session;
+    Thread *thread;
+};
+
+thread_local CurrentThread current = {0, nullptr};
+}
+
+template <typename Policy>
+BasicDataRaceDetector<Policy>::BasicDataRaceDetector(std::size_t raceSlots)
+    : barrierCount(0), 
+      barrierArrivals(0),
+      barrierGeneration(0),
+      dataRaceDetected(false), 
+      mode(DetectorMode::Online),
+      stats(ThreadSlotTable::kCapacity),
+      sampling(false),
+      retirement(true),
+      engine(DetectorEngine::Lockset),
+      latencyTracking(false),
+      latencyRecorders(new std::atomic<LatencyRecorder *>[ThreadSlotTable::kCapacity]),
+      session(nextSession.fetch_add(1, std::memory_order_relaxed)),
+      raceTable(raceSlots),
+      arenaBytes(Arena::kDefaultBytes),
+      arena(arenaBytes),
+      threadSlab(arena),
+      lockSlab(arena),
+      variableSlab(arena),
+      slotClocks(new std::atomic<std::uint64_t>[ThreadSlotTable::kCapacity]),
+      spareClockIndex(ThreadSlotTable::kCapacity)
+{
+    for (std::uint32_t slot = 0; slot < ThreadSlotTable::kCapacity; ++slot)
+    {
+        latencyRecorders[slot].store(nullptr, std::memory_order_relaxed);
+        slotClocks[slot].store(0, std::memory_order_relaxed);
+    }
     // Barrier will be initialized when needed
 }
 
-DataRaceDetector::~DataRaceDetector() 
+template <typename Policy>
+BasicDataRaceDetector<Policy>::~BasicDataRaceDetector() 
+{
+    // Analyzer threads refer to the registries; stop them first.
+    stopAsync();
+
+    // Clean up barrier if it was initialized
+    if (barrierCount > 0)
+    {
+        pthread_barrier_destroy(&barrier);
+    }
+    for (std::uint32_t slot = 0; slot < ThreadSlotTable::kCapacity; ++slot)
+    {
+        delete latencyRecorders[slot].load(std::memory_order_relaxed);
+    }
+    clearRaces();
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::registerThread(Thread *t)
+{
+    if (Policy::checkNullPointers && !t)
+    {
+        Log::log(LogEvent::NullThreadRegister);
+        return;
+    }
+    if (recording())
+    {
+        emit(TraceEventKind::ThreadRegister, t->getId(), 0);
+    }
+    if (threads.at(t->getSlot()) != t)
+    {
+        t->setSlot(threads.claim(t));
+        if (t->getSlot() == ThreadSlotTable::kNoSlot)
+        {
+            Log::log(LogEvent::ThreadTableFull, t->getId());
+        }
+    }
+    if (hybrid())
+    {
+        // Everything the parent did before the fork happens before t.
+        ensureClock(t);
+        std::lock_guard<std::mutex> guard(threadClocksMutex);
+        auto fork = forkClocks.find(t->getId());
+        if (fork != forkClocks.end())
+        {
+            t->getClock().join(fork->second);
+            forkClocks.erase(fork);
+        }
+    }
+    current.session = session.load(std::memory_order_relaxed);
+    current.thread = t;
+    Log::log(LogEvent::ThreadRegistered, t->getId());
+}
+
+template <typename Policy>
+Thread *BasicDataRaceDetector<Policy>::registerThread(int id)
+{
+    Thread *t = threadSlab.create(id);
+    t->setOwnedByDetector(true);
+    registerThread(t);
+    return t;
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::unregisterThread()
+{
+    Thread *t = callingThread();
+    if (t)
+    {
+        unregisterThread(t);
+    }
+}
+
+template <typename Policy>
+Thread *BasicDataRaceDetector<Policy>::currentThread() const
+{
+    return current.session == session.load(std::memory_order_relaxed) ? current.thread : nullptr;
+}
+
+template <typename Policy>
+Thread *BasicDataRaceDetector<Policy>::callingThread() const
+{
+    Thread *t = currentThread();
+    if (!t)
+    {
+        Log::log(LogEvent::UnregisteredThread);
+    }
+    return t;
+}
+
+template <typename Policy>
+std::size_t BasicDataRaceDetector<Policy>::getNumThreads() const
+{
+    return threads.size();
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::unregisterThread(Thread *t)
+{
+    if (Policy::checkNullPointers && !t)
+    {
+        Log::log(LogEvent::NullThreadUnregister);
+        return;
+    }
+    if (recording())
+    {
+        emit(TraceEventKind::ThreadUnregister, t->getId(), 0);
+    }
+    if (hybrid())
+    {
+        // Kept for onThreadJoin, which usually runs after t is gone.
+        ensureClock(t);
+        std::lock_guard<std::mutex> guard(threadClocksMutex);
+        exitClocks[t->getId()] = t->getClock();
+    }
+    if (t->hasClock() && t->getClockIndex() < ThreadSlotTable::kCapacity)
+    {
+        // Before the slot is freed, so its next holder starts above this clock.
+        slotClocks[t->getClockIndex()].store(t->getClock().get(t->getClockIndex()), std::memory_order_relaxed);
+        t->stopClock();
+    }
+    if (threads.at(t->getSlot()) == t)
+    {
+        threads.release(t->getSlot());
+    }
+    t->setSlot(ThreadSlotTable::kNoSlot);
+    if (currentThread() == t)
+    {
+        current.thread = nullptr;
+    }
+
+    if (t->isOwnedByDetector())
+    {
+        // The record stays valid for the variables and queued events that
+        // refer to it; no copy is needed.
+        Log::log(LogEvent::ThreadUnregistered, t->getId());
+        return;
+    }
+
+    if (async())
+    {
+        // Analyzers may still hold events naming t. Queue the switch to the
+        // copy behind them and wait, so t is unused once this returns.
+        Thread *ghost = threadSlab.create(*t);
+        AsyncEvent retire;
+        retire.kind = AsyncEventKind::Retire;
+        retire.type = AccessType::READ;
+        retire.thread = t;
+        retire.replacement = ghost;
+        retire.lockset = nullptr;
+        pipeline->broadcast(retire);
+        pipeline->drain();
+        Log::log(LogEvent::ThreadUnregistered, t->getId());
+        return;
+    }
+
+    // The Thread object usually dies right after unregistering, but variables
+    // it accessed last still refer to it for later race checks. Hand them a
+    // detector-owned copy with the same id and final locksets instead.
+    Thread *ghost = nullptr;
+    sharedVariables.forEach([&](SharedVariable *var)
+    {
+        std::lock_guard<std::mutex> guard(variableLocks.forAddress(var));
+        if (var->getAccessingThread() == t)
+        {
+            if (!ghost)
+            {
+                ghost = threadSlab.create(*t);
+            }
+            var->replaceAccessingThread(t, ghost);
+        }
+    });
+    Log::log(LogEvent::ThreadUnregistered, t->getId());
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::registerSharedVariable(SharedVariable *v)
+{
+    if (Policy::checkNullPointers && !v)
+    {
+        Log::log(LogEvent::NullVariableRegister);
+        return;
+    }
+    if (!sharedVariables.insertUnique(v))
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(variableLocks.forAddress(v));
+        v->setGeneration(barrierGeneration.load(std::memory_order_acquire));
+    }
+    variablesById.insert(v->getNameId(), v);
+    variablesByName.insert(v->getName(), v);
+    if (recording())
+    {
+        // The name must be readable by the time the daemon sees the record.
+        if (getMode() == DetectorMode::Stream)
+        {
+            ShmChannel::publishName(v->getNameId(), v->getName());
+        }
+        emit(TraceEventKind::VariableRegister, kTraceNone, v->getNameId());
+    }
+    Log::log(LogEvent::VariableRegistered, v->getNameId(), static_cast<int>(v->getState()));
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::unregisterSharedVariable(SharedVariable *v)
+{
+    if (Policy::checkNullPointers && !v)
+    {
+        Log::log(LogEvent::NullVariableUnregister);
+        return;
+    }
+    if (!sharedVariables.remove(v))
+    {
+        return;
+    }
+    variablesById.remove(v->getNameId(), v);
+    variablesByName.remove(v->getName(), v);
+    if (async())
+    {
+        pipeline->drain();
+    }
+    Log::log(LogEvent::VariableUnregistered, v->getNameId());
+}
+
+template <typename Policy>
+SharedVariable *BasicDataRaceDetector<Policy>::findSharedVariable(std::uint32_t id)
+{
+    return variablesById.find(id);
+}
+
+template <typename Policy>
+SharedVariable *BasicDataRaceDetector<Policy>::findSharedVariable(const std::string &name)
+{
+    return variablesByName.find(name);
+}
+
+template <typename Policy>
+std::size_t BasicDataRaceDetector<Policy>::getNumSharedVariables() const
+{
+    return sharedVariables.size();
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::locksetMainStart()
+{
+    flush();
+    dataRaceDetected = false;
+    sharedVariables.clear();
+    variablesById.clear();
+    variablesByName.clear();
+    threads.clear();
+    barrierGeneration.store(0, std::memory_order_relaxed);
+    if (async())
+    {
+        // The analyzers are idle after flush().
+        for (unsigned i = 0; i < pipeline->partitions(); ++i)
+        {
+            analyzerGenerations[i] = 0;
+        }
+    }
+    session.store(nextSession.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    // A new run also gives back the shadow pages of the last one.
+    shadow.wipe();
+    {
+        std::lock_guard<std::mutex> guard(threadClocksMutex);
+        forkClocks.clear();
+        exitClocks.clear();
+    }
+    {
+        std::lock_guard<std::mutex> guard(barrierClockMutex);
+        barrierClock.clear();
+    }
+    stats.clear();
+    clearRaces();
+    for (std::uint32_t slot = 0; slot < ThreadSlotTable::kCapacity; ++slot)
+    {
+        if (LatencyRecorder *recorder = latencyRecorders[slot].load(std::memory_order_relaxed))
+        {
+            for (LatencyHistogram &h : recorder->events)
+            {
+                h.clear();
+            }
+        }
+    }
+
+    // Every record of the previous run goes at once.
+    threadSlab.clear();
+    lockSlab.clear();
+    variableSlab.clear();
+    arena.reset(arenaBytes);
+
+    if (recording())
+    {
+        emit(TraceEventKind::MainStart, kTraceNone, 0);
+    }
+    Log::log(LogEvent::DetectorInitialized);
+    Logger::flush();
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::locksetMainEnd()
+{
+    flush();
+    if (recording())
+    {
+        // Races are only known once the trace has been analyzed.
+        emit(TraceEventKind::MainEnd, kTraceNone, 0);
+    }
+    else if (dataRaceDetected)
+    {
+        for (const RaceRecord &race : raceTable.snapshot())
+        {
+            if (race.count > 1)
+            {
+                Log::log(race.key.kind == RaceKey::Memory ? LogEvent::MemoryRaceOccurrences
+                                                          : LogEvent::RaceOccurrences,
+                         race.key.thread, race.key.otherThread, race.key.location, race.count);
+            }
+        }
+        if (raceTable.overflows())
+        {
+            Log::log(LogEvent::RaceTableFull, raceTable.overflows());
+        }
+        Log::log(LogEvent::RaceSummaryDetected);
+    }
+    else
+    {
+        Log::log(LogEvent::RaceSummaryClean);
+    }
+    Log::log(LogEvent::DetectorFinished);
+    Logger::flush();
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockAcquire(Thread *t, Lock *l, bool writeMode, SharedVariable *v)
+{
+    LatencyScope timed(this, t, LatencyEvent::LockAcquire);
+    if (Policy::checkNullPointers && (!t || !l || !v))
+    {
+        Log::log(LogEvent::NullLockAcquire);
+        return;
+    }
+
+    if (recording())
+    {
+        emit(TraceEventKind::LockAcquire, t->getId(), l->getId(), v->getNameId(), writeMode);
+        return;
+    }
+    
+    l->template acquire<Policy>(t, writeMode, v);
+    if (hybrid())
+    {
+        acquireClock(t, l);
+    }
+    if (Policy::collectStats)
+    {
+        statsOf(t).add(StatCounter::LockAcquisitions);
+    }
+
+    Log::log(LogEvent::LockAcquired, t->getId(), l->getId(), writeMode, v->getNameId());
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockRelease(Thread *t, Lock *l, SharedVariable *v)
+{
+    LatencyScope timed(this, t, LatencyEvent::LockRelease);
+    if (Policy::checkNullPointers && (!t || !l || !v))
+    {
+        Log::log(LogEvent::NullLockRelease);
+        return;
+    }
+
+    if (recording())
+    {
+        emit(TraceEventKind::LockRelease, t->getId(), l->getId(), v->getNameId());
+        return;
+    }
+    
+    // 1. Ownership Verification (a read-shared lock records only its last holder)
+    if (l->getHoldingThread() != t && !t->getLockset()->contains(l)) { 
+        Log::log(LogEvent::ReleaseNotOwner, t->getId(), l->getId());
+        return; 
+    }
+
+    // 2. Update Lock and Thread State 
+    if (hybrid())
+    {
+        releaseClock(t, l);
+    }
+    l->template release<Policy>(t);
+
+    // 3. Transition the Shared Variable (on its analyzer thread in async mode)
+    if (async())
+    {
+        AsyncEvent release;
+        release.kind = AsyncEventKind::Release;
+        release.type = AccessType::READ;
+        release.thread = t;
+        release.variable = v;
+        release.lockset = nullptr;
+        pipeline->append(release);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> guard(variableLocks.forAddress(v));
+        StatBlock &counts = statsOf(t);
+        enterGeneration(v, barrierGeneration.load(std::memory_order_acquire), counts);
+        if (v->getState() == State::Exclusive) {
+            v->setState(State::Virgin); // Exclusive access complete, reset to initial state
+            if (Policy::collectStats)
+            {
+                counts.transition(State::Virgin);
+            }
+        } else if (v->getState() == State::SharedModified) {
+            v->setState(State::Shared); // Last writer released, transition to Shared
+            if (Policy::collectStats)
+            {
+                counts.transition(State::Shared);
+            }
+        }
+
+        // 4. Release the variable
+        v->releaseThread(t);
+    }
+    
+    // 5. Update Statistics (optional)
+    if (Policy::collectStats)
+    {
+        statsOf(t).add(StatCounter::LockReleases);
+    }
+
+    // 6. Logging (optional)
+    Log::log(LogEvent::LockReleased, t->getId(), l->getId(), v->getNameId());
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockAcquire(Thread *t, Lock *l, bool writeMode)
+{
+    LatencyScope timed(this, t, LatencyEvent::LockAcquire);
+    if (Policy::checkNullPointers && (!t || !l))
+    {
+        Log::log(LogEvent::NullLockAcquire);
+        return;
+    }
+
+    if (recording())
+    {
+        emit(TraceEventKind::LockAcquire, t->getId(), l->getId(), kTraceNone, writeMode);
+        return;
+    }
+
+    l->template acquire<Policy>(t, writeMode, nullptr);
+    if (hybrid())
+    {
+        acquireClock(t, l);
+    }
+    if (Policy::collectStats)
+    {
+        statsOf(t).add(StatCounter::LockAcquisitions);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockRelease(Thread *t, Lock *l)
+{
+    LatencyScope timed(this, t, LatencyEvent::LockRelease);
+    if (Policy::checkNullPointers && (!t || !l))
+    {
+        Log::log(LogEvent::NullLockRelease);
+        return;
+    }
+
+    if (recording())
+    {
+        emit(TraceEventKind::LockRelease, t->getId(), l->getId());
+        return;
+    }
+
+    // A lock held in read mode by several threads records only its last holder.
+    if (l->getHoldingThread() != t && !t->getLockset()->contains(l))
+    {
+        Log::log(LogEvent::ReleaseNotOwner, t->getId(), l->getId());
+        return;
+    }
+
+    if (hybrid())
+    {
+        releaseClock(t, l);
+    }
+    l->template release<Policy>(t);
+    if (Policy::collectStats)
+    {
+        statsOf(t).add(StatCounter::LockReleases);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onSharedVariableAccess(Thread *t, SharedVariable *v, AccessType type)
+{
+    LatencyScope timed(this, t, LatencyEvent::VariableAccess);
+    if (Policy::checkNullPointers && (!t || !v))
+    {
+        Log::log(LogEvent::NullAccess);
+        return;
+    }
+    
+    if (recording())
+    {
+        emit(TraceEventKind::VariableAccess, t->getId(), v->getNameId(), kTraceNone,
+                              type == AccessType::WRITE);
+        return;
+    }
+
+    if (v->isRetired(session.load(std::memory_order_relaxed)))
+    {
+        return;
+    }
+
+    StatBlock &counts = statsOf(t);
+    if (Policy::collectStats)
+    {
+        counts.add(StatCounter::VariableAccesses);
+    }
+
+    const Lockset *held = locksetFor(t, type);
+
+    // Sampling counters are kept under every policy: they are what the
+    // overhead of a sampled run is judged by.
+    if (sampling.load(std::memory_order_relaxed))
+    {
+        if (v->skipSample(held))
+        {
+            counts.add(StatCounter::SkippedAccesses);
+            return;
+        }
+        counts.add(StatCounter::SampledAccesses);
+    }
+
+    if (async())
+    {
+        AsyncEvent access;
+        access.kind = AsyncEventKind::Access;
+        access.type = type;
+        access.thread = t;
+        access.variable = v;
+        access.lockset = held;
+        pipeline->append(access);
+        return;
+    }
+
+    // The state machine, the accessing thread and the race check for v must
+    // be observed atomically with respect to other accesses of v.
+    std::lock_guard<std::mutex> guard(variableLocks.forAddress(v));
+    analyzeAccess(t, v, type, held, false, barrierGeneration.load(std::memory_order_acquire), counts);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockAcquire(Lock *l, bool writeMode, SharedVariable *v)
+{
+    if (Thread *t = callingThread())
+    {
+        onLockAcquire(t, l, writeMode, v);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockRelease(Lock *l, SharedVariable *v)
+{
+    if (Thread *t = callingThread())
+    {
+        onLockRelease(t, l, v);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockAcquire(Lock *l, bool writeMode)
+{
+    if (Thread *t = callingThread())
+    {
+        onLockAcquire(t, l, writeMode);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onLockRelease(Lock *l)
+{
+    if (Thread *t = callingThread())
+    {
+        onLockRelease(t, l);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onSharedVariableAccess(SharedVariable *v, AccessType type)
+{
+    if (Thread *t = callingThread())
+    {
+        onSharedVariableAccess(t, v, type);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onMemoryAccess(const void *addr, std::size_t size, AccessType type)
+{
+    if (Thread *t = callingThread())
+    {
+        onMemoryAccess(t, addr, size, type);
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::analyzeAccess(Thread *t, SharedVariable *v, AccessType type,
+                                                  const Lockset *held, bool snapshots, std::uint32_t generation,
+                                                  StatBlock &counts)
+{
+    bool raced = false;
+    Log::log(LogEvent::AccessAttempt, t->getId(), v->getNameId(), type == AccessType::WRITE);
+    enterGeneration(v, generation, counts);
+
+    // Hybrid engine: the epochs are updated on every access, and a lockset
+    // violation only counts if the access is unordered with an earlier
+    // conflicting one. Queued events carry no clock, so Async is lockset only.
+    bool ordered = false;
+    if (!snapshots && hybrid())
+    {
+        ensureClock(t);
+        VariableClock &clock = v->getClock();
+        ordered = type == AccessType::WRITE ? !clock.write(t->getClock(), t->getClockIndex())
+                                            : !clock.read(t->getClock(), t->getClockIndex());
+    }
+    Log::log(LogEvent::VariableState, v->getNameId(), static_cast<int>(v->getState()));
+
+    // Eraser refinement: once v is shared, every access intersects C(v) with
+    // the locks held, and an empty C(v) means no lock protects v.
+    bool shared = v->getState() == State::Shared || v->getState() == State::SharedModified;
+    const Lockset *candidates = shared ? v->refineCandidateLocks(held) : nullptr;
+
+    if (v->isAccessed() && v->getAccessingThread() != t)
+    {
+        Thread *accessingThread = v->getAccessingThread();
+        // The previous accessor's locks are those it held at its access,
+        // recorded with it; the locks it holds now may have changed since.
+        const Lockset *accessingHeld = v->getAccessingLockset() ? v->getAccessingLockset()
+                                                                : accessingThread->getLockset();
+        // Until v is shared, the previous owner's locks stand in for C(v).
+        bool commonLocks = shared ? !candidates->empty() : hasCommonLocks(accessingHeld, held);
+        if (!shared)
+        {
+            v->refineCandidateLocks(accessingHeld);
+            candidates = v->refineCandidateLocks(held);
+        }
+        if (Policy::collectStats)
+        {
+            counts.add(StatCounter::ConflictChecks);
+        }
+
+        Log::log(LogEvent::CurrentlyAccessing, accessingThread->getId(), v->getNameId(),
+                    v->getState() == State::Exclusive);
+
+        if (isConflictingAccess(v->getState(), type) && !commonLocks && ordered)
+        {
+            Log::log(LogEvent::OrderedAccess, t->getId(), v->getNameId(), accessingThread->getId());
+        }
+        else if (isConflictingAccess(v->getState(), type) && !commonLocks)
+        {
+            Log::log(type == AccessType::WRITE ? LogEvent::WriteConflict : LogEvent::ReadConflict,
+                     t->getId(), v->getNameId(), accessingThread->getId());
+            raced = true;
+
+            RaceKey key;
+            key.location = v->getNameId();
+            key.thread = static_cast<std::uint32_t>(t->getId());
+            key.otherThread = static_cast<std::uint32_t>(accessingThread->getId());
+            key.lockset = held->getId();
+            key.otherLockset = accessingHeld->getId();
+            key.type = type;
+            key.state = v->getState();
+            key.kind = RaceKey::Variable;
+            // Analyzer threads must not record into t's slot.
+            LatencyScope timed(this, snapshots ? nullptr : t, LatencyEvent::RaceReport);
+            if (countRace(key, counts))
+            {
+                reportDataRace(t, v);
+            }
+        }
+    }
+
+    if (raced && candidates && candidates->empty() && retirement.load(std::memory_order_relaxed))
+    {
+        // Every later access would only repeat the report.
+        v->retire(session.load(std::memory_order_relaxed));
+    }
+
+    State before = v->getState();
+    v->template access<Policy>(t, type);
+    v->setAccessingLockset(held);
+    if (Policy::collectStats && v->getState() != before)
+    {
+        counts.transition(v->getState());
+    }
+    if (sampling.load(std::memory_order_relaxed))
+    {
+        v->sampled(held, raced);
+    }
+
+    Log::log(LogEvent::Accessed, t->getId(), v->getNameId(), static_cast<int>(v->getState()));
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onMemoryAccess(Thread *t, const void *addr, std::size_t size, AccessType type)
+{
+    LatencyScope timed(this, t, LatencyEvent::MemoryAccess);
+    if (Policy::checkNullPointers && (!t || !addr))
+    {
+        Log::log(LogEvent::NullMemoryAccess);
+        return;
+    }
+
+    std::uintptr_t a = reinterpret_cast<std::uintptr_t>(addr);
+    if (recording())
+    {
+        emit(TraceEventKind::MemoryAccess, t->getId(), a, static_cast<std::uint32_t>(size),
+                              type == AccessType::WRITE);
+        return;
+    }
+
+    StatBlock &counts = statsOf(t);
+    if (Policy::collectStats)
+    {
+        counts.add(StatCounter::MemoryAccesses);
+    }
+
+    Log::log(LogEvent::MemoryAccess, t->getId(), a, size, type == AccessType::WRITE);
+
+    // Every granule the access touches is checked; one report per access.
+    std::uintptr_t first = a >> ShadowMemory::kGranuleShift;
+    std::uintptr_t last = (a + (size ? size : 1) - 1) >> ShadowMemory::kGranuleShift;
+    int racingThread = -1;
+    std::uintptr_t racingGranule = 0;
+    ShadowCell racingCell;
+    for (std::uintptr_t g = first; g <= last; ++g)
+    {
+        std::atomic<std::uint64_t> *cell =
+            shadow.cellFor(reinterpret_cast<const void *>(g << ShadowMemory::kGranuleShift));
+        if (!cell)
+        {
+            continue; // outside the shadowed address range
+        }
+        ShadowCell previous;
+        int other = accessCell(*cell, t, type, previous, counts);
+        if (racingThread < 0 && other >= 0)
+        {
+            racingThread = other;
+            racingGranule = g;
+            racingCell = previous;
+        }
+    }
+
+    if (racingThread >= 0)
+    {
+        RaceKey key;
+        key.location = racingGranule << ShadowMemory::kGranuleShift;
+        key.thread = static_cast<std::uint32_t>(t->getId());
+        key.otherThread = static_cast<std::uint32_t>(racingThread);
+        key.lockset = locksetFor(t, type)->getId();
+        key.otherLockset = racingCell.locksetId;
+        key.type = type;
+        key.state = racingCell.state;
+        key.kind = RaceKey::Memory;
+        LatencyScope timed(this, t, LatencyEvent::RaceReport);
+        if (countRace(key, counts))
+        {
+            Log::log(LogEvent::MemoryRace, t->getId(), racingThread, a);
+        }
+    }
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onMemoryFree(const void *addr, std::size_t size)
 {
-    // Clean up barrier if it was initialized
-    if (barrierCount > 0)
+    if (recording())
     {
-        pthread_barrier_destroy(&barrier);
+        return;
     }
+    shadow.clear(addr, size);
 }
 
-void DataRaceDetector::registerThread(Thread *t)
+template <typename Policy>
+int BasicDataRaceDetector<Policy>::accessCell(std::atomic<std::uint64_t> &cell, Thread *t, AccessType type,
+                                              ShadowCell &previous, StatBlock &counts)
 {
-    if (!t)
+    // The previous accessor's lockset is the snapshot stored in the cell, so
+    // no Thread object has to outlive its accesses.
+    LocksetTable &table = LocksetTable::instance();
+    const Lockset *held = locksetFor(t, type);
+
+    ShadowCell next;
+    next.accessed = true;
+    next.owner = t->getId();
+    next.locksetId = held->getId();
+    next.generation = shadow.generation();
+
+    std::uint64_t bits = cell.load(std::memory_order_acquire);
+    int racingThread;
+    do
     {
-        std::cerr << "Error: Null thread pointer passed to registerThread" << std::endl;
-        return;
+        ShadowCell prev = ShadowCell::decode(bits, next.generation);
+        racingThread = -1;
+        if (prev.accessed && prev.owner != t->getId() && isConflictingAccess(prev.state, type) &&
+            prev.locksetId != ShadowCell::kUnknownLockset &&
+            !table.hasCommonLock(table.byId(prev.locksetId), held))
+        {
+            racingThread = prev.owner;
+        }
+        previous = prev;
+        next.state = nextState(prev.state, type);
+    } while (!cell.compare_exchange_weak(bits, next.encode(), std::memory_order_acq_rel,
+                                         std::memory_order_acquire));
+    if (Policy::collectStats)
+    {
+        if (previous.accessed && previous.owner != t->getId())
+        {
+            counts.add(StatCounter::ConflictChecks);
+        }
+        if (next.state != previous.state)
+        {
+            counts.transition(next.state);
+        }
     }
-    threads.insert(t);
-    std::cout << "Thread " << t->getId() << " registered." << std::endl;
+    return racingThread;
 }
 
-void DataRaceDetector::unregisterThread(Thread *t)
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::countRace(const RaceKey &key, StatBlock &counts)
 {
-    if (!t)
+    dataRaceDetected.store(true, std::memory_order_relaxed);
+    counts.add(StatCounter::RaceOccurrences);
+    RaceTable::Outcome outcome = raceTable.record(key);
+    if (outcome == RaceTable::Repeat)
     {
-        std::cerr << "Error: Null thread pointer passed to unregisterThread" << std::endl;
-        return;
+        return false;
+    }
+    if (outcome == RaceTable::New && key.kind == RaceKey::Variable)
+    {
+        // The summary names the variable, which may be gone by then.
+        Logger::retainName(static_cast<std::uint32_t>(key.location));
+    }
+    counts.add(StatCounter::DataRaces);
+    return true;
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::clearRaces()
+{
+    for (const RaceRecord &race : raceTable.snapshot())
+    {
+        if (race.key.kind == RaceKey::Variable)
+        {
+            Logger::releaseName(static_cast<std::uint32_t>(race.key.location));
+        }
     }
-    threads.erase(t);
-    std::cout << "Thread " << t->getId() << " unregistered." << std::endl;
+    raceTable.clear();
 }
 
-void DataRaceDetector::registerSharedVariable(SharedVariable *v)
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::reportDataRace(Thread *t, SharedVariable *v)
 {
-    if (!v)
+    if (Policy::checkNullPointers && (!t || !v || !v->getAccessingThread()))
     {
-        std::cerr << "Error: Null shared variable pointer passed to registerSharedVariable" << std::endl;
+        Log::log(LogEvent::InvalidRaceReport);
         return;
     }
-    sharedVariables.push_back(v);
-    std::cout << "Shared variable " << v->getName() << " registered. With state " << v->stateToString(v->getState()) << std::endl;
+    
+    Log::log(LogEvent::DataRace, t->getId(), v->getAccessingThread()->getId(), v->getNameId());
 }
 
-void DataRaceDetector::locksetMainStart()
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::hasCommonLocks(const Lockset *a, const Lockset *b)
 {
-    dataRaceDetected = false;
-    sharedVariables.clear();
-    threads.clear();
-    mutexes.clear();
-    numAccesses = 0;
-    numLockAcquisitions = 0;
-    numLockReleases = 0;
-    numDataRaces = 0;
-    std::cout << "Data race detector initialized." << std::endl;
+    // A thread's write lockset is a subset of its lockset, so the write/read
+    // cross intersections can only be non-empty if the plain one is. The
+    // check is a single lookup in the memoized pair cache.
+    return LocksetTable::instance().hasCommonLock(a, b);
 }
 
-void DataRaceDetector::locksetMainEnd()
+template <typename Policy>
+Thread *BasicDataRaceDetector<Policy>::createThread(int id)
 {
-    if (dataRaceDetected)
-    {
-        std::cout << "Warning: data race detected!" << std::endl;
-    }
-    else
-    {
-        std::cout << "Data race not detected!" << std::endl;
-    }
-    std::cout << "Data race detector finished." << std::endl;
+    return threadSlab.create(id);
+}
+
+template <typename Policy>
+Lock *BasicDataRaceDetector<Policy>::createLock(int id)
+{
+    return lockSlab.create(id);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::destroyLock(Lock *l)
+{
+    lockSlab.destroy(l);
+}
+
+template <typename Policy>
+SharedVariable *BasicDataRaceDetector<Policy>::createSharedVariable(const std::string &name)
+{
+    return variableSlab.create(name);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::setArenaSize(std::size_t bytes)
+{
+    arenaBytes = bytes;
 }
 
-void DataRaceDetector::onLockAcquire(Thread *t, Lock *l, bool writeMode, SharedVariable *v)
+template <typename Policy>
+std::size_t BasicDataRaceDetector<Policy>::getArenaUsed() const
 {
-    if (!t || !l || !v)
+    return arena.used();
+}
+
+template <typename Policy>
+std::size_t BasicDataRaceDetector<Policy>::getArenaCapacity() const
+{
+    return arena.capacity();
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::initializeBarrier(pthread_barrier_t *barrier, const pthread_barrierattr_t *attr, int count)
+{
+    if (!barrier || count <= 0)
+    {
+        Log::log(LogEvent::BarrierInvalidParams);
+        return;
+    }
+    
+    int result = pthread_barrier_init(barrier, attr, count);
+    if (result != 0)
     {
-        std::cerr << "Error: Null pointer passed to onLockAcquire" << std::endl;
+        Log::log(LogEvent::BarrierInitFailed);
         return;
     }
     
-    l->acquire(t, writeMode, v);
-    t->acquireLock(l, writeMode);
-    numLockAcquisitions++;
+    this->barrier = *barrier;
+    barrierCount = count;
+    barrierArrivals.store(0, std::memory_order_relaxed);
 
-    std::cout << "Thread " << t->getId() << " acquired lock " << l->getId()
-              << " with " << (writeMode ? "WRITE" : "READ") << " access on variable " << v->getName() << std::endl;
+    Log::log(LogEvent::BarrierInitialized, count);
 }
 
-void DataRaceDetector::onLockRelease(Thread *t, Lock *l, SharedVariable *v)
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::barrierWait()
 {
-    if (!t || !l || !v)
+    Thread *self = currentThread();
+    LatencyScope timed(this, self, LatencyEvent::BarrierWait);
+    if (barrierCount == 0)
     {
-        std::cerr << "Error: Null pointer passed to onLockRelease" << std::endl;
+        Log::log(LogEvent::BarrierNotInitialized);
         return;
     }
+    if (Policy::collectStats)
+    {
+        statsOf(self).add(StatCounter::BarrierWaits);
+    }
     
-    // 1. Ownership Verification
-    if (l->getHoldingThread() != t) { 
-        std::cerr << "Error: Thread " << t->getId() << " tried to release lock " << l->getId() << " which it doesn't own." << std::endl;
-        return; 
+    if (recording())
+    {
+        emit(TraceEventKind::BarrierWait, kTraceNone, 0, barrierCount);
+    }
+    if (async())
+    {
+        // Hand over everything from before the barrier, reset behind it, and
+        // only then let any thread queue events from after the barrier.
+        pipeline->flush();
+        if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            onBarrierReset();
+        }
+        pthread_barrier_wait(&barrier);
+        return;
     }
 
-    // 2. Update Lock and Thread State 
-    l->release(t);
-    t->releaseLock(l);
-
-    // 3. Transition the Shared Variable
-    if (v->getState() == State::Exclusive) {
-        v->setState(State::Virgin); // Exclusive access complete, reset to initial state
-    } else if (v->getState() == State::SharedModified) {
-        v->setState(State::Shared); // Last writer released, transition to Shared
+    if (recording())
+    {
+        if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            emit(TraceEventKind::BarrierReset, kTraceNone, 0);
+        }
+        return;
     }
-    
-    // 4. Release the variable
-    v->releaseThread(t); 
-    
-    // 5. Update Statistics (optional)
-    numLockReleases++;
 
-    // 6. Logging (optional)
-    std::cout << "Thread " << t->getId() << " released lock " << l->getId()
-              << " on variable " << v->getName() << std::endl;
+    // The reset is constant time, so the last thread to arrive does it
+    // before the barrier opens and no thread runs ahead of it.
+    if (barrierArrivals.fetch_add(1, std::memory_order_acq_rel) + 1 == barrierCount)
+    {
+        barrierArrivals.store(0, std::memory_order_relaxed);
+        onBarrierReset();
+    }
+    pthread_barrier_wait(&barrier);
 }
 
-
-void DataRaceDetector::onSharedVariableAccess(Thread *t, SharedVariable *v, AccessType type)
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::barrierWait(Thread *t)
 {
-    if (!t || !v)
+    if (!hybrid())
     {
-        std::cerr << "Error: Null pointer passed to onSharedVariableAccess" << std::endl;
+        barrierWait();
+        return;
+    }
+    if (Policy::checkNullPointers && !t)
+    {
+        Log::log(LogEvent::NullThreadSync);
+        return;
+    }
+    if (barrierCount == 0)
+    {
+        Log::log(LogEvent::BarrierNotInitialized);
         return;
     }
-    
-    numAccesses++;
-
-    std::cout << "Thread " << t->getId() << " is trying to access variable " << v->getName()
-              << " with " << (type == AccessType::READ ? "READ" : "WRITE") << " access." << std::endl;
-
-    std::cout << "Variable " << v->getName() << " is currently in state " << v->stateToString(v->getState()) << std::endl;
 
-    if (v->isAccessed() && v->getAccessingThread() != t)
+    LatencyScope timed(this, t, LatencyEvent::BarrierWait);
+    if (Policy::collectStats)
     {
-        Thread *accessingThread = v->getAccessingThread();
-        bool commonLocks = hasCommonLocks(accessingThread, t);
+        statsOf(t).add(StatCounter::BarrierWaits);
+    }
+    // Every thread adds its clock, and only once all have done so does any
+    // thread take the join. The second wait keeps a thread that is already
+    // at the next barrier from adding its later clock too early.
+    ensureClock(t);
+    {
+        std::lock_guard<std::mutex> guard(barrierClockMutex);
+        barrierClock.join(t->getClock());
+    }
+    if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+    {
+        // Variables keep their state; their epochs order the phases. Shadow
+        // cells have no clocks and are still reset.
+        Log::log(LogEvent::BarrierReached);
+        shadow.clear();
+    }
+    {
+        std::lock_guard<std::mutex> guard(barrierClockMutex);
+        t->getClock().join(barrierClock);
+    }
+    t->tick();
+    pthread_barrier_wait(&barrier);
+}
 
-        std::cout << "Thread " << accessingThread->getId() << " is currently accessing variable " << v->getName()
-                  << " with " << (v->getState() == State::Exclusive ? "WRITE" : "READ") << " access." << std::endl;
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onThreadFork(Thread *parent, int childId)
+{
+    if (Policy::checkNullPointers && !parent)
+    {
+        Log::log(LogEvent::NullThreadSync);
+        return;
+    }
+    if (!hybrid())
+    {
+        return;
+    }
+    ensureClock(parent);
+    {
+        std::lock_guard<std::mutex> guard(threadClocksMutex);
+        forkClocks[childId] = parent->getClock();
+    }
+    parent->tick();
+    Log::log(LogEvent::ThreadForked, parent->getId(), childId);
+}
 
-        if (type == AccessType::WRITE)
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onThreadJoin(Thread *parent, int childId)
+{
+    if (Policy::checkNullPointers && !parent)
+    {
+        Log::log(LogEvent::NullThreadSync);
+        return;
+    }
+    if (!hybrid())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(threadClocksMutex);
+        auto exit = exitClocks.find(childId);
+        if (exit != exitClocks.end())
         {
-            if (v->getState() == State::Exclusive || v->getState() == State::Initializing ||
-                v->getState() == State::Shared || v->getState() == State::SharedModified)
-            {
-                if (!commonLocks)
-                {
-                    std::cout << "Thread " << t->getId() << " cannot access variable " << v->getName()
-                              << " with WRITE access because it is already being accessed by thread " << accessingThread->getId() << std::endl;
-                    dataRaceDetected = true;
-                    numDataRaces++;
-                    reportDataRace(t, v);
-                }
-            }
+            parent->getClock().join(exit->second);
+            exitClocks.erase(exit);
         }
-        else if (type == AccessType::READ)
+    }
+    Log::log(LogEvent::ThreadJoined, parent->getId(), childId);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::startClock(Thread *t)
+{
+    std::uint32_t index = t->getSlot();
+    std::uint64_t first = 1;
+    if (index < ThreadSlotTable::kCapacity)
+    {
+        first = slotClocks[index].load(std::memory_order_relaxed) + 1;
+    }
+    else
+    {
+        // No slot: an index of its own, never reused.
+        index = spareClockIndex.fetch_add(1, std::memory_order_relaxed);
+        if (index > kMaxEpochIndex)
         {
-            if (v->getState() == State::Exclusive || v->getState() == State::Initializing)
+            if (index == kMaxEpochIndex + 1)
             {
-                if (!commonLocks)
-                {
-                    std::cout << "Thread " << t->getId() << " cannot access variable " << v->getName()
-                              << " with READ access because it is already being accessed by thread " << accessingThread->getId()
-                              << " with WRITE access." << std::endl;
-                    dataRaceDetected = true;
-                    numDataRaces++;
-                    reportDataRace(t, v);
-                }
+                Log::log(LogEvent::ClockIndexOverflow, t->getId());
             }
+            // Threads sharing the last index count as one: races between them are missed.
+            index = kMaxEpochIndex;
+            first = 1;
         }
     }
+    t->startClock(index, first);
+}
 
-    v->access(t, type);
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::acquireClock(Thread *t, Lock *l)
+{
+    // Several readers of a read-write lock may acquire it at once, so the
+    // lock's clock is guarded by its stripe.
+    ensureClock(t);
+    std::lock_guard<std::mutex> guard(variableLocks.forAddress(l));
+    t->getClock().join(l->getClock());
+}
 
-    std::cout << "Thread " << t->getId() << " accessed variable " << v->getName()
-              << ", now in state " << v->stateToString(v->getState()) << std::endl;
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::releaseClock(Thread *t, Lock *l)
+{
+    // A join rather than a copy, so read-mode releases accumulate.
+    ensureClock(t);
+    {
+        std::lock_guard<std::mutex> guard(variableLocks.forAddress(l));
+        l->getClock().join(t->getClock());
+    }
+    t->tick();
 }
 
-void DataRaceDetector::reportDataRace(Thread *t, SharedVariable *v)
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::onBarrierReset()
 {
-    if (!t || !v || !v->getAccessingThread())
+    Log::log(LogEvent::BarrierReached);
+    if (async())
     {
-        std::cerr << "Error: Invalid pointers in reportDataRace" << std::endl;
+        AsyncEvent reset;
+        reset.kind = AsyncEventKind::Reset;
+        reset.type = AccessType::READ;
+        reset.thread = nullptr;
+        reset.variable = nullptr;
+        reset.lockset = nullptr;
+        // Variables registered from here on start in the new generation.
+        barrierGeneration.fetch_add(1, std::memory_order_acq_rel);
+        pipeline->broadcast(reset);
+        shadow.clear();
         return;
     }
-    
-    std::cout << "Data race detected between thread " << t->getId()
-              << " and thread " << v->getAccessingThread()->getId() << " on shared variable " << v->getName() << std::endl;
+    // Every variable accessed before this point now belongs to an older
+    // generation and is reset the next time it is looked at. Shadow cells
+    // have a generation of their own.
+    barrierGeneration.fetch_add(1, std::memory_order_acq_rel);
+    shadow.clear();
 }
 
-std::set<Lock *> DataRaceDetector::intersect(const std::set<Lock *> &set1, const std::set<Lock *> &set2)
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::enterGeneration(SharedVariable *v, std::uint32_t generation, StatBlock &counts)
 {
-    std::set<Lock *> result;
-    std::set_intersection(set1.begin(), set1.end(), set2.begin(), set2.end(), std::inserter(result, result.begin()));
-    return result;
+    if (v->enterGeneration(generation))
+    {
+        Log::log(LogEvent::ResettingVariable, v->getNameId());
+        if (Policy::collectStats)
+        {
+            counts.transition(State::Clean);
+        }
+    }
 }
 
-bool DataRaceDetector::hasCommonLocks(const Thread *t1, const Thread *t2)
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::startRecording(const std::string &directory)
 {
-    std::set<Lock *> commonLocks = intersect(t1->getLockset(), t2->getLockset());
-    if (!commonLocks.empty())
+    if (!TraceRecorder::start(directory))
     {
-        return true;
+        return false;
     }
+    Logger::holdNames(true);
+    mode.store(DetectorMode::Record, std::memory_order_release);
+    return true;
+}
 
-    commonLocks = intersect(t1->getWriteLockset(), t2->getLockset());
-    if (!commonLocks.empty())
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::stopRecording()
+{
+    if (getMode() != DetectorMode::Record)
     {
-        return true;
+        return;
     }
+    mode.store(DetectorMode::Online, std::memory_order_release);
+    TraceRecorder::stop();
+    Logger::holdNames(false);
+}
 
-    commonLocks = intersect(t1->getLockset(), t2->getWriteLockset());
-    if (!commonLocks.empty())
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::startStreaming(const std::string &name)
+{
+    if (!ShmChannel::attach(name))
     {
-        return true;
+        return false;
     }
+    Logger::holdNames(true);
+    mode.store(DetectorMode::Stream, std::memory_order_release);
+    return true;
+}
 
-    commonLocks = intersect(t1->getWriteLockset(), t2->getWriteLockset());
-    if (!commonLocks.empty())
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::stopStreaming()
+{
+    if (getMode() != DetectorMode::Stream)
     {
-        return true;
+        return;
     }
+    mode.store(DetectorMode::Online, std::memory_order_release);
+    ShmChannel::detach();
+    Logger::holdNames(false);
+}
 
-    return false;
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::emit(TraceEventKind kind, std::uint32_t thread, std::uint64_t object,
+                                         std::uint32_t extra, std::uint16_t flags)
+{
+    if (getMode() == DetectorMode::Stream)
+    {
+        ShmChannel::push(kind, thread, object, extra, flags);
+    }
+    else
+    {
+        TraceRecorder::record(kind, thread, object, extra, flags);
+    }
 }
 
-void DataRaceDetector::initializeBarrier(pthread_barrier_t *barrier, const pthread_barrierattr_t *attr, int count)
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::startAsync(unsigned analyzers)
 {
-    if (!barrier || count <= 0)
+    if (getMode() != DetectorMode::Online)
     {
-        std::cerr << "Error: Invalid parameters for barrier initialization" << std::endl;
-        return;
+        return false;
     }
-    
-    int result = pthread_barrier_init(barrier, attr, count);
-    if (result != 0)
+    analyzerGenerations.reset(new std::uint32_t[analyzers]);
+    for (unsigned i = 0; i < analyzers; ++i)
+    {
+        analyzerGenerations[i] = barrierGeneration.load(std::memory_order_relaxed);
+    }
+    pipeline.reset(new AsyncPipeline(analyzers, [this](unsigned partition, const AsyncEvent &event)
+    {
+        analyze(partition, event);
+    }));
+    mode.store(DetectorMode::Async, std::memory_order_release);
+    return true;
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::stopAsync()
+{
+    if (!async())
     {
-        std::cerr << "Error: Failed to initialize barrier" << std::endl;
         return;
     }
-    
-    this->barrier = *barrier;
-    barrierCount = count;
+    mode.store(DetectorMode::Online, std::memory_order_release);
+    pipeline.reset();
+}
 
-    std::cout << "Barrier initialized with count " << count << std::endl;
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::flush()
+{
+    if (async())
+    {
+        pipeline->flush();
+        pipeline->drain();
+    }
 }
 
-void DataRaceDetector::barrierWait()
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::analyze(unsigned partition, const AsyncEvent &event)
 {
-    if (barrierCount == 0)
+    switch (event.kind)
     {
-        std::cerr << "Error: Barrier not initialized" << std::endl;
-        return;
+    case AsyncEventKind::Access:
+        // Accesses queued before their variable was retired are dropped here.
+        if (!event.variable->isRetired(session.load(std::memory_order_relaxed)))
+        {
+            analyzeAccess(event.thread, event.variable, event.type, event.lockset, true,
+                          analyzerGenerations[partition], stats.forAnalyzer(partition));
+        }
+        break;
+    case AsyncEventKind::Release:
+    {
+        SharedVariable *v = event.variable;
+        StatBlock &counts = stats.forAnalyzer(partition);
+        enterGeneration(v, analyzerGenerations[partition], counts);
+        if (v->getState() == State::Exclusive) {
+            v->setState(State::Virgin);
+            if (Policy::collectStats)
+            {
+                counts.transition(State::Virgin);
+            }
+        } else if (v->getState() == State::SharedModified) {
+            v->setState(State::Shared);
+            if (Policy::collectStats)
+            {
+                counts.transition(State::Shared);
+            }
+        }
+        v->releaseThread(event.thread);
+        break;
     }
-    
-    int result = pthread_barrier_wait(&barrier);
-    if (result == PTHREAD_BARRIER_SERIAL_THREAD)
+    case AsyncEventKind::Reset:
+        // Accesses queued before the barrier were analyzed in the old
+        // generation; the ones after it reset their variable first.
+        ++analyzerGenerations[partition];
+        break;
+    case AsyncEventKind::Retire:
+        sharedVariables.forEach([&](SharedVariable *var)
+        {
+            if (pipeline->partitionOf(var) == partition)
+            {
+                var->replaceAccessingThread(event.thread, event.replacement);
+            }
+        });
+        break;
+    }
+}
+
+template <typename Policy>
+DetectorMode BasicDataRaceDetector<Policy>::getMode() const
+{
+    return mode.load(std::memory_order_relaxed);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::setSampling(bool enabled)
+{
+    sampling.store(enabled, std::memory_order_relaxed);
+}
+
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::isSampling() const
+{
+    return sampling.load(std::memory_order_relaxed);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::setRetirement(bool enabled)
+{
+    retirement.store(enabled, std::memory_order_relaxed);
+}
+
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::isRetiring() const
+{
+    return retirement.load(std::memory_order_relaxed);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::setLatencyTracking(bool enabled)
+{
+    latencyTracking.store(enabled, std::memory_order_relaxed);
+}
+
+template <typename Policy>
+bool BasicDataRaceDetector<Policy>::isLatencyTracking() const
+{
+    return latencyTracking.load(std::memory_order_relaxed);
+}
+
+template <typename Policy>
+LatencySnapshot BasicDataRaceDetector<Policy>::getLatencySnapshot() const
+{
+    std::unique_ptr<LatencyRecorder> merged(new LatencyRecorder());
+    for (std::uint32_t slot = 0; slot < ThreadSlotTable::kCapacity; ++slot)
     {
-        std::cout << "All threads have reached the barrier" << std::endl;
-        for (auto &var : sharedVariables)
+        if (const LatencyRecorder *recorder = latencyRecorders[slot].load(std::memory_order_acquire))
         {
-            if (var)
+            for (std::size_t e = 0; e < kLatencyEvents; ++e)
             {
-                std::cout << "Resetting state of variable " << var->getName() << std::endl;
-                var->setState(State::Clean);
+                merged->events[e].add(recorder->events[e]);
             }
         }
     }
+    LatencySnapshot snapshot;
+    for (std::size_t e = 0; e < kLatencyEvents; ++e)
+    {
+        snapshot.events[e] = merged->events[e].summary();
+    }
+    return snapshot;
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::recordLatency(Thread *t, LatencyEvent event, std::uint64_t ns)
+{
+    std::uint32_t slot = t ? t->getSlot() : ThreadSlotTable::kNoSlot;
+    if (slot >= ThreadSlotTable::kCapacity)
+    {
+        return;
+    }
+    // Only the slot's thread records into it. The exchange guards against a
+    // Thread passed from two OS threads at once.
+    LatencyRecorder *recorder = latencyRecorders[slot].load(std::memory_order_acquire);
+    if (!recorder)
+    {
+        LatencyRecorder *created = new LatencyRecorder();
+        if (latencyRecorders[slot].compare_exchange_strong(recorder, created, std::memory_order_acq_rel))
+        {
+            recorder = created;
+        }
+        else
+        {
+            delete created;
+        }
+    }
+    (*recorder)[event].record(ns);
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::setEngine(DetectorEngine engine)
+{
+    this->engine.store(engine, std::memory_order_relaxed);
+}
+
+template <typename Policy>
+DetectorEngine BasicDataRaceDetector<Policy>::getEngine() const
+{
+    return engine.load(std::memory_order_relaxed);
+}
+
+template <typename Policy>
+DetectorStats BasicDataRaceDetector<Policy>::snapshot() const
+{
+    DetectorStats result = stats.sum();
+    result.raceTableOverflows = raceTable.overflows();
+    result.locksetOverflows = LocksetTable::instance().overflows();
+    result.droppedEvents = TraceRecorder::droppedRecords() + ShmChannel::droppedRecords();
+    return result;
+}
+
+template <typename Policy>
+std::uint64_t BasicDataRaceDetector<Policy>::getNumAccesses() const
+{
+    return stats.total(StatCounter::VariableAccesses) + stats.total(StatCounter::MemoryAccesses);
+}
+
+template <typename Policy>
+std::uint64_t BasicDataRaceDetector<Policy>::getNumLockAcquisitions() const
+{
+    return stats.total(StatCounter::LockAcquisitions);
 }
 
-int DataRaceDetector::getNumAccesses() const
+template <typename Policy>
+std::uint64_t BasicDataRaceDetector<Policy>::getNumLockReleases() const
 {
-    return numAccesses;
+    return stats.total(StatCounter::LockReleases);
 }
 
-int DataRaceDetector::getNumLockAcquisitions() const
+template <typename Policy>
+std::uint64_t BasicDataRaceDetector<Policy>::getNumDataRaces() const
 {
-    return numLockAcquisitions;
+    return stats.total(StatCounter::DataRaces);
 }
 
-int DataRaceDetector::getNumLockReleases() const
+template <typename Policy>
+std::uint64_t BasicDataRaceDetector<Policy>::getNumSampledAccesses() const
 {
-    return numLockReleases;
+    return stats.total(StatCounter::SampledAccesses);
 }
 
-int DataRaceDetector::getNumDataRaces() const
+template <typename Policy>
+std::uint64_t BasicDataRaceDetector<Policy>::getNumSkippedAccesses() const
 {
-    return numDataRaces;
+    return stats.total(StatCounter::SkippedAccesses);
 }
 
-void DataRaceDetector::locksetThreadStart()
+template <typename Policy>
+std::uint64_t BasicDataRaceDetector<Policy>::getNumRaceOccurrences() const
+{
+    return stats.total(StatCounter::RaceOccurrences);
+}
+
+template <typename Policy>
+std::vector<RaceRecord> BasicDataRaceDetector<Policy>::getRaceReports() const
+{
+    return raceTable.snapshot();
+}
+
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::locksetThreadStart()
 {
     // Thread-specific initialization if needed
     // Currently a placeholder for future thread-local state initialization
 }
 
-void DataRaceDetector::locksetThreadEnd()
+template <typename Policy>
+void BasicDataRaceDetector<Policy>::locksetThreadEnd()
 {
     // Thread-specific cleanup if needed
     // Currently a placeholder for future thread-local state cleanup
-}
\ No newline at end of file
+}
+
+template class BasicDataRaceDetector<VerbosePolicy>;
+template class BasicDataRaceDetector<ProductionPolicy>;
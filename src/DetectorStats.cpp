@@ -0,0 +1,79 @@
+/**
+ * @file DetectorStats.cpp
+ * @brief Implementation of the per-thread statistics table
+ */
+
+#include "../include/DetectorStats.h"
+#include <cstdlib>
+#include <new>
+
+StatTable::StatTable(std::size_t slots) : slots(slots), count(slots + 1 + kAnalyzerBlocks), blocks(nullptr)
+{
+    void *memory = nullptr;
+    if (posix_memalign(&memory, StatBlock::kCacheLine, count * sizeof(StatBlock)) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    blocks = static_cast<StatBlock *>(memory);
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        new (&blocks[b]) StatBlock();
+    }
+    clear();
+}
+
+StatTable::~StatTable()
+{
+    // StatBlock holds only atomics of integers; there is nothing to destroy.
+    std::free(blocks);
+}
+
+std::uint64_t StatTable::total(StatCounter c) const
+{
+    std::uint64_t n = 0;
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        n += blocks[b].counters[static_cast<std::size_t>(c)].load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+DetectorStats StatTable::sum() const
+{
+    std::uint64_t totals[kStatCounters] = {};
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        for (std::size_t c = 0; c < kStatCounters; ++c)
+        {
+            totals[c] += blocks[b].counters[c].load(std::memory_order_relaxed);
+        }
+    }
+
+    DetectorStats stats = DetectorStats();
+    stats.variableAccesses = totals[static_cast<std::size_t>(StatCounter::VariableAccesses)];
+    stats.memoryAccesses = totals[static_cast<std::size_t>(StatCounter::MemoryAccesses)];
+    stats.lockAcquisitions = totals[static_cast<std::size_t>(StatCounter::LockAcquisitions)];
+    stats.lockReleases = totals[static_cast<std::size_t>(StatCounter::LockReleases)];
+    stats.barrierWaits = totals[static_cast<std::size_t>(StatCounter::BarrierWaits)];
+    stats.conflictChecks = totals[static_cast<std::size_t>(StatCounter::ConflictChecks)];
+    stats.raceOccurrences = totals[static_cast<std::size_t>(StatCounter::RaceOccurrences)];
+    stats.dataRaces = totals[static_cast<std::size_t>(StatCounter::DataRaces)];
+    stats.sampledAccesses = totals[static_cast<std::size_t>(StatCounter::SampledAccesses)];
+    stats.skippedAccesses = totals[static_cast<std::size_t>(StatCounter::SkippedAccesses)];
+    for (std::size_t s = 0; s < kStateCount; ++s)
+    {
+        stats.transitions[s] = totals[static_cast<std::size_t>(StatCounter::TransitionsTo) + s];
+    }
+    return stats;
+}
+
+void StatTable::clear()
+{
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        for (std::atomic<std::uint64_t> &counter : blocks[b].counters)
+        {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+}
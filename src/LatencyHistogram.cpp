@@ -0,0 +1,118 @@
+/**
+ * @file LatencyHistogram.cpp
+ * @brief Implementation of the latency histograms
+ */
+
+#include "../include/LatencyHistogram.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+const char *latencyEventName(LatencyEvent event)
+{
+    switch (event)
+    {
+    case LatencyEvent::VariableAccess:
+        return "onSharedVariableAccess";
+    case LatencyEvent::MemoryAccess:
+        return "onMemoryAccess";
+    case LatencyEvent::LockAcquire:
+        return "onLockAcquire";
+    case LatencyEvent::LockRelease:
+        return "onLockRelease";
+    case LatencyEvent::BarrierWait:
+        return "barrierWait";
+    case LatencyEvent::RaceReport:
+        return "race report";
+    }
+    return "unknown";
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other)
+{
+    for (std::size_t b = 0; b < kBuckets; ++b)
+    {
+        bump(buckets[b], other.buckets[b].load(std::memory_order_relaxed));
+    }
+    bump(total, other.total.load(std::memory_order_relaxed));
+    bump(sum, other.sum.load(std::memory_order_relaxed));
+    std::uint64_t otherMax = other.maximum.load(std::memory_order_relaxed);
+    if (otherMax > maximum.load(std::memory_order_relaxed))
+    {
+        maximum.store(otherMax, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::clear()
+{
+    for (std::size_t b = 0; b < kBuckets; ++b)
+    {
+        buckets[b].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::upperBound(std::size_t bucket)
+{
+    if (bucket < kSubBuckets)
+    {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket / kSubBuckets) - 1;
+    std::uint64_t lower = (kSubBuckets + bucket % kSubBuckets) << shift;
+    return lower + (std::uint64_t(1) << shift) - 1;
+}
+
+std::uint64_t LatencyHistogram::valueAt(double q) const
+{
+    // Counts read here may be a little behind one another while the writer
+    // records, so the rank is taken against the bucket sums, not total.
+    std::uint64_t counts[kBuckets];
+    std::uint64_t n = 0;
+    for (std::size_t b = 0; b < kBuckets; ++b)
+    {
+        counts[b] = buckets[b].load(std::memory_order_relaxed);
+        n += counts[b];
+    }
+    if (n == 0)
+    {
+        return 0;
+    }
+    std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * n)));
+    std::uint64_t seen = 0;
+    std::uint64_t max = maximum.load(std::memory_order_relaxed);
+    for (std::size_t b = 0; b < kBuckets; ++b)
+    {
+        seen += counts[b];
+        if (seen >= rank)
+        {
+            return std::min(upperBound(b), max);
+        }
+    }
+    return max;
+}
+
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary s;
+    s.count = count();
+    s.mean = s.count ? static_cast<double>(sum.load(std::memory_order_relaxed)) / s.count : 0.0;
+    s.p50 = valueAt(0.50);
+    s.p99 = valueAt(0.99);
+    s.p999 = valueAt(0.999);
+    s.max = maximum.load(std::memory_order_relaxed);
+    return s;
+}
+
+std::uint64_t LatencyHistogram::now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
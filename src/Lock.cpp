@@ -5,36 +5,110 @@
 
 #include "../include/Lock.h"
 #include "../include/Thread.h"
-#include <iostream>
+#include "../include/Logger.h"
+#include <deque>
+#include <mutex>
+#include <vector>
 
-Lock::Lock(int id) : id(id), is_locked(false), holding_thread(nullptr), shared_variable(nullptr) {}
+namespace
+{
+
+/**
+ * Dense indices in use, by index, and the indices given back. Leaked so
+ * that Locks with static storage duration can be destroyed at exit.
+ */
+struct DenseIndices
+{
+    std::mutex mutex;
+    std::vector<Lock *> locks;
+    std::deque<std::uint32_t> free;
+
+    static DenseIndices &instance()
+    {
+        static DenseIndices *indices = new DenseIndices();
+        return *indices;
+    }
+
+    std::uint32_t claim(Lock *l)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        std::uint32_t index;
+        if (free.empty())
+        {
+            index = static_cast<std::uint32_t>(locks.size());
+            locks.push_back(l);
+        }
+        else
+        {
+            index = free.front();
+            free.pop_front();
+            locks[index] = l;
+        }
+        return index;
+    }
+
+    void release(std::uint32_t index)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        locks[index] = nullptr;
+        free.push_back(index);
+    }
+
+    Lock *find(std::uint32_t index)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        return index < locks.size() ? locks[index] : nullptr;
+    }
+};
 
+} // namespace
+
+Lock::Lock(int id)
+    : id(id),
+      denseIndex(DenseIndices::instance().claim(this)),
+      is_locked(false),
+      holding_thread(nullptr),
+      shared_variable(nullptr) {}
+
+Lock::~Lock()
+{
+    DenseIndices::instance().release(denseIndex);
+}
+
+Lock *Lock::byDenseIndex(std::uint32_t index)
+{
+    return DenseIndices::instance().find(index);
+}
+
+template <typename Policy>
 void Lock::acquire(Thread *t, bool writeMode, SharedVariable *v)
 {
-    if (!t)
+    if (Policy::checkNullPointers && !t)
     {
-        std::cerr << "Error: Null thread pointer passed to Lock::acquire" << std::endl;
+        PolicyLogger<Policy>::log(LogEvent::NullThreadLockAcquire);
         return;
     }
     
-    is_locked = true;
-    holding_thread = t;
-    shared_variable = v;
-    t->acquireLock(this, writeMode);
+    // Only the holder writes these; readers need no stronger order.
+    is_locked.store(true, std::memory_order_release);
+    holding_thread.store(t, std::memory_order_release);
+    shared_variable.store(v, std::memory_order_release);
+    t->acquireLock<Policy>(this, writeMode);
 }
 
+template <typename Policy>
 void Lock::release(Thread *t)
 {
-    if (!t)
+    if (Policy::checkNullPointers && !t)
     {
-        std::cerr << "Error: Null thread pointer passed to Lock::release" << std::endl;
+        PolicyLogger<Policy>::log(LogEvent::NullThreadLockRelease);
         return;
     }
     
-    is_locked = false;
-    holding_thread = nullptr;
-    shared_variable = nullptr;
-    t->releaseLock(this);
+    is_locked.store(false, std::memory_order_release);
+    holding_thread.store(nullptr, std::memory_order_release);
+    shared_variable.store(nullptr, std::memory_order_release);
+    t->releaseLock<Policy>(this);
 }
 
 bool Lock::isLocked() const
@@ -61,3 +135,18 @@ int Lock::getId() const
 {
     return id;
 }
+
+std::uint32_t Lock::getDenseIndex() const
+{
+    return denseIndex;
+}
+
+VectorClock &Lock::getClock()
+{
+    return clock;
+}
+
+template void Lock::acquire<VerbosePolicy>(Thread *t, bool writeMode, SharedVariable *v);
+template void Lock::acquire<ProductionPolicy>(Thread *t, bool writeMode, SharedVariable *v);
+template void Lock::release<VerbosePolicy>(Thread *t);
+template void Lock::release<ProductionPolicy>(Thread *t);
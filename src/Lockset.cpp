@@ -0,0 +1,412 @@
+/**
+ * @file Lockset.cpp
+ * @brief Implementation of interned locksets and the memoized lockset table
+ */
+
+#include "../include/Lockset.h"
+#include "../include/Lock.h"
+#include "../include/Logger.h"
+#include <algorithm>
+
+namespace
+{
+
+std::uint64_t hashIndices(const std::vector<std::uint32_t> &indices)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for (std::uint32_t i : indices)
+    {
+        h ^= i;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::vector<std::uint32_t> denseIndices(const std::vector<Lock *> &locks)
+{
+    std::vector<std::uint32_t> indices;
+    indices.reserve(locks.size());
+    for (Lock *l : locks)
+    {
+        indices.push_back(l->getDenseIndex());
+    }
+    return indices;
+}
+
+std::size_t pairSlot(std::uint32_t a, std::uint32_t b, std::size_t entries)
+{
+    std::uint64_t h = (static_cast<std::uint64_t>(a) << 32 | b) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h >> 40) & (entries - 1);
+}
+
+} // namespace
+
+Lockset::Lockset(std::uint32_t id, std::vector<std::uint32_t> indices)
+    : id(id), indices(std::move(indices)), bits(nullptr)
+{
+    for (int i = 0; i < kTransitionSlots; ++i)
+    {
+        added[i].store(nullptr, std::memory_order_relaxed);
+        removed[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+const LockBitset &Lockset::getBits() const
+{
+    const LockBitset *built = bits.load(std::memory_order_acquire);
+    if (!built)
+    {
+        // Built once per lockset and never freed, like the lockset itself.
+        LockBitset *fresh = new LockBitset(indices);
+        if (bits.compare_exchange_strong(built, fresh, std::memory_order_acq_rel))
+        {
+            built = fresh;
+        }
+        else
+        {
+            delete fresh;
+        }
+    }
+    return *built;
+}
+
+bool Lockset::contains(const Lock *lock) const
+{
+    return std::binary_search(indices.begin(), indices.end(), lock->getDenseIndex());
+}
+
+bool Lockset::intersectsSorted(const Lockset &other) const
+{
+    auto a = indices.begin();
+    auto b = other.indices.begin();
+    while (a != indices.end() && b != other.indices.end())
+    {
+        if (*a < *b)
+        {
+            ++a;
+        }
+        else if (*b < *a)
+        {
+            ++b;
+        }
+        else
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+LocksetTable &LocksetTable::instance()
+{
+    // Locksets are shared by every detector and must outlive all of them.
+    static LocksetTable *table = new LocksetTable();
+    return *table;
+}
+
+LocksetTable::LocksetTable()
+    : nodes(kNodeArenaBytes), count(0), representation(LocksetRepresentation::Sorted), emptyLockset(nullptr),
+      unknownLockset(nullptr), overflowed(0)
+{
+    for (std::size_t i = 0; i < kMaxChunks; ++i)
+    {
+        chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < kCacheEntries; ++i)
+    {
+        pairCache[i].store(0, std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < kTransitionEntries; ++i)
+    {
+        addedOverflow[i].store(0, std::memory_order_relaxed);
+        removedOverflow[i].store(0, std::memory_order_relaxed);
+    }
+    emptyLockset = intern(std::vector<Lock *>());
+    unknownLockset = new (nodes.allocate(sizeof(Lockset), alignof(Lockset)))
+        Lockset(Lockset::kUnknownId, std::vector<std::uint32_t>());
+}
+
+const Lockset *LocksetTable::byId(std::uint32_t id) const
+{
+    if (id == Lockset::kUnknownId)
+    {
+        return unknownLockset;
+    }
+    if (id >= count.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    std::atomic<const Lockset *> *chunk = chunks[id >> kChunkBits].load(std::memory_order_acquire);
+    return chunk[id & (kChunkSize - 1)].load(std::memory_order_acquire);
+}
+
+std::size_t LocksetTable::size() const
+{
+    return count.load(std::memory_order_acquire);
+}
+
+void LocksetTable::setRepresentation(LocksetRepresentation r)
+{
+    representation.store(r, std::memory_order_relaxed);
+}
+
+LocksetRepresentation LocksetTable::getRepresentation() const
+{
+    return representation.load(std::memory_order_relaxed);
+}
+
+const Lockset *LocksetTable::intern(std::vector<Lock *> locks)
+{
+    std::vector<std::uint32_t> indices = denseIndices(locks);
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    return internIndices(std::move(indices));
+}
+
+const Lockset *LocksetTable::internIndices(std::vector<std::uint32_t> indices)
+{
+    std::uint64_t h = hashIndices(indices);
+
+    std::lock_guard<std::mutex> guard(internMutex);
+    std::vector<const Lockset *> &bucket = byHash[h];
+    for (const Lockset *existing : bucket)
+    {
+        if (existing->indices == indices)
+        {
+            return existing;
+        }
+    }
+
+    std::uint32_t id = count.load(std::memory_order_relaxed);
+    std::size_t chunkIndex = id >> kChunkBits;
+    if (chunkIndex >= kMaxChunks)
+    {
+        // Out of ids. The empty set would make every access under this set
+        // race; the unknown set makes none of them race.
+        if (overflowed.fetch_add(1, std::memory_order_relaxed) == 0)
+        {
+            Logger::log(LogEvent::LocksetTableFull, kMaxChunks * kChunkSize);
+        }
+        return unknownLockset;
+    }
+    std::atomic<const Lockset *> *chunk = chunks[chunkIndex].load(std::memory_order_relaxed);
+    if (!chunk)
+    {
+        chunk = new std::atomic<const Lockset *>[kChunkSize];
+        for (std::size_t i = 0; i < kChunkSize; ++i)
+        {
+            chunk[i].store(nullptr, std::memory_order_relaxed);
+        }
+        chunks[chunkIndex].store(chunk, std::memory_order_release);
+    }
+
+    const Lockset *set = new (nodes.allocate(sizeof(Lockset), alignof(Lockset))) Lockset(id, std::move(indices));
+    if (getRepresentation() == LocksetRepresentation::Bitset)
+    {
+        set->getBits();
+    }
+    chunk[id & (kChunkSize - 1)].store(set, std::memory_order_release);
+    count.store(id + 1, std::memory_order_release);
+    bucket.push_back(set);
+    return set;
+}
+
+const Lockset *LocksetTable::cachedTransition(std::atomic<const Lockset::Transition *> *slots,
+                                              std::atomic<std::uint64_t> *overflow, const Lockset *set,
+                                              std::uint32_t lockIndex) const
+{
+    for (int i = 0; i < Lockset::kTransitionSlots; ++i)
+    {
+        const Lockset::Transition *t = slots[i].load(std::memory_order_acquire);
+        if (!t)
+        {
+            return nullptr;
+        }
+        if (t->lockIndex == lockIndex)
+        {
+            return t->result;
+        }
+    }
+    if (set->id > kMaxCachedId || lockIndex > kMaxCachedId)
+    {
+        return nullptr;
+    }
+    std::uint64_t key = (static_cast<std::uint64_t>(set->id) << (2 * kIdBits + 1)) |
+                        (static_cast<std::uint64_t>(lockIndex) << (kIdBits + 1));
+    std::uint64_t keyMask = ~((std::uint64_t(1) << (kIdBits + 1)) - 1);
+    std::uint64_t cached = overflow[pairSlot(set->id, lockIndex, kTransitionEntries)].load(std::memory_order_acquire);
+    if ((cached & 1) && (cached & keyMask) == key)
+    {
+        return byId(static_cast<std::uint32_t>((cached >> 1) & kMaxCachedId));
+    }
+    return nullptr;
+}
+
+void LocksetTable::cacheTransition(std::atomic<const Lockset::Transition *> *slots,
+                                   std::atomic<std::uint64_t> *overflow, const Lockset *set,
+                                   std::uint32_t lockIndex, const Lockset *result)
+{
+    Lockset::Transition *t = nullptr;
+    for (int i = 0; i < Lockset::kTransitionSlots; ++i)
+    {
+        const Lockset::Transition *expected = nullptr;
+        if (slots[i].load(std::memory_order_relaxed))
+        {
+            continue;
+        }
+        if (!t)
+        {
+            t = new (nodes.allocate(sizeof(Lockset::Transition), alignof(Lockset::Transition)))
+                Lockset::Transition{lockIndex, result};
+        }
+        if (slots[i].compare_exchange_strong(expected, t, std::memory_order_acq_rel))
+        {
+            return;
+        }
+    }
+    // All slots taken: memoize in the shared cache, where a colliding
+    // transition may evict it later. A node that lost every race stays
+    // unused in the arena.
+    if (set->id <= kMaxCachedId && lockIndex <= kMaxCachedId && result->id <= kMaxCachedId)
+    {
+        std::uint64_t entry = (static_cast<std::uint64_t>(set->id) << (2 * kIdBits + 1)) |
+                              (static_cast<std::uint64_t>(lockIndex) << (kIdBits + 1)) |
+                              (static_cast<std::uint64_t>(result->id) << 1) | 1;
+        overflow[pairSlot(set->id, lockIndex, kTransitionEntries)].store(entry, std::memory_order_release);
+    }
+}
+
+const Lockset *LocksetTable::withLock(const Lockset *set, Lock *lock)
+{
+    if (set->unknown() || set->contains(lock))
+    {
+        return set;
+    }
+    const Lockset *result = cachedTransition(set->added, addedOverflow, set, lock->getDenseIndex());
+    if (result)
+    {
+        return result;
+    }
+    std::vector<std::uint32_t> indices(set->indices);
+    indices.insert(std::upper_bound(indices.begin(), indices.end(), lock->getDenseIndex()), lock->getDenseIndex());
+    result = internIndices(std::move(indices));
+    cacheTransition(set->added, addedOverflow, set, lock->getDenseIndex(), result);
+    return result;
+}
+
+const Lockset *LocksetTable::withoutLock(const Lockset *set, Lock *lock)
+{
+    if (set->unknown() || !set->contains(lock))
+    {
+        return set;
+    }
+    const Lockset *result = cachedTransition(set->removed, removedOverflow, set, lock->getDenseIndex());
+    if (result)
+    {
+        return result;
+    }
+    std::vector<std::uint32_t> indices;
+    indices.reserve(set->indices.size() - 1);
+    for (std::uint32_t index : set->indices)
+    {
+        if (index != lock->getDenseIndex())
+        {
+            indices.push_back(index);
+        }
+    }
+    result = internIndices(std::move(indices));
+    cacheTransition(set->removed, removedOverflow, set, lock->getDenseIndex(), result);
+    return result;
+}
+
+const Lockset *LocksetTable::computeIntersection(const Lockset *a, const Lockset *b)
+{
+    std::vector<std::uint32_t> common;
+    if (getRepresentation() == LocksetRepresentation::Bitset)
+    {
+        // Disjoint sets, the common case when a race is found, stop at the
+        // AND+test. Otherwise AND the bitsets and read back the set bits.
+        if (!a->intersectsBitset(*b))
+        {
+            return emptyLockset;
+        }
+        LockBitset(a->getBits(), b->getBits()).appendIndices(common);
+        return internIndices(std::move(common));
+    }
+
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < a->indices.size() && j < b->indices.size())
+    {
+        if (a->indices[i] < b->indices[j])
+        {
+            ++i;
+        }
+        else if (b->indices[j] < a->indices[i])
+        {
+            ++j;
+        }
+        else
+        {
+            common.push_back(a->indices[i]);
+            ++i;
+            ++j;
+        }
+    }
+    return internIndices(std::move(common));
+}
+
+const Lockset *LocksetTable::intersect(const Lockset *a, const Lockset *b)
+{
+    if (a == b)
+    {
+        return a;
+    }
+    if (a->unknown() || b->unknown())
+    {
+        return unknownLockset;
+    }
+    if (a->empty() || b->empty())
+    {
+        return emptyLockset;
+    }
+
+    std::uint32_t lo = std::min(a->id, b->id);
+    std::uint32_t hi = std::max(a->id, b->id);
+    if (hi > kMaxCachedId)
+    {
+        return computeIntersection(a, b);
+    }
+
+    std::atomic<std::uint64_t> &entry = pairCache[pairSlot(lo, hi, kCacheEntries)];
+    std::uint64_t key = (static_cast<std::uint64_t>(lo) << (2 * kIdBits + 1)) |
+                        (static_cast<std::uint64_t>(hi) << (kIdBits + 1));
+    std::uint64_t keyMask = ~((std::uint64_t(1) << (kIdBits + 1)) - 1);
+    std::uint64_t cached = entry.load(std::memory_order_acquire);
+    if ((cached & 1) && (cached & keyMask) == key)
+    {
+        return byId(static_cast<std::uint32_t>((cached >> 1) & kMaxCachedId));
+    }
+
+    const Lockset *result = computeIntersection(a, b);
+    if (result->id <= kMaxCachedId)
+    {
+        entry.store(key | (static_cast<std::uint64_t>(result->id) << 1) | 1, std::memory_order_release);
+    }
+    return result;
+}
+
+bool LocksetTable::hasCommonLock(const Lockset *a, const Lockset *b)
+{
+    if (a->unknown() || b->unknown())
+    {
+        return true;
+    }
+    if (std::max(a->id, b->id) > kMaxCachedId)
+    {
+        // Not memoizable: test directly instead of interning the result.
+        return getRepresentation() == LocksetRepresentation::Bitset ? a->intersectsBitset(*b)
+                                                                    : a->intersectsSorted(*b);
+    }
+    return !intersect(a, b)->empty();
+}
@@ -0,0 +1,629 @@
+/**
+ * @file Logger.cpp
+ * @brief Implementation of the asynchronous ring-buffer logger
+ */
+
+#include "../include/Logger.h"
+#include "../include/SharedVariable.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct LogRecord
+{
+    std::uint64_t timestamp;
+    LogEvent event;
+    std::uint16_t count;
+    std::int64_t args[Logger::kMaxArgs];
+};
+
+/**
+ * Single-producer/single-consumer ring. The owning application thread
+ * advances head, the drain (under drainMutex) advances tail. Padding keeps
+ * the two indices on separate cache lines.
+ */
+struct RingBuffer
+{
+    static const std::uint64_t kCapacity = 4096;
+
+    std::atomic<std::uint64_t> head;
+    char headPad[64 - sizeof(std::atomic<std::uint64_t>)];
+    std::atomic<std::uint64_t> tail;
+    char tailPad[64 - sizeof(std::atomic<std::uint64_t>)];
+    std::atomic<bool> released;
+    RingBuffer *next;
+    LogRecord records[kCapacity];
+
+    RingBuffer() : head(0), tail(0), released(false), next(nullptr) {}
+};
+
+std::uint64_t now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+const char *formatOf(LogEvent event)
+{
+    switch (event)
+    {
+    case LogEvent::DataRace:
+        return "Data race detected between thread %d and thread %d on shared variable %v";
+    case LogEvent::MemoryRace:
+        return "Data race detected between thread %d and thread %d on address %p";
+    case LogEvent::NullThreadRegister:
+        return "Error: Null thread pointer passed to registerThread";
+    case LogEvent::NullThreadUnregister:
+        return "Error: Null thread pointer passed to unregisterThread";
+    case LogEvent::NullVariableRegister:
+        return "Error: Null shared variable pointer passed to registerSharedVariable";
+    case LogEvent::NullVariableUnregister:
+        return "Error: Null shared variable pointer passed to unregisterSharedVariable";
+    case LogEvent::NullLockAcquire:
+        return "Error: Null pointer passed to onLockAcquire";
+    case LogEvent::NullLockRelease:
+        return "Error: Null pointer passed to onLockRelease";
+    case LogEvent::NullAccess:
+        return "Error: Null pointer passed to onSharedVariableAccess";
+    case LogEvent::InvalidRaceReport:
+        return "Error: Invalid pointers in reportDataRace";
+    case LogEvent::ReleaseNotOwner:
+        return "Error: Thread %d tried to release lock %d which it doesn't own.";
+    case LogEvent::BarrierInvalidParams:
+        return "Error: Invalid parameters for barrier initialization";
+    case LogEvent::BarrierInitFailed:
+        return "Error: Failed to initialize barrier";
+    case LogEvent::BarrierNotInitialized:
+        return "Error: Barrier not initialized";
+    case LogEvent::NullThreadLockAcquire:
+        return "Error: Null thread pointer passed to Lock::acquire";
+    case LogEvent::NullThreadLockRelease:
+        return "Error: Null thread pointer passed to Lock::release";
+    case LogEvent::NullThreadVariableAccess:
+        return "Error: Null thread pointer passed to access";
+    case LogEvent::NullLockThreadAcquire:
+        return "Error: Null lock pointer passed to Thread::acquireLock";
+    case LogEvent::NullLockThreadRelease:
+        return "Error: Null lock pointer passed to Thread::releaseLock";
+    case LogEvent::NullMemoryAccess:
+        return "Error: Null pointer passed to onMemoryAccess";
+    case LogEvent::RaceTableFull:
+        return "Error: Race table full; %d race occurrences were reported without deduplication";
+    case LogEvent::NullThreadSync:
+        return "Error: Null thread pointer passed to barrierWait, onThreadFork or onThreadJoin";
+    case LogEvent::ThreadTableFull:
+        return "Error: Thread table full; thread %d has no slot";
+    case LogEvent::UnregisteredThread:
+        return "Error: Event from a thread with no registered Thread in this detector";
+    case LogEvent::ClockIndexOverflow:
+        return "Error: Out of clock indices at thread %d; races between threads without a slot may be missed";
+    case LogEvent::LocksetTableFull:
+        return "Error: Lockset table full after %d locksets; accesses under new locksets are no longer checked";
+    case LogEvent::ThreadRegistered:
+        return "Thread %d registered.";
+    case LogEvent::ThreadUnregistered:
+        return "Thread %d unregistered.";
+    case LogEvent::VariableRegistered:
+        return "Shared variable %v registered. With state %s";
+    case LogEvent::VariableUnregistered:
+        return "Shared variable %v unregistered.";
+    case LogEvent::DetectorInitialized:
+        return "Data race detector initialized.";
+    case LogEvent::RaceSummaryDetected:
+        return "Warning: data race detected!";
+    case LogEvent::RaceSummaryClean:
+        return "Data race not detected!";
+    case LogEvent::RaceOccurrences:
+        return "Data race between thread %d and thread %d on shared variable %v occurred %d times";
+    case LogEvent::MemoryRaceOccurrences:
+        return "Data race between thread %d and thread %d on address %p occurred %d times";
+    case LogEvent::DetectorFinished:
+        return "Data race detector finished.";
+    case LogEvent::BarrierInitialized:
+        return "Barrier initialized with count %d";
+    case LogEvent::BarrierReached:
+        return "All threads have reached the barrier";
+    case LogEvent::LockAcquired:
+        return "Thread %d acquired lock %d with %m access on variable %v";
+    case LogEvent::LockReleased:
+        return "Thread %d released lock %d on variable %v";
+    case LogEvent::AccessAttempt:
+        return "Thread %d is trying to access variable %v with %m access.";
+    case LogEvent::VariableState:
+        return "Variable %v is currently in state %s";
+    case LogEvent::CurrentlyAccessing:
+        return "Thread %d is currently accessing variable %v with %m access.";
+    case LogEvent::WriteConflict:
+        return "Thread %d cannot access variable %v with WRITE access because it is already being accessed by thread %d";
+    case LogEvent::ReadConflict:
+        return "Thread %d cannot access variable %v with READ access because it is already being accessed by thread %d with WRITE access.";
+    case LogEvent::Accessed:
+        return "Thread %d accessed variable %v, now in state %s";
+    case LogEvent::ResettingVariable:
+        return "Resetting state of variable %v";
+    case LogEvent::VariableAccess:
+        return "Thread %d accessed variable %v with %m access. State: %s";
+    case LogEvent::StateAfterAccess:
+        return "State after access: %s";
+    case LogEvent::ThreadLockAcquired:
+        return "Thread %d acquired lock %d (%W Mode)";
+    case LogEvent::ThreadLockReleased:
+        return "Thread %d released lock %d";
+    case LogEvent::MemoryAccess:
+        return "Thread %d accessed address %p (%d bytes) with %m access";
+    case LogEvent::OrderedAccess:
+        return "Thread %d access to variable %v happens after the conflicting access; not a race with thread %d";
+    case LogEvent::ThreadForked:
+        return "Thread %d forked thread %d";
+    case LogEvent::ThreadJoined:
+        return "Thread %d joined thread %d";
+    }
+    return "Unknown log event";
+}
+
+/// Ids of interned names are spread over stripes so that threads creating
+/// variables do not all take one mutex. Id = index * kNameStripes + stripe.
+const std::uint32_t kNameStripes = 16;
+
+/// Released ids a stripe may hold before a new id drains the logger inline.
+const std::size_t kNameBacklog = 1024;
+
+struct NameEntry
+{
+    std::string name;
+    std::uint32_t refs = 0;
+};
+
+/**
+ * One stripe of the name table. An index whose references are gone waits
+ * in released until the next drain has written every record that might
+ * print it, then moves to free for reuse.
+ */
+struct NameStripe
+{
+    std::mutex mutex;
+    std::vector<NameEntry> entries;
+    std::vector<std::uint32_t> free;
+    std::vector<std::uint32_t> released;
+    std::vector<std::uint32_t> retiring;   ///< Released before the current drain
+};
+
+/**
+ * Shared logger state. It is intentionally leaked so that detectors and
+ * variables with static storage duration can still log while the program
+ * is shutting down; an atexit handler drains what is left.
+ */
+class LoggerState
+{
+public:
+    static LoggerState &instance()
+    {
+        static LoggerState *state = new LoggerState();
+        return *state;
+    }
+
+    RingBuffer *acquireBuffer()
+    {
+        std::lock_guard<std::mutex> guard(buffersMutex);
+        for (RingBuffer *r = buffers.load(std::memory_order_acquire); r; r = r->next)
+        {
+            if (r->released.load(std::memory_order_acquire) &&
+                r->tail.load(std::memory_order_acquire) == r->head.load(std::memory_order_relaxed))
+            {
+                r->released.store(false, std::memory_order_release);
+                return r;
+            }
+        }
+        RingBuffer *r = new RingBuffer();
+        r->next = buffers.load(std::memory_order_relaxed);
+        buffers.store(r, std::memory_order_release);
+        return r;
+    }
+
+    std::vector<std::string> internedNames()
+    {
+        std::vector<std::string> all;
+        for (std::uint32_t s = 0; s < kNameStripes; ++s)
+        {
+            NameStripe &stripe = stripes[s];
+            std::lock_guard<std::mutex> guard(stripe.mutex);
+            for (std::size_t i = 0; i < stripe.entries.size(); ++i)
+            {
+                std::size_t id = i * kNameStripes + s;
+                if (id >= all.size())
+                {
+                    all.resize(id + 1);
+                }
+                all[id] = stripe.entries[i].name;
+            }
+        }
+        return all;
+    }
+
+    std::uint32_t internName(const std::string &name)
+    {
+        static std::atomic<std::uint32_t> nextStripe(0);
+        thread_local std::uint32_t s = nextStripe.fetch_add(1, std::memory_order_relaxed) % kNameStripes;
+        NameStripe &stripe = stripes[s];
+        std::unique_lock<std::mutex> guard(stripe.mutex);
+        if (stripe.free.empty() && stripe.released.size() >= kNameBacklog)
+        {
+            // Released ids are reused after the next drain; run one now
+            // rather than grow the table until the background thread does.
+            guard.unlock();
+            drain();
+            guard.lock();
+        }
+        std::uint32_t index;
+        if (stripe.free.empty())
+        {
+            index = static_cast<std::uint32_t>(stripe.entries.size());
+            stripe.entries.emplace_back();
+        }
+        else
+        {
+            index = stripe.free.back();
+            stripe.free.pop_back();
+        }
+        stripe.entries[index].name = name;
+        stripe.entries[index].refs = 1;
+        return index * kNameStripes + s;
+    }
+
+    void retainName(std::uint32_t id)
+    {
+        NameStripe &stripe = stripes[id % kNameStripes];
+        std::lock_guard<std::mutex> guard(stripe.mutex);
+        ++stripe.entries[id / kNameStripes].refs;
+    }
+
+    void releaseName(std::uint32_t id)
+    {
+        NameStripe &stripe = stripes[id % kNameStripes];
+        std::lock_guard<std::mutex> guard(stripe.mutex);
+        if (--stripe.entries[id / kNameStripes].refs == 0)
+        {
+            stripe.released.push_back(id / kNameStripes);
+        }
+    }
+
+    void holdNames(bool hold)
+    {
+        holds.fetch_add(hold ? 1 : -1, std::memory_order_acq_rel);
+    }
+
+    void setOutput(std::FILE *stream, std::FILE *errorStream)
+    {
+        std::lock_guard<std::mutex> guard(drainMutex);
+        out = stream;
+        err = errorStream;
+    }
+
+    void wake()
+    {
+        wakeCondition.notify_one();
+    }
+
+    bool isStopped() const
+    {
+        return stopped.load(std::memory_order_acquire);
+    }
+
+    /// Moves every pending record from every ring to the output streams.
+    void drain()
+    {
+        std::lock_guard<std::mutex> guard(drainMutex);
+        // Names released before the rings are read may still be printed by
+        // this batch; they are reused only once it has been written.
+        for (NameStripe &stripe : stripes)
+        {
+            std::lock_guard<std::mutex> names(stripe.mutex);
+            stripe.retiring.swap(stripe.released);
+        }
+        writeBatch();
+        bool held = holds.load(std::memory_order_acquire) > 0;
+        for (NameStripe &stripe : stripes)
+        {
+            std::lock_guard<std::mutex> names(stripe.mutex);
+            for (std::uint32_t index : stripe.retiring)
+            {
+                if (held)
+                {
+                    stripe.released.push_back(index);
+                }
+                else
+                {
+                    std::string().swap(stripe.entries[index].name);
+                    stripe.free.push_back(index);
+                }
+            }
+            stripe.retiring.clear();
+        }
+    }
+
+    void writeBatch()
+    {
+        batch.clear();
+        for (RingBuffer *r = buffers.load(std::memory_order_acquire); r; r = r->next)
+        {
+            std::uint64_t tail = r->tail.load(std::memory_order_relaxed);
+            std::uint64_t head = r->head.load(std::memory_order_acquire);
+            for (; tail != head; ++tail)
+            {
+                batch.push_back(r->records[tail & (RingBuffer::kCapacity - 1)]);
+            }
+            r->tail.store(tail, std::memory_order_release);
+        }
+        if (batch.empty())
+        {
+            return;
+        }
+
+        std::stable_sort(batch.begin(), batch.end(), [](const LogRecord &a, const LogRecord &b)
+        {
+            return a.timestamp < b.timestamp;
+        });
+
+        outText.clear();
+        errText.clear();
+        for (const LogRecord &rec : batch)
+        {
+            format(rec, Logger::levelOf(rec.event) == LogLevel::Error ? errText : outText);
+        }
+        if (!outText.empty())
+        {
+            std::fwrite(outText.data(), 1, outText.size(), out);
+            std::fflush(out);
+        }
+        if (!errText.empty())
+        {
+            std::fwrite(errText.data(), 1, errText.size(), err);
+            std::fflush(err);
+        }
+    }
+
+    void stop()
+    {
+        stopped.store(true, std::memory_order_release);
+        wake();
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+        drain();
+    }
+
+private:
+    LoggerState() : buffers(nullptr), holds(0), stopped(false), out(stdout), err(stderr)
+    {
+        worker = std::thread(&LoggerState::run, this);
+        std::atexit([] { LoggerState::instance().stop(); });
+    }
+
+    void run()
+    {
+        while (!isStopped())
+        {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wakeCondition.wait_for(lock, std::chrono::milliseconds(2));
+            }
+            drain();
+        }
+    }
+
+    std::string nameOf(std::int64_t id)
+    {
+        if (id < 0)
+        {
+            return "?";
+        }
+        NameStripe &stripe = stripes[static_cast<std::uint64_t>(id) % kNameStripes];
+        std::size_t index = static_cast<std::size_t>(static_cast<std::uint64_t>(id) / kNameStripes);
+        std::lock_guard<std::mutex> guard(stripe.mutex);
+        if (index >= stripe.entries.size() || stripe.entries[index].name.empty())
+        {
+            return "?";
+        }
+        return stripe.entries[index].name;
+    }
+
+    void format(const LogRecord &rec, std::string &text)
+    {
+        int arg = 0;
+        for (const char *p = formatOf(rec.event); *p; ++p)
+        {
+            if (*p != '%' || p[1] == '\0')
+            {
+                text += *p;
+                continue;
+            }
+            std::int64_t value = arg < rec.count ? rec.args[arg] : 0;
+            ++arg;
+            switch (*++p)
+            {
+            case 'd':
+                text += std::to_string(value);
+                break;
+            case 'v':
+                text += nameOf(value);
+                break;
+            case 'p':
+            {
+                char hex[2 + 16 + 1];
+                std::snprintf(hex, sizeof(hex), "0x%llx", static_cast<unsigned long long>(value));
+                text += hex;
+                break;
+            }
+            case 'm':
+                text += value ? "WRITE" : "READ";
+                break;
+            case 'W':
+                text += value ? "Write" : "Read";
+                break;
+            case 's':
+                text += SharedVariable::stateToString(static_cast<State>(value));
+                break;
+            default:
+                text += *p;
+                --arg;
+                break;
+            }
+        }
+        text += '\n';
+    }
+
+    std::mutex buffersMutex;
+    std::atomic<RingBuffer *> buffers;
+    NameStripe stripes[kNameStripes];
+    std::atomic<int> holds;
+
+    std::mutex drainMutex;
+    std::vector<LogRecord> batch;
+    std::string outText;
+    std::string errText;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<bool> stopped;
+    std::thread worker;
+    std::FILE *out;
+    std::FILE *err;
+};
+
+/// Marks the thread's ring as reusable once the thread exits.
+struct BufferHandle
+{
+    RingBuffer *ring = nullptr;
+    ~BufferHandle()
+    {
+        if (ring)
+        {
+            ring->released.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local BufferHandle currentBuffer;
+
+std::uint8_t initialLevel()
+{
+    const char *env = std::getenv("LOCKSET_LOG_LEVEL");
+    if (!env)
+    {
+        return static_cast<std::uint8_t>(LogLevel::Trace);
+    }
+    static const char *const levelNames[] = {"off", "race", "error", "info", "trace"};
+    for (std::uint8_t i = 0; i < 5; ++i)
+    {
+        if (std::strcmp(env, levelNames[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return static_cast<std::uint8_t>(LogLevel::Trace);
+}
+
+} // namespace
+
+std::atomic<std::uint8_t> Logger::currentLevel(initialLevel());
+
+void Logger::setLevel(LogLevel level)
+{
+    currentLevel.store(static_cast<std::uint8_t>(level), std::memory_order_relaxed);
+}
+
+LogLevel Logger::getLevel()
+{
+    return static_cast<LogLevel>(currentLevel.load(std::memory_order_relaxed));
+}
+
+void Logger::setOutput(std::FILE *stream, std::FILE *errorStream)
+{
+    LoggerState::instance().setOutput(stream, errorStream);
+}
+
+std::uint32_t Logger::internName(const std::string &name)
+{
+    return LoggerState::instance().internName(name);
+}
+
+void Logger::retainName(std::uint32_t id)
+{
+    LoggerState::instance().retainName(id);
+}
+
+void Logger::releaseName(std::uint32_t id)
+{
+    LoggerState::instance().releaseName(id);
+}
+
+void Logger::holdNames(bool hold)
+{
+    LoggerState::instance().holdNames(hold);
+}
+
+std::vector<std::string> Logger::internedNames()
+{
+    return LoggerState::instance().internedNames();
+}
+
+void Logger::flush()
+{
+    LoggerState::instance().drain();
+}
+
+void Logger::append(LogEvent event, const std::int64_t *args, int count)
+{
+    LoggerState &state = LoggerState::instance();
+    RingBuffer *ring = currentBuffer.ring;
+    if (!ring)
+    {
+        ring = currentBuffer.ring = state.acquireBuffer();
+    }
+
+    std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    std::uint64_t used = head - ring->tail.load(std::memory_order_acquire);
+    while (used >= RingBuffer::kCapacity)
+    {
+        // Full: never drop, let the drain catch up. Once the background
+        // thread has stopped (process exit) drain inline.
+        if (state.isStopped())
+        {
+            state.drain();
+        }
+        else
+        {
+            state.wake();
+            std::this_thread::yield();
+        }
+        used = head - ring->tail.load(std::memory_order_acquire);
+    }
+
+    LogRecord &rec = ring->records[head & (RingBuffer::kCapacity - 1)];
+    rec.timestamp = now();
+    rec.event = event;
+    rec.count = static_cast<std::uint16_t>(count);
+    for (int i = 0; i < count; ++i)
+    {
+        rec.args[i] = args[i];
+    }
+    ring->head.store(head + 1, std::memory_order_release);
+
+    if (used == RingBuffer::kCapacity / 2)
+    {
+        state.wake();
+    }
+    else if (state.isStopped())
+    {
+        state.drain();
+    }
+}
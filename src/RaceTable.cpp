@@ -0,0 +1,126 @@
+/**
+ * @file RaceTable.cpp
+ * @brief Implementation of the race aggregation table
+ */
+
+#include "../include/RaceTable.h"
+#include "../include/SharedVariable.h"
+#include <chrono>
+
+namespace
+{
+
+std::uint64_t nowNanoseconds()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+std::uint64_t mix(std::uint64_t h, std::uint64_t v)
+{
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    return h;
+}
+
+std::uint64_t hashOf(const RaceKey &key)
+{
+    std::uint64_t h = mix(0, key.location);
+    h = mix(h, (std::uint64_t(key.thread) << 32) | key.otherThread);
+    h = mix(h, (std::uint64_t(key.lockset) << 32) | key.otherLockset);
+    h = mix(h, (std::uint64_t(key.kind) << 16) | (std::uint64_t(key.type) << 8) |
+                   static_cast<std::uint64_t>(key.state));
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return h | 1; // 0 marks a free slot
+}
+
+std::size_t roundUpToPowerOfTwo(std::size_t n)
+{
+    std::size_t p = 1;
+    while (p < n)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+} // namespace
+
+bool RaceKey::operator==(const RaceKey &other) const
+{
+    return location == other.location && thread == other.thread && otherThread == other.otherThread &&
+           lockset == other.lockset && otherLockset == other.otherLockset && type == other.type &&
+           state == other.state && kind == other.kind;
+}
+
+RaceTable::RaceTable(std::size_t slotCount)
+    : slots(new Slot[roundUpToPowerOfTwo(slotCount ? slotCount : 1)]),
+      mask(roundUpToPowerOfTwo(slotCount ? slotCount : 1) - 1),
+      overflowed(0)
+{
+    clear();
+}
+
+RaceTable::Outcome RaceTable::record(const RaceKey &key)
+{
+    std::uint64_t h = hashOf(key);
+    for (int probe = 0; probe < kMaxProbes; ++probe)
+    {
+        Slot &slot = slots[(h + static_cast<std::uint64_t>(probe)) & mask];
+        std::uint64_t current = slot.hash.load(std::memory_order_acquire);
+        if (current == 0)
+        {
+            if (slot.hash.compare_exchange_strong(current, h, std::memory_order_acq_rel))
+            {
+                std::uint64_t now = nowNanoseconds();
+                slot.key = key;
+                slot.firstSeen.store(now, std::memory_order_relaxed);
+                slot.lastSeen.store(now, std::memory_order_relaxed);
+                slot.count.store(1, std::memory_order_relaxed);
+                slot.ready.store(true, std::memory_order_release);
+                return New;
+            }
+            // Lost the slot; current now holds the winner's hash.
+        }
+        // While the key is still being written the hash alone decides.
+        if (current == h && (!slot.ready.load(std::memory_order_acquire) || slot.key == key))
+        {
+            slot.count.fetch_add(1, std::memory_order_relaxed);
+            slot.lastSeen.store(nowNanoseconds(), std::memory_order_relaxed);
+            return Repeat;
+        }
+    }
+    overflowed.fetch_add(1, std::memory_order_relaxed);
+    return Overflow;
+}
+
+std::vector<RaceRecord> RaceTable::snapshot() const
+{
+    std::vector<RaceRecord> records;
+    for (std::size_t i = 0; i <= mask; ++i)
+    {
+        const Slot &slot = slots[i];
+        if (slot.ready.load(std::memory_order_acquire))
+        {
+            RaceRecord r;
+            r.key = slot.key;
+            r.count = slot.count.load(std::memory_order_relaxed);
+            r.firstSeen = slot.firstSeen.load(std::memory_order_relaxed);
+            r.lastSeen = slot.lastSeen.load(std::memory_order_relaxed);
+            records.push_back(r);
+        }
+    }
+    return records;
+}
+
+void RaceTable::clear()
+{
+    for (std::size_t i = 0; i <= mask; ++i)
+    {
+        slots[i].hash.store(0, std::memory_order_relaxed);
+        slots[i].ready.store(false, std::memory_order_relaxed);
+        slots[i].count.store(0, std::memory_order_relaxed);
+    }
+    overflowed.store(0, std::memory_order_relaxed);
+}
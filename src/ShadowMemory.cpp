@@ -0,0 +1,156 @@
+/**
+ * @file ShadowMemory.cpp
+ * @brief Implementation of the lazily reserved shadow cell table
+ */
+
+#include "../include/ShadowMemory.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+ShadowMemory::ShadowMemory() : regions(nullptr), currentGeneration(0), hugePages(false)
+{
+    const char *env = std::getenv("LOCKSET_SHADOW_HUGEPAGES");
+    hugePages = env && std::strcmp(env, "0") != 0;
+
+    // The top-level table itself is 256 KiB; keep it off the caller's stack
+    // and let the kernel zero-fill it on demand.
+    void *table = mmap(nullptr, kRegions * sizeof(*regions), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (table != MAP_FAILED)
+    {
+        regions = static_cast<std::atomic<std::atomic<std::uint64_t> *> *>(table);
+    }
+}
+
+ShadowMemory::~ShadowMemory()
+{
+    if (!regions)
+    {
+        return;
+    }
+    for (std::size_t i = 0; i < kRegions; ++i)
+    {
+        std::atomic<std::uint64_t> *cells = regions[i].load(std::memory_order_relaxed);
+        if (cells)
+        {
+            munmap(cells, kRegionCells * sizeof(*cells));
+        }
+    }
+    munmap(regions, kRegions * sizeof(*regions));
+}
+
+std::atomic<std::uint64_t> *ShadowMemory::mapRegion(std::uintptr_t region)
+{
+    std::size_t bytes = kRegionCells * sizeof(std::atomic<std::uint64_t>);
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugePages)
+    {
+        madvise(p, bytes, MADV_HUGEPAGE);
+    }
+#endif
+
+    std::atomic<std::uint64_t> *cells = static_cast<std::atomic<std::uint64_t> *>(p);
+    std::atomic<std::uint64_t> *expected = nullptr;
+    if (!regions[region].compare_exchange_strong(expected, cells, std::memory_order_acq_rel))
+    {
+        // Another thread reserved this region first.
+        munmap(p, bytes);
+        return expected;
+    }
+    return cells;
+}
+
+void ShadowMemory::clear()
+{
+    std::uint32_t next = (currentGeneration.load(std::memory_order_relaxed) + 1) &
+                         ((1u << ShadowCell::kGenerationBits) - 1);
+    if (next == 0)
+    {
+        wipe();
+        return;
+    }
+    currentGeneration.store(next, std::memory_order_release);
+}
+
+void ShadowMemory::wipe()
+{
+    currentGeneration.store(0, std::memory_order_release);
+    if (!regions)
+    {
+        return;
+    }
+    for (std::size_t i = 0; i < kRegions; ++i)
+    {
+        std::atomic<std::uint64_t> *cells = regions[i].load(std::memory_order_acquire);
+        if (cells)
+        {
+            // Anonymous private pages read back as zero, i.e. Virgin cells.
+            madvise(cells, kRegionCells * sizeof(*cells), MADV_DONTNEED);
+        }
+    }
+}
+
+void ShadowMemory::clear(const void *addr, std::size_t size)
+{
+    std::uintptr_t a = reinterpret_cast<std::uintptr_t>(addr);
+    if (!regions || size == 0 || a >= (std::uintptr_t(1) << kAddressBits))
+    {
+        return;
+    }
+    std::uintptr_t first = a >> kGranuleShift;
+    std::uintptr_t end = std::min<std::uintptr_t>(((a + size - 1) >> kGranuleShift) + 1,
+                                                  std::uintptr_t(1) << (kAddressBits - kGranuleShift));
+    const std::uintptr_t cellsPerPage = 4096 / sizeof(std::uint64_t);
+    while (first < end)
+    {
+        std::uintptr_t region = first >> (kRegionShift - kGranuleShift);
+        std::uintptr_t regionEnd = std::min<std::uintptr_t>(end, (region + 1) << (kRegionShift - kGranuleShift));
+        std::atomic<std::uint64_t> *cells = regions[region].load(std::memory_order_acquire);
+        if (cells)
+        {
+            // Cell indices within the region; [pageLo, pageHi) are whole pages.
+            std::uintptr_t lo = first & (kRegionCells - 1);
+            std::uintptr_t hi = lo + (regionEnd - first);
+            std::uintptr_t pageLo = (lo + cellsPerPage - 1) & ~(cellsPerPage - 1);
+            std::uintptr_t pageHi = hi & ~(cellsPerPage - 1);
+            if (pageLo < pageHi)
+            {
+                madvise(cells + pageLo, (pageHi - pageLo) * sizeof(*cells), MADV_DONTNEED);
+            }
+            else
+            {
+                pageLo = pageHi = hi;
+            }
+            for (std::uintptr_t c = lo; c < pageLo; ++c)
+            {
+                cells[c].store(0, std::memory_order_relaxed);
+            }
+            for (std::uintptr_t c = pageHi; c < hi; ++c)
+            {
+                cells[c].store(0, std::memory_order_relaxed);
+            }
+        }
+        first = regionEnd;
+    }
+}
+
+std::size_t ShadowMemory::mappedRegions() const
+{
+    std::size_t n = 0;
+    for (std::size_t i = 0; regions && i < kRegions; ++i)
+    {
+        if (regions[i].load(std::memory_order_relaxed))
+        {
+            ++n;
+        }
+    }
+    return n;
+}
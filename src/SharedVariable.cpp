@@ -7,10 +7,47 @@
 #include "../include/Accesstype.h"
 #include "../include/Thread.h"
 #include "../include/Lock.h"
+#include "../include/Lockset.h"
+#include "../include/Logger.h"
 #include <iostream>
 
+State nextState(State current, AccessType type)
+{
+    switch (current)
+    {
+    case State::Virgin:
+        return type == AccessType::WRITE ? State::Initializing : State::Exclusive;
+    case State::Initializing:
+    case State::Exclusive:
+        return type == AccessType::WRITE ? State::SharedModified : State::Shared;
+    case State::Shared:
+        return type == AccessType::WRITE ? State::SharedModified : State::Shared;
+    case State::SharedModified:
+        // No state change for further accesses in SharedModified state
+        return State::SharedModified;
+    default:
+        return current;
+    }
+}
+
+bool isConflictingAccess(State current, AccessType type)
+{
+    if (type == AccessType::WRITE)
+    {
+        return current == State::Exclusive || current == State::Initializing ||
+               current == State::Shared || current == State::SharedModified;
+    }
+    return current == State::Exclusive || current == State::Initializing;
+}
+
 SharedVariable::SharedVariable(const std::string &name)
-    : name(name), is_accessed(false), accessing_thread(nullptr), state(State::Virgin) {}
+    : name(name), nameId(Logger::internName(name)), is_accessed(false), accessing_thread(nullptr), accessing_lockset(nullptr), state(State::Virgin),
+      candidate_locks(nullptr), retired_session(0), sample_countdown(0), sampled_lockset(nullptr), sample_shift(0), sample_streak(0), generation(0) {}
+
+SharedVariable::~SharedVariable()
+{
+    Logger::releaseName(nameId);
+}
 
 bool SharedVariable::isAccessed() const
 {
@@ -31,77 +68,81 @@ Thread *SharedVariable::releaseThread(Thread *t)
     }
     return t;
 }
+
+void SharedVariable::replaceAccessingThread(Thread *from, Thread *to)
+{
+    if (accessing_thread == from)
+    {
+        accessing_thread = to;
+    }
+}
+
+const Lockset *SharedVariable::getAccessingLockset() const
+{
+    return accessing_lockset;
+}
+
+void SharedVariable::setAccessingLockset(const Lockset *set)
+{
+    accessing_lockset = set;
+}
+
+void SharedVariable::sampled(const Lockset *held, bool raced)
+{
+    if (raced || held != sampled_lockset.load(std::memory_order_relaxed))
+    {
+        sample_shift = 0;
+        sample_streak = 0;
+    }
+    else if (++sample_streak >= kSamplesPerBackoff)
+    {
+        sample_streak = 0;
+        if (sample_shift < kMaxSampleShift)
+        {
+            ++sample_shift;
+        }
+    }
+    sampled_lockset.store(held, std::memory_order_relaxed);
+    sample_countdown.store(std::int32_t(1) << sample_shift, std::memory_order_relaxed);
+}
+
+unsigned SharedVariable::getSampleShift() const
+{
+    return sample_shift;
+}
+
+VariableClock &SharedVariable::getClock()
+{
+    return clock;
+}
+
 void SharedVariable::reset()
 {
     is_accessed = false;
     accessing_thread = nullptr;
     state = State::Virgin;
+    candidate_locks = nullptr;
+    retired_session.store(0, std::memory_order_relaxed);
+    clock.reset();
 }
+
+template <typename Policy>
 void SharedVariable::access(Thread *t, AccessType type)
 {
-    if (!t)
+    if (Policy::checkNullPointers && !t)
     {
-        std::cerr << "Error: Null thread pointer passed to access" << std::endl;
+        PolicyLogger<Policy>::log(LogEvent::NullThreadVariableAccess);
         return;
     }
     
     is_accessed = true;
     accessing_thread = t;
 
-    std::cout << "Thread " << t->getId() << " accessed variable " << name
-              << " with " << (type == AccessType::READ ? "READ" : "WRITE") << " access. State: " << SharedVariable::stateToString(state) << std::endl;
+    PolicyLogger<Policy>::log(LogEvent::VariableAccess, t->getId(), nameId, type == AccessType::WRITE, static_cast<int>(state));
 
-    switch (state)
-    {
-    case State::Virgin:
-        if (type == AccessType::WRITE)
-        {
-            state = State::Initializing;
-        }
-        else
-        {
-            state = State::Exclusive;
-        }
-        break;
+    state = nextState(state, type);
 
-    case State::Initializing:
-        if (type == AccessType::WRITE)
-        {
-            state = State::SharedModified;
-        }
-        else
-        {
-            state = State::Shared;
-        }
-        break;
-
-    case State::Exclusive:
-        if (type == AccessType::WRITE)
-        {
-            state = State::SharedModified;
-        }
-        else if (type == AccessType::READ)
-        {
-            state = State::Shared;
-        }
-        break;
-
-    case State::Shared:
-        if (type == AccessType::WRITE)
-        {
-            state = State::SharedModified;
-        }
-        break;
-
-    case State::SharedModified:
-        // No state change for further accesses in SharedModified state
-        break;
-
-    default:
-        break;
-    }
-
-    std::cout << "State after access: " << SharedVariable::stateToString(state) << std::endl;
+    PolicyLogger<Policy>::log(LogEvent::StateAfterAccess, static_cast<int>(state));
 }
 
 std::string SharedVariable::getName() const
@@ -109,6 +150,11 @@ std::string SharedVariable::getName() const
     return name;
 }
 
+std::uint32_t SharedVariable::getNameId() const
+{
+    return nameId;
+}
+
 State SharedVariable::getState() const
 {
     return state;
@@ -165,49 +211,74 @@ std::string SharedVariable::stateToStringShort(State state)
     }
 }
 
-std::set<Lock *> &SharedVariable::getCandidateLocks()
+const Lockset *SharedVariable::getCandidateLocks() const
 {
-    return candidateLocks;
+    return candidate_locks;
+}
+
+const Lockset *SharedVariable::refineCandidateLocks(const Lockset *held)
+{
+    candidate_locks = candidate_locks ? LocksetTable::instance().intersect(candidate_locks, held) : held;
+    return candidate_locks;
 }
 
 void SharedVariable::addCandidateLock(Lock *lock)
 {
-    if (lock)
+    // An unset C(v) already holds every lock.
+    if (lock && candidate_locks)
     {
-        candidateLocks.insert(lock);
+        candidate_locks = LocksetTable::instance().withLock(candidate_locks, lock);
     }
 }
 
 void SharedVariable::removeCandidateLock(Lock *lock)
 {
-    if (lock)
+    if (lock && candidate_locks)
     {
-        candidateLocks.erase(lock);
+        candidate_locks = LocksetTable::instance().withoutLock(candidate_locks, lock);
     }
 }
 
 void SharedVariable::clearCandidateLocks()
 {
-    candidateLocks.clear();
+    candidate_locks = nullptr;
 }
 
 void SharedVariable::printCandidateLocks()
 {
+    // Keep this direct print ordered after any queued trace output.
+    Logger::flush();
     std::cout << "Candidate locks for variable " << name << ": ";
-    if (candidateLocks.empty())
+    if (!candidate_locks)
+    {
+        std::cout << "all";
+    }
+    else if (candidate_locks->empty())
     {
         std::cout << "none";
     }
     else
     {
-        for (auto it = candidateLocks.begin(); it != candidateLocks.end(); ++it)
+        const std::vector<std::uint32_t> &indices = candidate_locks->getIndices();
+        for (std::size_t i = 0; i < indices.size(); ++i)
         {
-            std::cout << (*it)->getId();
-            if (std::next(it) != candidateLocks.end())
+            Lock *lock = Lock::byDenseIndex(indices[i]);
+            if (lock)
+            {
+                std::cout << lock->getId();
+            }
+            else
+            {
+                std::cout << "?";
+            }
+            if (i + 1 != indices.size())
             {
                 std::cout << ", ";
             }
         }
     }
     std::cout << std::endl;
-}
\ No newline at end of file
+}
+
+template void SharedVariable::access<VerbosePolicy>(Thread *t, AccessType type);
+template void SharedVariable::access<ProductionPolicy>(Thread *t, AccessType type);
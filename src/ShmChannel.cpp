@@ -0,0 +1,583 @@
+/**
+ * @file ShmChannel.cpp
+ * @brief Implementation of the shared-memory event channel
+ */
+
+#include "../include/ShmChannel.h"
+#include "../include/TraceRecorder.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char kShmMagic[8] = {'L', 'S', 'S', 'H', 'M', '0', '1', '\0'};
+const std::uint32_t kShmVersion = 2;
+
+/// A producer blocked on a full ring checks the daemon after this many yields.
+const unsigned kYieldsPerLivenessCheck = 1024;
+
+std::string shmPath(const std::string &name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+std::string spillPath(const char *directory, std::uint32_t pid, std::uint32_t ring)
+{
+    char file[64];
+    std::snprintf(file, sizeof(file), "/spill-%u-%u.bin", pid, ring);
+    return std::string(directory) + file;
+}
+
+/// This process's view of a ring it has claimed.
+struct LocalRing
+{
+    std::uint32_t index;
+    ShmRing *ring;
+    TraceRecord *records;
+    std::uint64_t head;     ///< The daemon's head as last read
+    std::uint64_t tail;
+    bool closed;
+
+    std::FILE *spill;
+    std::uint64_t spillOffset;
+    std::uint64_t spillStart;
+    std::uint32_t spillCount;
+    bool spilling;
+};
+
+struct ProducerState
+{
+    std::mutex mutex;
+    ShmControl *ctl;
+    std::size_t mappedBytes;
+    Backpressure backpressure;
+    std::uint32_t capacity;
+    std::atomic<bool> attached;
+    std::atomic<std::uint64_t> session;
+    std::atomic<std::uint64_t> dropped;
+    std::vector<LocalRing *> rings;
+
+    ProducerState()
+        : ctl(nullptr), mappedBytes(0), backpressure(Backpressure::Block), capacity(0),
+          attached(false), session(0), dropped(0) {}
+
+    static ProducerState &instance()
+    {
+        // Leaked so that thread-exit handlers can still reach it.
+        static ProducerState *state = new ProducerState();
+        return *state;
+    }
+
+    /// Free slots in r. The daemon's head, on a cache line it keeps
+    /// writing, is only read again once the last value read leaves none.
+    std::uint64_t room(LocalRing &r) const
+    {
+        if (r.tail - r.head == capacity)
+        {
+            r.head = r.ring->head.load(std::memory_order_acquire);
+        }
+        return capacity - (r.tail - r.head);
+    }
+
+    std::uint64_t freshRoom(LocalRing &r) const
+    {
+        r.head = r.ring->head.load(std::memory_order_acquire);
+        return capacity - (r.tail - r.head);
+    }
+
+    /// Whether the daemon still runs. Needs the daemon in the same pid namespace.
+    bool daemonAlive() const
+    {
+        return !ctl->daemonExited.load(std::memory_order_acquire) &&
+               (::kill(static_cast<pid_t>(ctl->daemonPid), 0) == 0 || errno == EPERM);
+    }
+
+    /// Waits for a free slot in r. False if the daemon went away meanwhile;
+    /// the process then stops streaming.
+    bool waitForRoom(LocalRing &r)
+    {
+        for (unsigned yields = 1; room(r) == 0; ++yields)
+        {
+            if (yields % kYieldsPerLivenessCheck == 0 && !daemonAlive())
+            {
+                orphan();
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    /// Stops streaming after the daemon went away. The mapping and the
+    /// rings stay, since other threads may be in push; attach drops them.
+    void orphan()
+    {
+        if (attached.exchange(false, std::memory_order_acq_rel))
+        {
+            std::fprintf(stderr, "ShmChannel: lockset-daemon (pid %u) is gone, streaming stopped\n",
+                         ctl->daemonPid);
+        }
+    }
+
+    void store(LocalRing &r, const TraceRecord &rec)
+    {
+        r.records[r.tail & (capacity - 1)] = rec;
+        ++r.tail;
+        r.ring->tail.store(r.tail, std::memory_order_release);
+    }
+
+    LocalRing *claim()
+    {
+        for (std::uint32_t i = 0; i < ctl->ringCount; ++i)
+        {
+            ShmRing *ring = ctl->ring(i);
+            std::uint32_t expected = ShmRing::Free;
+            if (ring->state.compare_exchange_strong(expected, ShmRing::Active, std::memory_order_acq_rel))
+            {
+                LocalRing *r = new LocalRing();
+                r->index = i;
+                r->ring = ring;
+                r->records = ctl->records(ring);
+                r->head = ring->head.load(std::memory_order_acquire);
+                r->tail = ring->tail.load(std::memory_order_relaxed);
+                r->closed = false;
+                r->spill = nullptr;
+                r->spillOffset = 0;
+                r->spillStart = 0;
+                r->spillCount = 0;
+                r->spilling = false;
+                std::lock_guard<std::mutex> guard(mutex);
+                rings.push_back(r);
+                return r;
+            }
+        }
+        return nullptr;
+    }
+
+    bool spillRecord(LocalRing &r, const TraceRecord &rec)
+    {
+        if (!r.spill)
+        {
+            r.spill = std::fopen(spillPath(ctl->spillDirectory, static_cast<std::uint32_t>(::getpid()), r.index).c_str(), "wb");
+            if (!r.spill)
+            {
+                return false;
+            }
+        }
+        if (!r.spilling)
+        {
+            r.spilling = true;
+            r.spillStart = r.spillOffset;
+            r.spillCount = 0;
+        }
+        std::fwrite(&rec, sizeof(rec), 1, r.spill);
+        r.spillOffset += sizeof(rec);
+        ++r.spillCount;
+        return true;
+    }
+
+    /// Points the daemon at the records spilled since spilling began. Needs one free slot.
+    void endSpill(LocalRing &r)
+    {
+        std::fflush(r.spill);
+        TraceRecord marker;
+        std::memset(&marker, 0, sizeof(marker));
+        marker.kind = kShmSpillMarker;
+        marker.thread = static_cast<std::uint32_t>(::getpid());
+        marker.object = r.spillStart;
+        marker.extra = r.spillCount;
+        store(r, marker);
+        r.spilling = false;
+    }
+
+    void close(LocalRing &r)
+    {
+        if (r.closed)
+        {
+            return;
+        }
+        if (r.spilling && waitForRoom(r))
+        {
+            endSpill(r);
+        }
+        if (r.spill)
+        {
+            std::fclose(r.spill);
+            r.spill = nullptr;
+        }
+        r.closed = true;
+        r.ring->state.store(ShmRing::Closed, std::memory_order_release);
+    }
+};
+
+/// The calling thread's ring; closed when the thread exits.
+struct LocalHandle
+{
+    std::uint64_t session;
+    LocalRing *ring;
+
+    ~LocalHandle()
+    {
+        ProducerState &state = ProducerState::instance();
+        std::lock_guard<std::mutex> guard(state.mutex);
+        if (ring && state.attached.load(std::memory_order_acquire) &&
+            session == state.session.load(std::memory_order_relaxed))
+        {
+            state.close(*ring);
+        }
+    }
+};
+
+thread_local LocalHandle localHandle = {0, nullptr};
+
+} // namespace
+
+std::size_t ShmControl::ringBytes(std::uint32_t capacity)
+{
+    return sizeof(ShmRing) + static_cast<std::size_t>(capacity) * sizeof(TraceRecord);
+}
+
+std::size_t ShmControl::totalBytes(std::uint32_t rings, std::uint32_t capacity)
+{
+    return sizeof(ShmControl) + rings * ringBytes(capacity);
+}
+
+ShmRing *ShmControl::ring(std::uint32_t index)
+{
+    char *base = reinterpret_cast<char *>(this) + sizeof(ShmControl);
+    return reinterpret_cast<ShmRing *>(base + index * ringBytes(ringCapacity));
+}
+
+TraceRecord *ShmControl::records(ShmRing *ring)
+{
+    return reinterpret_cast<TraceRecord *>(ring + 1);
+}
+
+// ---------------------------------------------------------------------------
+// Producer
+// ---------------------------------------------------------------------------
+
+bool ShmChannel::attach(const std::string &name, int timeoutMs)
+{
+    ProducerState &state = ProducerState::instance();
+    if (state.attached.load(std::memory_order_acquire))
+    {
+        detach();
+    }
+    else if (state.ctl)
+    {
+        // Left behind by a daemon that went away (ProducerState::orphan).
+        std::lock_guard<std::mutex> guard(state.mutex);
+        state.rings.clear();
+        state.ctl = nullptr;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;)
+    {
+        int fd = ::shm_open(shmPath(name).c_str(), O_RDWR, 0);
+        struct stat st;
+        if (fd >= 0 && ::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(ShmControl)))
+        {
+            void *p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p != MAP_FAILED)
+            {
+                ShmControl *ctl = static_cast<ShmControl *>(p);
+                bool ready = std::memcmp(ctl->magic, kShmMagic, sizeof(kShmMagic)) == 0;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (ready && ctl->version == kShmVersion)
+                {
+                    std::lock_guard<std::mutex> guard(state.mutex);
+                    state.ctl = ctl;
+                    state.mappedBytes = static_cast<std::size_t>(st.st_size);
+                    state.backpressure = static_cast<Backpressure>(ctl->backpressure);
+                    state.capacity = ctl->ringCapacity;
+                    state.dropped.store(0, std::memory_order_relaxed);
+                    ctl->producers.fetch_add(1, std::memory_order_acq_rel);
+                    ctl->activeProducers.fetch_add(1, std::memory_order_acq_rel);
+                    state.session.fetch_add(1, std::memory_order_relaxed);
+                    state.attached.store(true, std::memory_order_release);
+                    return true;
+                }
+                munmap(p, static_cast<std::size_t>(st.st_size));
+            }
+        }
+        else if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+void ShmChannel::detach()
+{
+    ProducerState &state = ProducerState::instance();
+    std::lock_guard<std::mutex> guard(state.mutex);
+    if (!state.attached.exchange(false, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    for (LocalRing *r : state.rings)
+    {
+        state.close(*r);
+        delete r;
+    }
+    state.rings.clear();
+    state.ctl->activeProducers.fetch_sub(1, std::memory_order_acq_rel);
+    munmap(state.ctl, state.mappedBytes);
+    state.ctl = nullptr;
+}
+
+bool ShmChannel::attached()
+{
+    return ProducerState::instance().attached.load(std::memory_order_acquire);
+}
+
+void ShmChannel::push(TraceEventKind kind, std::uint32_t thread, std::uint64_t object,
+                      std::uint32_t extra, std::uint16_t flags)
+{
+    ProducerState &state = ProducerState::instance();
+    if (!state.attached.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    std::uint64_t session = state.session.load(std::memory_order_relaxed);
+    if (localHandle.session != session || !localHandle.ring)
+    {
+        localHandle.ring = state.claim();
+        localHandle.session = session;
+        if (!localHandle.ring)
+        {
+            // More streaming threads than rings.
+            state.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    LocalRing &r = *localHandle.ring;
+    TraceRecord rec;
+    rec.timestamp = TraceRecorder::now();
+    rec.object = object;
+    rec.thread = thread;
+    rec.extra = extra;
+    rec.kind = static_cast<std::uint16_t>(kind);
+    rec.flags = flags;
+    rec.reserved = 0;
+
+    if (r.spilling)
+    {
+        // Keep spilling until the daemon has caught up by half a ring, so
+        // markers do not fill the ring one record at a time.
+        if (state.freshRoom(r) < state.capacity / 2)
+        {
+            state.spillRecord(r, rec);
+            return;
+        }
+        state.endSpill(r);
+    }
+
+    if (state.room(r) == 0 && (state.backpressure != Backpressure::Block || !state.waitForRoom(r)))
+    {
+        if (state.backpressure == Backpressure::Spill && state.spillRecord(r, rec))
+        {
+            return;
+        }
+        // Dropped by choice, for want of a spill file, or because the
+        // daemon a blocked producer waited for is gone.
+        r.ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        state.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    state.store(r, rec);
+}
+
+void ShmChannel::publishName(std::uint32_t id, const std::string &name)
+{
+    ProducerState &state = ProducerState::instance();
+    std::lock_guard<std::mutex> guard(state.mutex);
+    if (!state.attached.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    ShmControl *ctl = state.ctl;
+    std::string line = std::to_string(id) + " " + name + "\n";
+
+    // Several producer processes may share the daemon; serialize appends.
+    while (ctl->namesLock.exchange(1, std::memory_order_acquire))
+    {
+        std::this_thread::yield();
+    }
+    std::uint32_t used = ctl->namesUsed.load(std::memory_order_relaxed);
+    if (used + line.size() <= sizeof(ctl->names))
+    {
+        std::memcpy(ctl->names + used, line.data(), line.size());
+        ctl->namesUsed.store(used + static_cast<std::uint32_t>(line.size()), std::memory_order_release);
+    }
+    ctl->namesLock.store(0, std::memory_order_release);
+}
+
+std::uint64_t ShmChannel::droppedRecords()
+{
+    return ProducerState::instance().dropped.load(std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Daemon
+// ---------------------------------------------------------------------------
+
+ShmChannelServer::ShmChannelServer() : ctl(nullptr), mappedBytes(0), namesParsed(0) {}
+
+ShmChannelServer::~ShmChannelServer()
+{
+    if (ctl)
+    {
+        // Producers still attached stop waiting for this process.
+        ctl->daemonExited.store(1, std::memory_order_release);
+        munmap(ctl, mappedBytes);
+        ::shm_unlink(shmName.c_str());
+    }
+}
+
+bool ShmChannelServer::create(const std::string &name, std::uint32_t rings, std::uint32_t capacity,
+                              Backpressure backpressure, const std::string &spillDirectory)
+{
+    if (rings == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        spillDirectory.size() >= sizeof(ctl->spillDirectory))
+    {
+        return false;
+    }
+    shmName = shmPath(name);
+    ::shm_unlink(shmName.c_str());
+    int fd = ::shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    mappedBytes = ShmControl::totalBytes(rings, capacity);
+    if (::ftruncate(fd, static_cast<off_t>(mappedBytes)) != 0)
+    {
+        ::close(fd);
+        ::shm_unlink(shmName.c_str());
+        return false;
+    }
+    void *p = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        ::shm_unlink(shmName.c_str());
+        return false;
+    }
+
+    // The object is zero-filled, which is a valid initial value for every
+    // atomic in it. Producers only use it once the magic is in place.
+    ctl = static_cast<ShmControl *>(p);
+    ctl->version = kShmVersion;
+    ctl->ringCount = rings;
+    ctl->ringCapacity = capacity;
+    ctl->backpressure = static_cast<std::uint32_t>(backpressure);
+    ctl->daemonPid = static_cast<std::uint32_t>(::getpid());
+    std::strncpy(ctl->spillDirectory, spillDirectory.c_str(), sizeof(ctl->spillDirectory) - 1);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(ctl->magic, kShmMagic, sizeof(kShmMagic));
+    return true;
+}
+
+std::size_t ShmChannelServer::drain(std::uint32_t index, std::deque<TraceRecord> &out, std::size_t max)
+{
+    ShmRing *ring = ctl->ring(index);
+    TraceRecord *records = ctl->records(ring);
+    std::uint32_t state = ring->state.load(std::memory_order_acquire);
+    std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    std::uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    std::size_t n = static_cast<std::size_t>(tail - head) < max ? static_cast<std::size_t>(tail - head) : max;
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const TraceRecord &rec = records[(head + i) & (ctl->ringCapacity - 1)];
+        if (rec.kind == kShmSpillMarker)
+        {
+            readSpill(rec, index, out);
+        }
+        else
+        {
+            out.push_back(rec);
+        }
+    }
+    ring->head.store(head + n, std::memory_order_release);
+
+    // A closed ring is handed out again once everything in it was consumed.
+    // The state was read before the tail, so no record can be left behind.
+    if (state == ShmRing::Closed && head + n == tail)
+    {
+        ring->state.store(ShmRing::Free, std::memory_order_release);
+    }
+    return n;
+}
+
+void ShmChannelServer::readSpill(const TraceRecord &marker, std::uint32_t index, std::deque<TraceRecord> &out)
+{
+    std::string path = spillPath(ctl->spillDirectory, marker.thread, index);
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f || std::fseek(f, static_cast<long>(marker.object), SEEK_SET) != 0)
+    {
+        std::fprintf(stderr, "lockset-daemon: lost %u spilled events (%s)\n", marker.extra, path.c_str());
+        if (f)
+        {
+            std::fclose(f);
+        }
+        return;
+    }
+    std::vector<TraceRecord> spilled(marker.extra);
+    std::size_t got = std::fread(spilled.data(), sizeof(TraceRecord), spilled.size(), f);
+    std::fclose(f);
+    out.insert(out.end(), spilled.begin(), spilled.begin() + got);
+}
+
+std::string ShmChannelServer::nameOf(std::uint32_t id)
+{
+    std::uint32_t used = ctl->namesUsed.load(std::memory_order_acquire);
+    while (namesParsed < used)
+    {
+        const char *line = ctl->names + namesParsed;
+        const char *end = static_cast<const char *>(std::memchr(line, '\n', used - namesParsed));
+        if (!end)
+        {
+            break;
+        }
+        const char *space = static_cast<const char *>(std::memchr(line, ' ', static_cast<std::size_t>(end - line)));
+        if (space)
+        {
+            names[static_cast<std::uint32_t>(std::strtoul(line, nullptr, 10))] = std::string(space + 1, end);
+        }
+        namesParsed += static_cast<std::uint32_t>(end - line + 1);
+    }
+    auto it = names.find(id);
+    return it != names.end() ? it->second : "#" + std::to_string(id);
+}
+
+std::uint64_t ShmChannelServer::droppedRecords() const
+{
+    std::uint64_t total = 0;
+    for (std::uint32_t i = 0; i < ctl->ringCount; ++i)
+    {
+        total += ctl->ring(i)->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
@@ -5,52 +5,91 @@
 
 #include "../include/Thread.h"
 #include "../include/Lock.h"
-#include <iostream>
+#include "../include/Logger.h"
+
+Thread::Thread(const Thread& other)
+    : id(other.id),
+      locksHeld(other.getLockset()),
+      writeLocksHeld(other.getWriteLockset()),
+      lastAcquire(other.lastAcquire),
+      lastRelease(other.lastRelease),
+      clockIndex(other.clockIndex),
+      clock(other.clock),
+      slot(ThreadSlotTable::kNoSlot),
+      ownedByDetector(false) {}
+
+Thread& Thread::operator=(const Thread& other) {
+    id = other.id;
+    locksHeld.store(other.getLockset(), std::memory_order_release);
+    writeLocksHeld.store(other.getWriteLockset(), std::memory_order_release);
+    clockIndex = other.clockIndex;
+    clock = other.clock;
+    return *this;
+}
 
 // Method implementations
 int Thread::getId() const {
     return id;
 }
 
-const std::set<Lock*>& Thread::getLockset() const {
-    return locksHeld;
+const Lockset* Thread::getLockset() const {
+    return locksHeld.load(std::memory_order_acquire);
 }
 
-const std::set<Lock*>& Thread::getWriteLockset() const {
-    return writeLocksHeld;
+const Lockset* Thread::getWriteLockset() const {
+    return writeLocksHeld.load(std::memory_order_acquire);
 }
 
+template <typename Policy>
 void Thread::acquireLock(Lock* lock, bool writeMode) {
-    if (!lock)
+    if (Policy::checkNullPointers && !lock)
     {
-        std::cerr << "Error: Null lock pointer passed to Thread::acquireLock" << std::endl;
+        PolicyLogger<Policy>::log(LogEvent::NullLockThreadAcquire);
         return;
     }
     
-    locksHeld.insert(lock);
+    // Only this thread writes its locksets, so a plain load/store suffices.
+    // While every lock is held in write mode the two sets are the same
+    // interned object, and one transition updates both.
+    const Lockset *held = getLockset();
+    const Lockset *writeHeld = getWriteLockset();
+    std::uint32_t index = lock->getDenseIndex();
+    if (lastAcquire.from != held || lastAcquire.lockIndex != index) {
+        lastAcquire = {held, index, LocksetTable::instance().withLock(held, lock)};
+    }
+    locksHeld.store(lastAcquire.to, std::memory_order_release);
     if (writeMode) {
-        writeLocksHeld.insert(lock);
+        writeLocksHeld.store(writeHeld == held ? lastAcquire.to : LocksetTable::instance().withLock(writeHeld, lock),
+                             std::memory_order_release);
     }
 
     // Optional logging of the event
-    std::cout << "Thread " << this->getId() << " acquired lock " << lock->getId();
-    if (writeMode) {
-        std::cout << " (Write Mode)" << std::endl;
-    } else {
-        std::cout << " (Read Mode)" << std::endl;
-    }
+    PolicyLogger<Policy>::log(LogEvent::ThreadLockAcquired, this->getId(), lock->getId(), writeMode);
 }
 
+template <typename Policy>
 void Thread::releaseLock(Lock* lock) {
-    if (!lock)
+    if (Policy::checkNullPointers && !lock)
     {
-        std::cerr << "Error: Null lock pointer passed to Thread::releaseLock" << std::endl;
+        PolicyLogger<Policy>::log(LogEvent::NullLockThreadRelease);
         return;
     }
     
-    locksHeld.erase(lock);
-    writeLocksHeld.erase(lock);
+    const Lockset *held = getLockset();
+    const Lockset *writeHeld = getWriteLockset();
+    std::uint32_t index = lock->getDenseIndex();
+    if (lastRelease.from != held || lastRelease.lockIndex != index) {
+        lastRelease = {held, index, LocksetTable::instance().withoutLock(held, lock)};
+    }
+    locksHeld.store(lastRelease.to, std::memory_order_release);
+    writeLocksHeld.store(writeHeld == held ? lastRelease.to : LocksetTable::instance().withoutLock(writeHeld, lock),
+                         std::memory_order_release);
 
     // Optional logging of the event
-    std::cout << "Thread " << this->getId() << " released lock " << lock->getId() << std::endl;
+    PolicyLogger<Policy>::log(LogEvent::ThreadLockReleased, this->getId(), lock->getId());
 }
+
+template void Thread::acquireLock<VerbosePolicy>(Lock* lock, bool writeMode);
+template void Thread::acquireLock<ProductionPolicy>(Lock* lock, bool writeMode);
+template void Thread::releaseLock<VerbosePolicy>(Lock* lock);
+template void Thread::releaseLock<ProductionPolicy>(Lock* lock);
@@ -0,0 +1,64 @@
+/**
+ * @file ThreadSlotTable.cpp
+ * @brief Implementation of the ThreadSlotTable
+ */
+
+#include "../include/ThreadSlotTable.h"
+
+ThreadSlotTable::ThreadSlotTable()
+{
+    clear();
+}
+
+std::uint32_t ThreadSlotTable::claim(Thread *t)
+{
+    for (std::uint32_t w = 0; w < kWords; ++w)
+    {
+        std::uint64_t bits = used[w].load(std::memory_order_relaxed);
+        while (bits != ~std::uint64_t(0))
+        {
+            std::uint32_t bit = static_cast<std::uint32_t>(__builtin_ctzll(~bits));
+            // On failure bits is reloaded and the next free bit is tried.
+            if (used[w].compare_exchange_weak(bits, bits | (std::uint64_t(1) << bit),
+                                              std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                std::uint32_t slot = w * 64 + bit;
+                slots[slot].store(t, std::memory_order_release);
+                return slot;
+            }
+        }
+    }
+    return kNoSlot;
+}
+
+void ThreadSlotTable::release(std::uint32_t slot)
+{
+    if (slot >= kCapacity)
+    {
+        return;
+    }
+    slots[slot].store(nullptr, std::memory_order_release);
+    used[slot / 64].fetch_and(~(std::uint64_t(1) << (slot % 64)), std::memory_order_acq_rel);
+}
+
+std::size_t ThreadSlotTable::size() const
+{
+    std::size_t n = 0;
+    for (std::uint32_t w = 0; w < kWords; ++w)
+    {
+        n += static_cast<std::size_t>(__builtin_popcountll(used[w].load(std::memory_order_relaxed)));
+    }
+    return n;
+}
+
+void ThreadSlotTable::clear()
+{
+    for (std::uint32_t w = 0; w < kWords; ++w)
+    {
+        used[w].store(0, std::memory_order_relaxed);
+    }
+    for (std::uint32_t i = 0; i < kCapacity; ++i)
+    {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,417 @@
+/**
+ * @file TraceRecorder.cpp
+ * @brief Implementation of the memory-mapped trace recorder
+ */
+
+#include "../include/TraceRecorder.h"
+#include "../include/Logger.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+
+const std::size_t kRecordsPerSegment =
+    (TraceRecorder::kSegmentBytes - sizeof(TraceSegmentHeader)) / sizeof(TraceRecord);
+
+#if defined(__x86_64__) || defined(__i386__)
+const TraceClock kClock = TraceClock::Tsc;
+
+inline std::uint64_t timestamp()
+{
+    return __rdtsc();
+}
+#else
+const TraceClock kClock = TraceClock::SteadyNanoseconds;
+
+inline std::uint64_t timestamp()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
+/// A mapped segment file; header is null if it could not be created.
+struct Segment
+{
+    int fd;
+    std::uint32_t number;
+    TraceSegmentHeader *header;
+};
+
+/**
+ * One recording thread's current segment, and the spare that replaces it
+ * when it is full. The spare is created by the preparer thread while the
+ * current segment fills; spareReady is guarded by RecorderState::jobsMutex.
+ */
+struct Writer
+{
+    std::uint32_t index;
+    Segment current;
+    TraceRecord *records;
+    std::size_t used;
+    Segment spare;
+    bool spareReady;
+
+    explicit Writer(std::uint32_t index)
+        : index(index), current{-1, 0, nullptr}, records(nullptr), used(0), spare{-1, 0, nullptr},
+          spareReady(false) {}
+};
+
+/// Preparer thread work: seal a full segment, or make a writer's spare.
+struct SegmentJob
+{
+    Writer *prepareFor;     ///< Null for a seal
+    Segment segment;        ///< To seal, or the number of the spare to make
+    std::size_t used;
+};
+
+struct RecorderState
+{
+    std::mutex writersMutex;
+    std::string directory;
+    std::vector<std::unique_ptr<Writer>> writers;
+    std::atomic<bool> active;
+    std::atomic<std::uint64_t> session;
+    std::atomic<std::uint64_t> dropped;
+
+    // Segment files are created and sealed off the recording threads.
+    std::mutex jobsMutex;
+    std::condition_variable jobsReady;
+    std::condition_variable spareMade;
+    std::deque<SegmentJob> jobs;
+    bool stopping;
+    std::thread preparer;
+
+    RecorderState() : active(false), session(0), dropped(0), stopping(false) {}
+
+    static RecorderState &instance()
+    {
+        // Leaked so that recording threads can outlive static destruction.
+        static RecorderState *state = new RecorderState();
+        return *state;
+    }
+
+    std::string segmentPath(std::uint32_t writer, std::uint32_t number) const
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "/thread-%u-%u.trace", writer, number);
+        return directory + name;
+    }
+
+    Segment openSegment(std::uint32_t writer, std::uint32_t number) const
+    {
+        Segment seg = {-1, number, nullptr};
+        seg.fd = ::open(segmentPath(writer, number).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (seg.fd < 0)
+        {
+            return seg;
+        }
+        if (::ftruncate(seg.fd, static_cast<off_t>(TraceRecorder::kSegmentBytes)) != 0)
+        {
+            ::close(seg.fd);
+            seg.fd = -1;
+            return seg;
+        }
+        void *p = mmap(nullptr, TraceRecorder::kSegmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, seg.fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(seg.fd);
+            seg.fd = -1;
+            return seg;
+        }
+
+        // Write to every page now: MAP_POPULATE maps shared file pages read
+        // only, and the recording thread would take a fault on each page.
+        char *bytes = static_cast<char *>(p);
+        for (std::size_t offset = 0; offset < TraceRecorder::kSegmentBytes; offset += 4096)
+        {
+            bytes[offset] = 0;
+        }
+
+        seg.header = static_cast<TraceSegmentHeader *>(p);
+        std::memcpy(seg.header->magic, kTraceMagic, sizeof(kTraceMagic));
+        seg.header->version = kTraceVersion;
+        seg.header->recordSize = sizeof(TraceRecord);
+        seg.header->writer = writer;
+        seg.header->segment = number;
+        seg.header->recordCount = 0;
+        seg.header->clock = static_cast<std::uint32_t>(kClock);
+        return seg;
+    }
+
+    void sealSegment(Segment &seg, std::size_t used)
+    {
+        if (!seg.header)
+        {
+            return;
+        }
+        seg.header->recordCount = used;
+        munmap(seg.header, TraceRecorder::kSegmentBytes);
+        // Drop the unused tail so short runs do not leave 4 MiB files behind.
+        if (::ftruncate(seg.fd, static_cast<off_t>(sizeof(TraceSegmentHeader) + used * sizeof(TraceRecord))) != 0)
+        {
+            // The file keeps its full size; readers still honour recordCount.
+        }
+        ::close(seg.fd);
+        seg.fd = -1;
+        seg.header = nullptr;
+    }
+
+    /// Removes a spare that was never used.
+    void discardSegment(std::uint32_t writer, Segment &seg)
+    {
+        if (!seg.header)
+        {
+            return;
+        }
+        munmap(seg.header, TraceRecorder::kSegmentBytes);
+        ::close(seg.fd);
+        ::unlink(segmentPath(writer, seg.number).c_str());
+        seg.fd = -1;
+        seg.header = nullptr;
+    }
+
+    void use(Writer &w, const Segment &seg)
+    {
+        w.current = seg;
+        w.records = seg.header ? reinterpret_cast<TraceRecord *>(seg.header + 1) : nullptr;
+        w.used = 0;
+    }
+
+    /// Replaces w's full segment with its spare and queues the seal of the
+    /// full one and the making of the next spare.
+    void nextSegment(Writer &w)
+    {
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            // The spare had a whole segment's worth of records to be made.
+            spareMade.wait(lock, [&w] { return w.spareReady; });
+            jobs.push_back(SegmentJob{nullptr, w.current, w.used});
+            jobs.push_back(SegmentJob{&w, Segment{-1, w.spare.number + 1, nullptr}, 0});
+            use(w, w.spare);
+            w.spareReady = false;
+        }
+        jobsReady.notify_one();
+    }
+
+    /// Preparer thread: runs jobs until stopping is set and none are left.
+    void prepare()
+    {
+        std::unique_lock<std::mutex> lock(jobsMutex);
+        for (;;)
+        {
+            jobsReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            SegmentJob job = jobs.front();
+            jobs.pop_front();
+            lock.unlock();
+            if (job.prepareFor)
+            {
+                Segment spare = openSegment(job.prepareFor->index, job.segment.number);
+                lock.lock();
+                job.prepareFor->spare = spare;
+                job.prepareFor->spareReady = true;
+                spareMade.notify_all();
+            }
+            else
+            {
+                sealSegment(job.segment, job.used);
+                lock.lock();
+            }
+        }
+    }
+
+    Writer *newWriter()
+    {
+        std::lock_guard<std::mutex> guard(writersMutex);
+        writers.emplace_back(new Writer(static_cast<std::uint32_t>(writers.size())));
+        Writer *w = writers.back().get();
+        use(*w, openSegment(w->index, 0));
+        {
+            std::lock_guard<std::mutex> jobsGuard(jobsMutex);
+            jobs.push_back(SegmentJob{w, Segment{-1, 1, nullptr}, 0});
+        }
+        jobsReady.notify_one();
+        return w;
+    }
+
+    void writeNames()
+    {
+        std::FILE *f = std::fopen((directory + "/names.txt").c_str(), "w");
+        if (!f)
+        {
+            return;
+        }
+        std::vector<std::string> names = Logger::internedNames();
+        for (std::size_t i = 0; i < names.size(); ++i)
+        {
+            if (!names[i].empty())
+            {
+                std::fprintf(f, "%zu %s\n", i, names[i].c_str());
+            }
+        }
+        std::fclose(f);
+    }
+};
+
+/// Removes segments left in directory by an earlier recording.
+void removeOldSegments(const std::string &directory)
+{
+    DIR *dir = ::opendir(directory.c_str());
+    if (!dir)
+    {
+        return;
+    }
+    while (dirent *entry = ::readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name.compare(0, 7, "thread-") == 0 && name.size() > 6 &&
+            name.compare(name.size() - 6, 6, ".trace") == 0)
+        {
+            ::unlink((directory + "/" + name).c_str());
+        }
+    }
+    ::closedir(dir);
+}
+
+/// The calling thread's writer for the session it was created in.
+struct LocalWriter
+{
+    std::uint64_t session;
+    Writer *writer;
+};
+
+thread_local LocalWriter localWriter = {0, nullptr};
+
+} // namespace
+
+bool TraceRecorder::start(const std::string &directory)
+{
+    RecorderState &state = RecorderState::instance();
+    if (state.active.load(std::memory_order_relaxed))
+    {
+        stop();
+    }
+    if (::mkdir(directory.c_str(), 0755) != 0)
+    {
+        struct stat st;
+        if (::stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            return false;
+        }
+    }
+    removeOldSegments(directory);
+
+    std::lock_guard<std::mutex> guard(state.writersMutex);
+    state.directory = directory;
+    state.stopping = false;
+    state.preparer = std::thread(&RecorderState::prepare, &state);
+    state.dropped.store(0, std::memory_order_relaxed);
+    state.session.fetch_add(1, std::memory_order_relaxed);
+    state.active.store(true, std::memory_order_release);
+    return true;
+}
+
+void TraceRecorder::stop()
+{
+    RecorderState &state = RecorderState::instance();
+    if (!state.active.exchange(false, std::memory_order_acq_rel))
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(state.jobsMutex);
+        state.stopping = true;
+    }
+    state.jobsReady.notify_one();
+    state.preparer.join();
+
+    std::lock_guard<std::mutex> guard(state.writersMutex);
+    for (auto &w : state.writers)
+    {
+        state.sealSegment(w->current, w->used);
+        if (w->spareReady)
+        {
+            state.discardSegment(w->index, w->spare);
+        }
+    }
+    state.writers.clear();
+    state.writeNames();
+}
+
+bool TraceRecorder::active()
+{
+    return RecorderState::instance().active.load(std::memory_order_acquire);
+}
+
+void TraceRecorder::record(TraceEventKind kind, std::uint32_t thread, std::uint64_t object,
+                           std::uint32_t extra, std::uint16_t flags)
+{
+    RecorderState &state = RecorderState::instance();
+    if (!state.active.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    std::uint64_t session = state.session.load(std::memory_order_relaxed);
+    if (localWriter.session != session || !localWriter.writer)
+    {
+        localWriter.writer = state.newWriter();
+        localWriter.session = session;
+    }
+
+    Writer &w = *localWriter.writer;
+    if (w.used == kRecordsPerSegment)
+    {
+        state.nextSegment(w);
+    }
+    if (!w.records)
+    {
+        state.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceRecord &r = w.records[w.used++];
+    r.timestamp = timestamp();
+    r.object = object;
+    r.thread = thread;
+    r.extra = extra;
+    r.kind = static_cast<std::uint16_t>(kind);
+    r.flags = flags;
+    r.reserved = 0;
+}
+
+std::uint64_t TraceRecorder::droppedRecords()
+{
+    return RecorderState::instance().dropped.load(std::memory_order_relaxed);
+}
+
+std::uint64_t TraceRecorder::now()
+{
+    return timestamp();
+}
+
+TraceClock TraceRecorder::clock()
+{
+    return kClock;
+}
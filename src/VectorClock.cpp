@@ -0,0 +1,102 @@
+/**
+ * @file VectorClock.cpp
+ * @brief Implementation of VectorClock and VariableClock
+ */
+
+#include "../include/VectorClock.h"
+#include <algorithm>
+
+void VectorClock::set(std::uint32_t index, std::uint64_t clock)
+{
+    if (index >= clocks.size())
+    {
+        clocks.resize(index + 1, 0);
+    }
+    clocks[index] = clock;
+}
+
+void VectorClock::join(const VectorClock &other)
+{
+    if (other.clocks.size() > clocks.size())
+    {
+        clocks.resize(other.clocks.size(), 0);
+    }
+    for (std::size_t i = 0; i < other.clocks.size(); ++i)
+    {
+        clocks[i] = std::max(clocks[i], other.clocks[i]);
+    }
+}
+
+bool VectorClock::covers(const VectorClock &other) const
+{
+    for (std::size_t i = 0; i < other.clocks.size(); ++i)
+    {
+        if (other.clocks[i] > get(static_cast<std::uint32_t>(i)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VariableClock::read(const VectorClock &clock, std::uint32_t index)
+{
+    Epoch now = clock.epochOf(index);
+
+    // Same epoch: this thread read it since its last release; nothing new.
+    if (readers ? readers->get(index) == epochClock(now) : readEpoch == now)
+    {
+        return false;
+    }
+
+    bool race = !clock.covers(writeEpoch);
+
+    if (readers)
+    {
+        readers->set(index, epochClock(now));
+    }
+    else if (clock.covers(readEpoch))
+    {
+        readEpoch = now;
+    }
+    else
+    {
+        // Two unordered readers: switch to a full read clock.
+        readers.reset(new VectorClock);
+        readers->set(epochIndex(readEpoch), epochClock(readEpoch));
+        readers->set(index, epochClock(now));
+    }
+    return race;
+}
+
+bool VariableClock::write(const VectorClock &clock, std::uint32_t index)
+{
+    Epoch now = clock.epochOf(index);
+    if (writeEpoch == now)
+    {
+        return false;
+    }
+
+    bool race = !clock.covers(writeEpoch);
+    if (readers)
+    {
+        // Every read is ordered before this write once it is checked, so
+        // the next read starts over from a single epoch.
+        race = !clock.covers(*readers) || race;
+        readers.reset();
+        readEpoch = kNoEpoch;
+    }
+    else
+    {
+        race = !clock.covers(readEpoch) || race;
+    }
+    writeEpoch = now;
+    return race;
+}
+
+void VariableClock::reset()
+{
+    writeEpoch = kNoEpoch;
+    readEpoch = kNoEpoch;
+    readers.reset();
+}
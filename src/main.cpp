@@ -15,6 +15,7 @@
 #include "../include/Thread.h"
 #include "../include/Accesstype.h"
 #include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
 
 void threadFunctionCorrect(int threadId, DataRaceDetector* drd, Lock* lock1, SharedVariable* var1)
 {
@@ -71,6 +72,7 @@ int main()
     t1.join();
     t2.join();
     auto end1 = std::chrono::high_resolution_clock::now();
+    Logger::flush();
     std::chrono::duration<double> elapsed1 = end1 - start1;
     std::cout << "Scenario 1 execution time: " << elapsed1.count() << " seconds\n";
 
@@ -85,6 +87,7 @@ int main()
     t3.join();
     t4.join();
     auto end2 = std::chrono::high_resolution_clock::now();
+    Logger::flush();
     std::chrono::duration<double> elapsed2 = end2 - start2;
     std::cout << "Scenario 2 execution time: " << elapsed2.count() << " seconds\n";
 
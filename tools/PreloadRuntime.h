@@ -0,0 +1,129 @@
+/**
+ * @file PreloadRuntime.h
+ * @brief State shared by the files of liblockset_preload.so and liblockset_tsan.so
+ *
+ * Internal to the two libraries (see lockset_preload.cpp). The process-wide
+ * detector, the lock and barrier maps and the calling thread's state are
+ * defined in lockset_preload.cpp; the per-call helpers are inline here so
+ * that the TSan entry points in lockset_tsan.cpp get the same fast path as
+ * the pthread wrappers.
+ */
+
+#ifndef PRELOADRUNTIME_H
+#define PRELOADRUNTIME_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <pthread.h>
+#include "../include/AddressMap.h"
+#include "../include/DataRaceDetector.h"
+
+// The libraries are built with hidden visibility; only these symbols interpose.
+#define LOCKSET_EXPORT __attribute__((visibility("default")))
+
+namespace lockset_preload
+{
+
+typedef BasicDataRaceDetector<ProductionPolicy> Detector;
+
+/// Initial capacities of the lock and barrier maps, which grow on demand.
+const std::size_t kInitialLocks = std::size_t(1) << 16;
+const std::size_t kInitialBarriers = 1024;
+
+/// Arrivals of one interposed barrier.
+struct BarrierState
+{
+    std::atomic<unsigned> count;
+    std::atomic<unsigned> arrivals;
+};
+
+/**
+ * Everything the library owns. Constructed once into static storage and
+ * never destroyed: other libraries' threads and destructors may still
+ * lock mutexes while the process exits.
+ */
+struct Preload
+{
+    Detector detector;
+    AddressMap<Lock> locks;
+    AddressMap<BarrierState> barriers;
+    std::atomic<int> nextThreadId;
+    std::atomic<int> nextLockId;
+    /// Set once the map is full and the first untracked object is reported.
+    std::atomic<bool> locksFull;
+    std::atomic<bool> barriersFull;
+    bool hybrid;
+    std::mutex childrenMutex;
+    std::unordered_map<pthread_t, int> children;
+
+    Preload()
+        : locks(kInitialLocks), barriers(kInitialBarriers), nextThreadId(1), nextLockId(1), locksFull(false),
+          barriersFull(false), hybrid(false)
+    {
+    }
+};
+
+enum InitState
+{
+    Uninitialized,
+    Initializing,
+    Ready
+};
+
+extern std::atomic<int> initState;
+extern unsigned char storage[];
+
+inline Preload &preload()
+{
+    return *reinterpret_cast<Preload *>(storage);
+}
+
+/**
+ * Per-thread state. inside is set while the library runs on the thread,
+ * and for good on threads the library starts or that have exited.
+ */
+struct PreloadThread
+{
+    Thread *thread;
+    bool inside;
+};
+
+extern __thread PreloadThread self __attribute__((tls_model("initial-exec")));
+
+/// Marks the calling thread as inside the library for the enclosing scope.
+class Inside
+{
+public:
+    Inside() : was(self.inside) { self.inside = true; }
+    ~Inside() { self.inside = was; }
+
+private:
+    bool was;
+};
+
+/// Constructs the detector and registers the calling thread; idempotent.
+void initialize();
+
+/// Registers the calling thread under id.
+Thread *attach(int id);
+
+/// The calling thread's Thread, registered on its first event; nullptr
+/// while the library is not ready or is running on this thread.
+inline Thread *caller()
+{
+    if (self.inside || initState.load(std::memory_order_acquire) != Ready)
+    {
+        return nullptr;
+    }
+    if (!self.thread)
+    {
+        Inside guard;
+        attach(preload().nextThreadId.fetch_add(1, std::memory_order_relaxed));
+    }
+    return self.thread;
+}
+
+} // namespace lockset_preload
+
+#endif // PRELOADRUNTIME_H
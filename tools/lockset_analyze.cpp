@@ -0,0 +1,943 @@
+/**
+ * @file lockset_analyze.cpp
+ * @brief Offline race analysis of a trace recorded in DetectorMode::Record
+ *
+ * The per-thread segment streams are merged by timestamp and consumed in
+ * chunks, so memory use is bounded by the chunk size rather than the trace
+ * size. For every chunk a sequential pass tracks lock ownership and each
+ * thread's lockset and routes variable and memory events, tagged with the
+ * lockset held, into shards by variable hash. The shards are then replayed
+ * in parallel on a work-stealing pool: every shard owns the state of its
+ * variables outright, including their candidate sets C(v), which it interns
+ * itself, and the lockset recorded at each variable's last access. Variables
+ * are refined and retired as the online
+ * detector does with retirement on (its default). Reports are sorted back
+ * into trace order and printed in the same format as the online detector.
+ *
+ * Usage: lockset-analyze [-j threads] [-c chunk-events] <trace-dir>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/TraceFormat.h"
+#include "../include/SharedVariable.h"
+#include "../include/RaceTable.h"
+#include "../include/ShadowMemory.h"
+
+namespace
+{
+
+// ---------------------------------------------------------------------------
+// Trace input
+// ---------------------------------------------------------------------------
+
+/// Sequential reader over one writer's segments, mapping one segment at a time.
+class SegmentStream
+{
+public:
+    explicit SegmentStream(std::vector<std::string> paths)
+        : paths(std::move(paths)), next(0), base(nullptr), mappedBytes(0), records(nullptr), count(0), pos(0)
+    {
+        advance();
+    }
+
+    ~SegmentStream() { unmap(); }
+
+    bool done() const { return !records; }
+    const TraceRecord &peek() const { return records[pos]; }
+
+    void pop()
+    {
+        if (++pos == count)
+        {
+            advance();
+        }
+    }
+
+private:
+    void unmap()
+    {
+        if (base)
+        {
+            munmap(base, mappedBytes);
+            base = nullptr;
+        }
+        records = nullptr;
+    }
+
+    void advance()
+    {
+        unmap();
+        while (next < paths.size())
+        {
+            const std::string &path = paths[next++];
+            int fd = ::open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || ::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(TraceSegmentHeader)))
+            {
+                std::fprintf(stderr, "lockset-analyze: cannot read %s\n", path.c_str());
+                std::exit(1);
+            }
+            mappedBytes = static_cast<std::size_t>(st.st_size);
+            base = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED)
+            {
+                std::fprintf(stderr, "lockset-analyze: cannot map %s\n", path.c_str());
+                std::exit(1);
+            }
+            madvise(base, mappedBytes, MADV_SEQUENTIAL);
+
+            const TraceSegmentHeader *header = static_cast<const TraceSegmentHeader *>(base);
+            if (std::memcmp(header->magic, kTraceMagic, sizeof(kTraceMagic)) != 0 ||
+                header->version != kTraceVersion || header->recordSize != sizeof(TraceRecord))
+            {
+                std::fprintf(stderr, "lockset-analyze: %s is not a version %u trace segment\n",
+                             path.c_str(), kTraceVersion);
+                std::exit(1);
+            }
+
+            // Unsealed segments have no count; they end at the first End record.
+            std::size_t capacity = (mappedBytes - sizeof(TraceSegmentHeader)) / sizeof(TraceRecord);
+            records = reinterpret_cast<const TraceRecord *>(header + 1);
+            count = header->recordCount ? std::min<std::size_t>(header->recordCount, capacity) : capacity;
+            std::size_t valid = 0;
+            while (valid < count && records[valid].kind != static_cast<std::uint16_t>(TraceEventKind::End))
+            {
+                ++valid;
+            }
+            count = valid;
+            pos = 0;
+            if (count > 0)
+            {
+                return;
+            }
+            unmap();
+        }
+    }
+
+    std::vector<std::string> paths;
+    std::size_t next;
+    void *base;
+    std::size_t mappedBytes;
+    const TraceRecord *records;
+    std::size_t count;
+    std::size_t pos;
+};
+
+/// k-way merge of all writer streams by timestamp.
+class TraceMerger
+{
+public:
+    explicit TraceMerger(const std::string &directory)
+    {
+        std::map<std::uint32_t, std::map<std::uint32_t, std::string>> byWriter;
+        DIR *dir = ::opendir(directory.c_str());
+        if (!dir)
+        {
+            std::fprintf(stderr, "lockset-analyze: cannot open %s\n", directory.c_str());
+            std::exit(1);
+        }
+        while (dirent *entry = ::readdir(dir))
+        {
+            unsigned writer = 0;
+            unsigned segment = 0;
+            char suffix[8] = {0};
+            if (std::sscanf(entry->d_name, "thread-%u-%u.%7s", &writer, &segment, suffix) == 3 &&
+                std::strcmp(suffix, "trace") == 0)
+            {
+                byWriter[writer][segment] = directory + "/" + entry->d_name;
+            }
+        }
+        ::closedir(dir);
+
+        for (auto &w : byWriter)
+        {
+            std::vector<std::string> paths;
+            for (auto &s : w.second)
+            {
+                paths.push_back(s.second);
+            }
+            streams.emplace_back(new SegmentStream(std::move(paths)));
+            if (!streams.back()->done())
+            {
+                heap.push(Head{streams.back()->peek().timestamp, streams.size() - 1});
+            }
+        }
+    }
+
+    std::size_t writerCount() const { return streams.size(); }
+
+    bool next(TraceRecord &out)
+    {
+        if (heap.empty())
+        {
+            return false;
+        }
+        Head h = heap.top();
+        heap.pop();
+        SegmentStream &s = *streams[h.stream];
+        out = s.peek();
+        s.pop();
+        if (!s.done())
+        {
+            heap.push(Head{s.peek().timestamp, h.stream});
+        }
+        return true;
+    }
+
+private:
+    struct Head
+    {
+        std::uint64_t timestamp;
+        std::size_t stream;
+
+        bool operator<(const Head &other) const
+        {
+            // Earliest first; ties go to the lower writer for a stable order.
+            return timestamp != other.timestamp ? timestamp > other.timestamp : stream > other.stream;
+        }
+    };
+
+    std::vector<std::unique_ptr<SegmentStream>> streams;
+    std::priority_queue<Head> heap;
+};
+
+std::unordered_map<std::uint32_t, std::string> readNames(const std::string &directory)
+{
+    std::unordered_map<std::uint32_t, std::string> names;
+    std::ifstream in(directory + "/names.txt");
+    std::uint32_t id;
+    std::string name;
+    while (in >> id && std::getline(in >> std::ws, name))
+    {
+        names[id] = name;
+    }
+    return names;
+}
+
+// ---------------------------------------------------------------------------
+// Locksets
+// ---------------------------------------------------------------------------
+
+/// Interns locksets of lock ids. Only the sequential pass adds sets; the
+/// parallel replay only reads them.
+class LocksetInterner
+{
+public:
+    LocksetInterner()
+    {
+        sets.push_back(std::vector<std::uint64_t>());
+        ids[sets[0]] = 0;
+    }
+
+    std::uint32_t with(std::uint32_t set, std::uint64_t lock)
+    {
+        return transition(set, lock, true);
+    }
+
+    std::uint32_t without(std::uint32_t set, std::uint64_t lock)
+    {
+        return transition(set, lock, false);
+    }
+
+    const std::vector<std::uint64_t> &locksOf(std::uint32_t set) const { return sets[set]; }
+
+    std::uint32_t intern(const std::vector<std::uint64_t> &locks)
+    {
+        auto inserted = ids.insert(std::make_pair(locks, static_cast<std::uint32_t>(sets.size())));
+        if (inserted.second)
+        {
+            sets.push_back(locks);
+        }
+        return inserted.first->second;
+    }
+
+    bool intersect(std::uint32_t a, std::uint32_t b) const
+    {
+        const std::vector<std::uint64_t> &x = sets[a];
+        const std::vector<std::uint64_t> &y = sets[b];
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while (i < x.size() && j < y.size())
+        {
+            if (x[i] < y[j])
+            {
+                ++i;
+            }
+            else if (y[j] < x[i])
+            {
+                ++j;
+            }
+            else
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::uint32_t transition(std::uint32_t set, std::uint64_t lock, bool add)
+    {
+        std::uint64_t key = (lock << 33) ^ (static_cast<std::uint64_t>(set) << 1) ^ add;
+        auto cached = transitions.find(key);
+        if (cached != transitions.end())
+        {
+            return cached->second;
+        }
+        std::vector<std::uint64_t> locks = sets[set];
+        auto it = std::lower_bound(locks.begin(), locks.end(), lock);
+        bool present = it != locks.end() && *it == lock;
+        if (add && !present)
+        {
+            locks.insert(it, lock);
+        }
+        else if (!add && present)
+        {
+            locks.erase(it);
+        }
+        std::uint32_t id = intern(locks);
+        transitions[key] = id;
+        return id;
+    }
+
+    std::deque<std::vector<std::uint64_t>> sets;
+    std::map<std::vector<std::uint64_t>, std::uint32_t> ids;
+    std::unordered_map<std::uint64_t, std::uint32_t> transitions;
+};
+
+// ---------------------------------------------------------------------------
+// Work-stealing pool
+// ---------------------------------------------------------------------------
+
+/// Fixed set of workers, each with its own task deque. A worker pops from
+/// the back of its own deque and steals from the front of the others'.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(unsigned workers)
+        : queues(workers), generation(0), pending(0), stopping(false)
+    {
+        for (unsigned i = 0; i < workers; ++i)
+        {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+    }
+
+    /// Runs every task and returns when all have finished.
+    void run(std::vector<std::function<void()>> &tasks)
+    {
+        if (tasks.empty())
+        {
+            return;
+        }
+        pending.store(tasks.size(), std::memory_order_relaxed);
+        for (std::size_t i = 0; i < tasks.size(); ++i)
+        {
+            Queue &q = queues[i % queues.size()];
+            std::lock_guard<std::mutex> guard(q.mutex);
+            q.tasks.push_back(&tasks[i]);
+        }
+        {
+            std::lock_guard<std::mutex> guard(wakeMutex);
+            ++generation;
+        }
+        wake.notify_all();
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        finished.wait(lock, [this]() { return pending.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()> *> tasks;
+    };
+
+    std::function<void()> *take(unsigned self)
+    {
+        {
+            Queue &own = queues[self];
+            std::lock_guard<std::mutex> guard(own.mutex);
+            if (!own.tasks.empty())
+            {
+                std::function<void()> *task = own.tasks.back();
+                own.tasks.pop_back();
+                return task;
+            }
+        }
+        for (std::size_t i = 1; i < queues.size(); ++i)
+        {
+            Queue &victim = queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                std::function<void()> *task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void workerLoop(unsigned self)
+    {
+        std::uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait(lock, [&]() { return stopping || generation != seen; });
+                if (stopping)
+                {
+                    return;
+                }
+                seen = generation;
+            }
+            while (std::function<void()> *task = take(self))
+            {
+                (*task)();
+                if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    std::lock_guard<std::mutex> guard(wakeMutex);
+                    finished.notify_all();
+                }
+            }
+        }
+    }
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> threads;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::uint64_t generation;
+    std::atomic<std::size_t> pending;
+    bool stopping;
+};
+
+// ---------------------------------------------------------------------------
+// Replay
+// ---------------------------------------------------------------------------
+
+enum class Op : std::uint8_t
+{
+    VariableAccess,
+    VariableRelease,
+    MemoryAccess
+};
+
+/// One event routed to a shard. key is a variable name id or a granule.
+struct ShardEvent
+{
+    std::uint64_t seq;
+    std::uint64_t key;
+    std::uint64_t address;
+    std::uint32_t thread;
+    std::uint32_t lockset;
+    Op op;
+    bool write;
+};
+
+/// C(v) of a variable no access has refined yet: every lock.
+const std::uint32_t kAllLocks = 0xFFFFFFFFu;
+
+struct VariableState
+{
+    bool accessed;
+    bool retired;
+    std::uint32_t accessingThread;
+    std::uint32_t accessingLockset;   ///< Lockset held at the last access
+    std::uint32_t candidates;   ///< C(v) in the shard's interner, or kAllLocks
+    State state;
+
+    VariableState()
+        : accessed(false), retired(false), accessingThread(0), accessingLockset(0), candidates(kAllLocks),
+          state(State::Virgin)
+    {
+    }
+};
+
+struct CellState
+{
+    bool accessed;
+    std::uint32_t owner;
+    std::uint32_t lockset;
+    State state;
+
+    CellState() : accessed(false), owner(0), lockset(0), state(State::Virgin) {}
+};
+
+struct Report
+{
+    std::uint64_t seq;
+    std::uint32_t thread;
+    std::uint32_t other;
+    bool memory;
+    std::uint64_t object;
+    std::uint64_t key;
+    std::uint32_t lockset;
+    std::uint32_t otherLockset;
+    bool write;
+    State state;
+
+    bool operator<(const Report &r) const { return seq != r.seq ? seq < r.seq : key < r.key; }
+};
+
+/// Variables and granules are owned by exactly one shard, so the replay of a
+/// shard needs no synchronization.
+struct Shard
+{
+    std::vector<ShardEvent> events;
+    std::unordered_map<std::uint64_t, VariableState> variables;
+    std::unordered_map<std::uint64_t, CellState> cells;
+    std::vector<Report> reports;
+    /// Candidate sets of this shard's variables; C(v) ∩ held is memoized
+    /// by (C(v), held), held being an id of the analyzer's interner.
+    LocksetInterner candidateSets;
+    std::unordered_map<std::uint64_t, std::uint32_t> refinements;
+
+    void replay(const LocksetInterner &locksets)
+    {
+        for (const ShardEvent &e : events)
+        {
+            switch (e.op)
+            {
+            case Op::VariableAccess:
+                access(e, locksets);
+                break;
+            case Op::VariableRelease:
+                release(e);
+                break;
+            case Op::MemoryAccess:
+                accessCell(e, locksets);
+                break;
+            }
+        }
+        events.clear();
+    }
+
+    /// C(v) = C(v) ∩ held (SharedVariable::refineCandidateLocks).
+    std::uint32_t refine(VariableState &v, std::uint32_t held, const LocksetInterner &locksets)
+    {
+        std::uint64_t key = (static_cast<std::uint64_t>(v.candidates) << 32) | held;
+        auto cached = refinements.find(key);
+        if (cached != refinements.end())
+        {
+            return v.candidates = cached->second;
+        }
+        const std::vector<std::uint64_t> &locks = locksets.locksOf(held);
+        std::vector<std::uint64_t> result;
+        if (v.candidates == kAllLocks)
+        {
+            result = locks;
+        }
+        else
+        {
+            const std::vector<std::uint64_t> &current = candidateSets.locksOf(v.candidates);
+            std::set_intersection(current.begin(), current.end(), locks.begin(), locks.end(),
+                                  std::back_inserter(result));
+        }
+        std::uint32_t id = candidateSets.intern(result);
+        refinements[key] = id;
+        return v.candidates = id;
+    }
+
+    // Mirrors BasicDataRaceDetector::onSharedVariableAccess and analyzeAccess.
+    void access(const ShardEvent &e, const LocksetInterner &locksets)
+    {
+        VariableState &v = variables[e.key];
+        if (v.retired)
+        {
+            return;
+        }
+        AccessType type = e.write ? AccessType::WRITE : AccessType::READ;
+        bool shared = v.state == State::Shared || v.state == State::SharedModified;
+        std::uint32_t candidates = shared ? refine(v, e.lockset, locksets) : kAllLocks;
+        bool raced = false;
+        if (v.accessed && v.accessingThread != e.thread)
+        {
+            std::uint32_t otherLockset = v.accessingLockset;
+            // Until v is shared, the previous owner's locks stand in for C(v).
+            bool commonLocks = shared ? !candidateSets.locksOf(candidates).empty()
+                                      : locksets.intersect(otherLockset, e.lockset);
+            if (!shared)
+            {
+                refine(v, otherLockset, locksets);
+                candidates = refine(v, e.lockset, locksets);
+            }
+            if (isConflictingAccess(v.state, type) && !commonLocks)
+            {
+                raced = true;
+                reports.push_back(Report{e.seq, e.thread, v.accessingThread, false, e.key, e.key,
+                                         e.lockset, otherLockset, e.write, v.state});
+            }
+        }
+        if (raced && candidates != kAllLocks && candidateSets.locksOf(candidates).empty())
+        {
+            // Every later access would only repeat the report.
+            v.retired = true;
+        }
+        v.accessed = true;
+        v.accessingThread = e.thread;
+        v.accessingLockset = e.lockset;
+        v.state = nextState(v.state, type);
+    }
+
+    // Mirrors the variable transition in BasicDataRaceDetector::onLockRelease.
+    void release(const ShardEvent &e)
+    {
+        VariableState &v = variables[e.key];
+        if (v.state == State::Exclusive)
+        {
+            v.state = State::Virgin;
+        }
+        else if (v.state == State::SharedModified)
+        {
+            v.state = State::Shared;
+        }
+        if (v.accessingThread == e.thread)
+        {
+            v.accessed = false;
+        }
+    }
+
+    // Mirrors BasicDataRaceDetector::accessCell.
+    void accessCell(const ShardEvent &e, const LocksetInterner &locksets)
+    {
+        CellState &c = cells[e.key];
+        AccessType type = e.write ? AccessType::WRITE : AccessType::READ;
+        if (c.accessed && c.owner != e.thread && isConflictingAccess(c.state, type) &&
+            !locksets.intersect(c.lockset, e.lockset))
+        {
+            reports.push_back(Report{e.seq, e.thread, c.owner, true, e.address, e.key,
+                                     e.lockset, c.lockset, e.write, c.state});
+        }
+        c.accessed = true;
+        c.owner = e.thread;
+        c.lockset = e.lockset;
+        c.state = nextState(c.state, type);
+    }
+};
+
+class Analyzer
+{
+public:
+    Analyzer(unsigned workers, std::size_t chunkEvents,
+             const std::unordered_map<std::uint32_t, std::string> &names)
+        : pool(workers), shards(workers * 8), chunkEvents(chunkEvents), seq(0), numRaces(0), numOccurrences(0),
+          names(names), raceTable(std::size_t(1) << 16)
+    {
+    }
+
+    void run(TraceMerger &merger)
+    {
+        std::size_t inChunk = 0;
+        TraceRecord r;
+        while (merger.next(r))
+        {
+            ++seq;
+            TraceEventKind kind = static_cast<TraceEventKind>(r.kind);
+            if (kind == TraceEventKind::BarrierReset || kind == TraceEventKind::MainStart)
+            {
+                // Resets touch every variable: finish the chunk, then apply them.
+                flushChunk();
+                inChunk = 0;
+                resetAll(kind == TraceEventKind::MainStart);
+                continue;
+            }
+            dispatch(r);
+            if (++inChunk == chunkEvents)
+            {
+                flushChunk();
+                inChunk = 0;
+            }
+        }
+        flushChunk();
+    }
+
+    std::uint64_t events() const { return seq; }
+    std::uint64_t races() const { return numRaces; }
+    std::uint64_t occurrences() const { return numOccurrences; }
+
+private:
+    Shard &shardFor(std::uint64_t key)
+    {
+        return shards[(key * 0x9E3779B97F4A7C15ull >> 32) % shards.size()];
+    }
+
+    std::uint32_t &heldBy(std::uint32_t thread)
+    {
+        return locksetOf.insert(std::make_pair(thread, 0u)).first->second;
+    }
+
+    /// Locks thread holds in write mode.
+    std::uint32_t &writeHeldBy(std::uint32_t thread)
+    {
+        return writeLocksetOf.insert(std::make_pair(thread, 0u)).first->second;
+    }
+
+    /// The locks that protect an access: a write counts only locks held in
+    /// write mode (BasicDataRaceDetector::locksetFor).
+    std::uint32_t protecting(const TraceRecord &r)
+    {
+        return (r.flags & 1) ? writeHeldBy(r.thread) : heldBy(r.thread);
+    }
+
+    void dispatch(const TraceRecord &r)
+    {
+        switch (static_cast<TraceEventKind>(r.kind))
+        {
+        case TraceEventKind::VariableRegister:
+            registered.insert(r.object);
+            break;
+
+        case TraceEventKind::LockAcquire:
+        {
+            holder[r.object] = r.thread;
+            std::uint32_t &held = heldBy(r.thread);
+            held = locksets.with(held, r.object);
+            if (r.flags & 1)
+            {
+                std::uint32_t &writeHeld = writeHeldBy(r.thread);
+                writeHeld = locksets.with(writeHeld, r.object);
+            }
+            break;
+        }
+
+        case TraceEventKind::LockRelease:
+        {
+            auto h = holder.find(r.object);
+            if (h == holder.end() || h->second != r.thread)
+            {
+                break; // the online detector rejects releases by non-owners
+            }
+            holder.erase(h);
+            std::uint32_t &held = heldBy(r.thread);
+            held = locksets.without(held, r.object);
+            std::uint32_t &writeHeld = writeHeldBy(r.thread);
+            writeHeld = locksets.without(writeHeld, r.object);
+            if (r.extra != kTraceNone)
+            {
+                shardFor(r.extra).events.push_back(
+                    ShardEvent{seq, r.extra, 0, r.thread, held, Op::VariableRelease, false});
+            }
+            break;
+        }
+
+        case TraceEventKind::VariableAccess:
+            shardFor(r.object).events.push_back(
+                ShardEvent{seq, r.object, 0, r.thread, protecting(r), Op::VariableAccess, (r.flags & 1) != 0});
+            break;
+
+        case TraceEventKind::MemoryAccess:
+        {
+            std::uint64_t first = r.object >> ShadowMemory::kGranuleShift;
+            std::uint64_t last = (r.object + (r.extra ? r.extra : 1) - 1) >> ShadowMemory::kGranuleShift;
+            // Granule keys are tagged so they never collide with variable ids.
+            for (std::uint64_t g = first; g <= last; ++g)
+            {
+                std::uint64_t key = g | (std::uint64_t(1) << 63);
+                shardFor(key).events.push_back(
+                    ShardEvent{seq, key, r.object, r.thread, protecting(r), Op::MemoryAccess, (r.flags & 1) != 0});
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    void flushChunk()
+    {
+        std::vector<std::function<void()>> tasks;
+        for (Shard &s : shards)
+        {
+            if (!s.events.empty())
+            {
+                Shard *shard = &s;
+                tasks.push_back([this, shard]() { shard->replay(locksets); });
+            }
+        }
+        pool.run(tasks);
+
+        std::vector<Report> reports;
+        for (Shard &s : shards)
+        {
+            reports.insert(reports.end(), s.reports.begin(), s.reports.end());
+            s.reports.clear();
+        }
+        std::sort(reports.begin(), reports.end());
+        std::uint64_t lastMemorySeq = 0;
+        for (const Report &r : reports)
+        {
+            if (r.memory)
+            {
+                // One report per access even if it spans several granules.
+                if (r.seq == lastMemorySeq)
+                {
+                    continue;
+                }
+                lastMemorySeq = r.seq;
+            }
+            // Repeats are counted but reported once, as online (RaceTable.h).
+            ++numOccurrences;
+            RaceKey race;
+            race.location = r.memory ? r.key : r.object;
+            race.thread = r.thread;
+            race.otherThread = r.other;
+            race.lockset = r.lockset;
+            race.otherLockset = r.otherLockset;
+            race.type = r.write ? AccessType::WRITE : AccessType::READ;
+            race.state = r.state;
+            race.kind = r.memory ? RaceKey::Memory : RaceKey::Variable;
+            if (raceTable.record(race) == RaceTable::Repeat)
+            {
+                continue;
+            }
+            if (r.memory)
+            {
+                std::printf("Data race detected between thread %d and thread %d on address 0x%llx\n",
+                            static_cast<int>(r.thread), static_cast<int>(r.other),
+                            static_cast<unsigned long long>(r.object));
+            }
+            else
+            {
+                auto name = names.find(static_cast<std::uint32_t>(r.object));
+                std::printf("Data race detected between thread %d and thread %d on shared variable %s\n",
+                            static_cast<int>(r.thread), static_cast<int>(r.other),
+                            name != names.end() ? name->second.c_str() : "?");
+            }
+            ++numRaces;
+        }
+    }
+
+    void resetAll(bool restart)
+    {
+        for (Shard &s : shards)
+        {
+            // Barriers return shadow cells to Virgin (ShadowMemory::clear).
+            s.cells.clear();
+            if (restart)
+            {
+                s.variables.clear();
+            }
+        }
+        if (restart)
+        {
+            registered.clear();
+            raceTable.clear();
+            return;
+        }
+        for (std::uint64_t v : registered)
+        {
+            // As SharedVariable::clean: C(v) starts over, retirement stays.
+            VariableState &state = shardFor(v).variables[v];
+            state.state = State::Clean;
+            state.candidates = kAllLocks;
+        }
+    }
+
+    WorkStealingPool pool;
+    std::vector<Shard> shards;
+    std::size_t chunkEvents;
+    std::uint64_t seq;
+    std::uint64_t numRaces;
+    std::uint64_t numOccurrences;
+    const std::unordered_map<std::uint32_t, std::string> &names;
+    RaceTable raceTable;
+
+    LocksetInterner locksets;
+    std::unordered_map<std::uint32_t, std::uint32_t> locksetOf;
+    std::unordered_map<std::uint32_t, std::uint32_t> writeLocksetOf;
+    std::unordered_map<std::uint64_t, std::uint32_t> holder;
+    std::unordered_set<std::uint64_t> registered;
+};
+
+void usage()
+{
+    std::fprintf(stderr, "usage: lockset-analyze [-j threads] [-c chunk-events] <trace-dir>\n");
+    std::exit(2);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t chunkEvents = std::size_t(1) << 20;
+    std::string directory;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            workers = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            chunkEvents = static_cast<std::size_t>(std::max(1L, std::atol(argv[++i])));
+        }
+        else if (directory.empty() && argv[i][0] != '-')
+        {
+            directory = argv[i];
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (directory.empty())
+    {
+        usage();
+    }
+
+    std::unordered_map<std::uint32_t, std::string> names = readNames(directory);
+    TraceMerger merger(directory);
+    Analyzer analyzer(workers, chunkEvents, names);
+    analyzer.run(merger);
+
+    std::fflush(stdout);
+    std::fprintf(stderr, "%llu events from %zu writers, %llu data races (%llu occurrences)\n",
+                 static_cast<unsigned long long>(analyzer.events()), merger.writerCount(),
+                 static_cast<unsigned long long>(analyzer.races()),
+                 static_cast<unsigned long long>(analyzer.occurrences()));
+    return 0;
+}
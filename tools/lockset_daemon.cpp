@@ -0,0 +1,346 @@
+/**
+ * @file lockset_daemon.cpp
+ * @brief Out-of-process race detection for programs in DetectorMode::Stream
+ *
+ * The daemon creates the shared-memory rings (see ShmChannel.h) and replays
+ * the events producers push into them into its own DataRaceDetector, mapping
+ * the producers' thread, lock and variable ids to local objects. Rings are
+ * merged by timestamp. An event is held back while a producer ring with
+ * nothing pending could still deliver an older one, for at most a short
+ * slack window, so a stalled thread cannot hold up the rest for long.
+ *
+ * The daemon exits once every producer that attached has detached and the
+ * rings are empty, or on SIGINT/SIGTERM.
+ *
+ * Usage: lockset-daemon [-r rings] [-n capacity] [-b block|drop|spill] [-s spill-dir] <name>
+ */
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include "../include/DataRaceDetector.h"
+#include "../include/Logger.h"
+#include "../include/ShmChannel.h"
+#include "../include/TraceRecorder.h"
+
+namespace
+{
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void onSignal(int)
+{
+    stopRequested = 1;
+}
+
+/// Events from a ring are held back at most this long waiting for older ones.
+const int kSlackMicroseconds = 2000;
+
+std::uint64_t slackTicks()
+{
+    if (TraceRecorder::clock() == TraceClock::SteadyNanoseconds)
+    {
+        return std::uint64_t(kSlackMicroseconds) * 1000;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t ticks = TraceRecorder::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ticks = TraceRecorder::now() - ticks;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<std::uint64_t>(ticks / us * kSlackMicroseconds);
+}
+
+/// Replays producer events into a local detector.
+class Replayer
+{
+public:
+    explicit Replayer(ShmChannelServer &server) : server(server), events(0), races(0) {}
+
+    void apply(const TraceRecord &r)
+    {
+        ++events;
+        switch (static_cast<TraceEventKind>(r.kind))
+        {
+        case TraceEventKind::ThreadRegister:
+            detector.registerThread(thread(r.thread));
+            break;
+        case TraceEventKind::ThreadUnregister:
+            // The detector keeps its own copy of the final locksets.
+            detector.unregisterThread(thread(r.thread));
+            threads.erase(r.thread);
+            break;
+        case TraceEventKind::VariableRegister:
+            detector.registerSharedVariable(variable(static_cast<std::uint32_t>(r.object)));
+            break;
+        case TraceEventKind::LockAcquire:
+            if (r.extra == kTraceNone)
+            {
+                detector.onLockAcquire(thread(r.thread), lock(r.object), r.flags != 0);
+            }
+            else
+            {
+                detector.onLockAcquire(thread(r.thread), lock(r.object), r.flags != 0, variable(r.extra));
+            }
+            break;
+        case TraceEventKind::LockRelease:
+            if (r.extra == kTraceNone)
+            {
+                detector.onLockRelease(thread(r.thread), lock(r.object));
+            }
+            else
+            {
+                detector.onLockRelease(thread(r.thread), lock(r.object), variable(r.extra));
+            }
+            break;
+        case TraceEventKind::VariableAccess:
+            detector.onSharedVariableAccess(thread(r.thread), variable(static_cast<std::uint32_t>(r.object)),
+                                            static_cast<AccessType>(r.flags));
+            break;
+        case TraceEventKind::MemoryAccess:
+            detector.onMemoryAccess(thread(r.thread), reinterpret_cast<const void *>(r.object), r.extra,
+                                    static_cast<AccessType>(r.flags));
+            break;
+        case TraceEventKind::BarrierReset:
+            detector.onBarrierReset();
+            break;
+        case TraceEventKind::MainStart:
+            // A new run in the producer: start from fresh objects, as it does.
+            races += detector.getNumDataRaces();
+            detector.locksetMainStart();
+            variables.clear();
+            locks.clear();
+            threads.clear();
+            break;
+        case TraceEventKind::MainEnd:
+            detector.locksetMainEnd();
+            break;
+        default:
+            break;
+        }
+    }
+
+    std::uint64_t eventCount() const { return events; }
+    std::uint64_t raceCount() const { return races + detector.getNumDataRaces(); }
+
+private:
+    Thread *thread(std::uint32_t id)
+    {
+        std::unique_ptr<Thread> &t = threads[id];
+        if (!t)
+        {
+            t.reset(new Thread(static_cast<int>(id)));
+        }
+        return t.get();
+    }
+
+    Lock *lock(std::uint64_t id)
+    {
+        std::unique_ptr<Lock> &l = locks[id];
+        if (!l)
+        {
+            l.reset(new Lock(static_cast<int>(id)));
+        }
+        return l.get();
+    }
+
+    SharedVariable *variable(std::uint32_t id)
+    {
+        std::unique_ptr<SharedVariable> &v = variables[id];
+        if (!v)
+        {
+            v.reset(new SharedVariable(server.nameOf(id)));
+        }
+        return v.get();
+    }
+
+    ShmChannelServer &server;
+    std::unordered_map<std::uint32_t, std::unique_ptr<SharedVariable>> variables;
+    std::unordered_map<std::uint64_t, std::unique_ptr<Lock>> locks;
+    std::unordered_map<std::uint32_t, std::unique_ptr<Thread>> threads;
+    // Declared last so it is destroyed before the objects it refers to.
+    DataRaceDetector detector;
+    std::uint64_t events;
+    std::uint64_t races;
+};
+
+void removeSpillFiles(const std::string &directory)
+{
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+    {
+        return;
+    }
+    while (dirent *entry = readdir(dir))
+    {
+        if (std::strncmp(entry->d_name, "spill-", 6) == 0)
+        {
+            ::unlink((directory + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "usage: lockset-daemon [-r rings] [-n capacity] [-b block|drop|spill] [-s spill-dir] <name>\n");
+    std::exit(2);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::uint32_t rings = 64;
+    std::uint32_t capacity = 1u << 16;
+    Backpressure backpressure = Backpressure::Block;
+    std::string spillDirectory = "/tmp";
+    std::string name;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            rings = static_cast<std::uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            capacity = static_cast<std::uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode == "block")
+            {
+                backpressure = Backpressure::Block;
+            }
+            else if (mode == "drop")
+            {
+                backpressure = Backpressure::Drop;
+            }
+            else if (mode == "spill")
+            {
+                backpressure = Backpressure::Spill;
+            }
+            else
+            {
+                usage();
+            }
+        }
+        else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            spillDirectory = argv[++i];
+        }
+        else if (name.empty() && argv[i][0] != '-')
+        {
+            name = argv[i];
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (name.empty())
+    {
+        usage();
+    }
+
+    ShmChannelServer server;
+    if (!server.create(name, rings, capacity, backpressure, spillDirectory))
+    {
+        std::fprintf(stderr, "lockset-daemon: cannot create shared memory %s "
+                             "(capacity must be a power of two)\n", name.c_str());
+        return 1;
+    }
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    Logger::setLevel(LogLevel::Race);
+
+    ShmControl *ctl = server.control();
+    const std::uint64_t slack = slackTicks();
+    std::vector<std::deque<TraceRecord>> pending(rings);
+    Replayer replayer(server);
+
+    while (!stopRequested)
+    {
+        // Read before draining: once every producer has detached, their
+        // rings are closed and whatever they pushed is visible.
+        bool finished = ctl->producers.load(std::memory_order_acquire) > 0 &&
+                        ctl->activeProducers.load(std::memory_order_acquire) == 0;
+        bool progress = false;
+        for (std::uint32_t i = 0; i < rings; ++i)
+        {
+            if (server.drain(i, pending[i], capacity))
+            {
+                progress = true;
+            }
+        }
+
+        std::uint64_t horizon = TraceRecorder::now() - slack;
+        for (;;)
+        {
+            std::uint32_t next = rings;
+            for (std::uint32_t i = 0; i < rings; ++i)
+            {
+                if (!pending[i].empty() &&
+                    (next == rings || pending[i].front().timestamp < pending[next].front().timestamp))
+                {
+                    next = i;
+                }
+            }
+            if (next == rings)
+            {
+                break;
+            }
+            const TraceRecord &r = pending[next].front();
+            bool mayHaveOlder = false;
+            for (std::uint32_t i = 0; i < rings && r.timestamp > horizon && !finished; ++i)
+            {
+                mayHaveOlder = pending[i].empty() &&
+                               ctl->ring(i)->state.load(std::memory_order_acquire) == ShmRing::Active;
+                if (mayHaveOlder)
+                {
+                    break;
+                }
+            }
+            if (mayHaveOlder)
+            {
+                break;
+            }
+            replayer.apply(r);
+            pending[next].pop_front();
+            progress = true;
+        }
+
+        if (finished && !progress)
+        {
+            break;
+        }
+        if (!progress)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    Logger::flush();
+    std::fflush(stdout);
+    if (backpressure == Backpressure::Spill)
+    {
+        removeSpillFiles(spillDirectory);
+    }
+    std::fprintf(stderr, "%llu events from %u producers, %llu data races, %llu events dropped\n",
+                 static_cast<unsigned long long>(replayer.eventCount()),
+                 ctl->producers.load(std::memory_order_relaxed),
+                 static_cast<unsigned long long>(replayer.raceCount()),
+                 static_cast<unsigned long long>(server.droppedRecords()));
+    return 0;
+}
@@ -0,0 +1,569 @@
+/**
+ * @file lockset_preload.cpp
+ * @brief LD_PRELOAD library that drives a detector from a program's pthread calls
+ *
+ * Built as liblockset_preload.so. Loaded into an unmodified program with
+ *
+ *   LD_PRELOAD=./liblockset_preload.so ./program
+ *
+ * it interposes the pthread mutex, rwlock, barrier, create and join calls
+ * and reports them to a process-wide detector:
+ *
+ * - Every pthread_mutex_t and pthread_rwlock_t is mapped to a Lock by
+ *   address through an AddressMap (see AddressMap.h), created on first
+ *   use and destroyed by pthread_mutex_destroy or pthread_rwlock_destroy.
+ *   Read locks are acquired with writeMode false. The map grows with the
+ *   number of live locks; if it cannot, the first lock left untracked is
+ *   reported on stderr.
+ * - Threads are registered on their first event through thread_local
+ *   state. Threads started with pthread_create are unregistered when
+ *   their start routine returns or they call pthread_exit, and the
+ *   accesses to their stack are forgotten.
+ * - The last thread to arrive at a barrier resets the variables, as the
+ *   detector's own barrierWait does. The arrival count is taken from the
+ *   interposed pthread_barrier_init.
+ * - With LOCKSET_ENGINE=hybrid, create and join are happens-before edges.
+ *
+ * Memory accesses are not visible to the library. Programs report them
+ * through lockset_preload_access (see LocksetPreload.h); locks and
+ * threads are tracked either way. The detector uses ProductionPolicy, so
+ * races are logged and nothing else; a summary goes to stderr at exit.
+ *
+ * Calls made while the library itself runs, including those from the
+ * detector's mutexes and from threads the detector starts, go straight
+ * to the real functions. A lock or unlock costs the real call, one
+ * thread_local load, an address-map probe and the detector callback.
+ * The library is linked with hidden visibility and initial-exec TLS, so
+ * the detector's own calls and thread_locals cost what they do in a
+ * program linked with it statically.
+ *
+ * Known limits: a mutex re-locked recursively is released from the
+ * lockset by its first unlock, a pthread_cond_wait keeps its mutex in
+ * the lockset while waiting, and a lock freed without being destroyed
+ * and reallocated at the same address stays the same Lock.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <dlfcn.h>
+#include <time.h>
+#include "../include/Logger.h"
+#include "../include/LocksetPreload.h"
+#include "PreloadRuntime.h"
+
+namespace lockset_preload
+{
+
+std::atomic<int> initState(Uninitialized);
+alignas(Preload) unsigned char storage[sizeof(Preload)];
+__thread PreloadThread self __attribute__((tls_model("initial-exec"))) = {nullptr, false};
+
+Thread *attach(int id)
+{
+    Thread *t = preload().detector.registerThread(id);
+    self.thread = t;
+    return t;
+}
+
+} // namespace lockset_preload
+
+using namespace lockset_preload;
+
+namespace
+{
+
+/// The real pthread functions, resolved with RTLD_NEXT.
+struct RealFunctions
+{
+    int (*mutexLock)(pthread_mutex_t *);
+    int (*mutexTrylock)(pthread_mutex_t *);
+    int (*mutexTimedlock)(pthread_mutex_t *, const struct timespec *);
+    int (*mutexUnlock)(pthread_mutex_t *);
+    int (*rdlock)(pthread_rwlock_t *);
+    int (*tryrdlock)(pthread_rwlock_t *);
+    int (*timedrdlock)(pthread_rwlock_t *, const struct timespec *);
+    int (*wrlock)(pthread_rwlock_t *);
+    int (*trywrlock)(pthread_rwlock_t *);
+    int (*timedwrlock)(pthread_rwlock_t *, const struct timespec *);
+    int (*mutexDestroy)(pthread_mutex_t *);
+    int (*rwlockUnlock)(pthread_rwlock_t *);
+    int (*rwlockDestroy)(pthread_rwlock_t *);
+    int (*barrierInit)(pthread_barrier_t *, const pthread_barrierattr_t *, unsigned);
+    int (*barrierWait)(pthread_barrier_t *);
+    int (*barrierDestroy)(pthread_barrier_t *);
+    int (*create)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+    int (*join)(pthread_t, void **);
+};
+
+RealFunctions real;
+
+template <typename F>
+void resolve(F &f, const char *name)
+{
+    f = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+    if (!f)
+    {
+        std::fprintf(stderr, "lockset_preload: cannot resolve %s\n", name);
+        std::abort();
+    }
+}
+
+void resolveReal()
+{
+    // Resolved last: wrappers test it to see whether the table is complete.
+    resolve(real.mutexTrylock, "pthread_mutex_trylock");
+    resolve(real.mutexTimedlock, "pthread_mutex_timedlock");
+    resolve(real.mutexUnlock, "pthread_mutex_unlock");
+    resolve(real.mutexDestroy, "pthread_mutex_destroy");
+    resolve(real.rdlock, "pthread_rwlock_rdlock");
+    resolve(real.tryrdlock, "pthread_rwlock_tryrdlock");
+    resolve(real.timedrdlock, "pthread_rwlock_timedrdlock");
+    resolve(real.wrlock, "pthread_rwlock_wrlock");
+    resolve(real.trywrlock, "pthread_rwlock_trywrlock");
+    resolve(real.timedwrlock, "pthread_rwlock_timedwrlock");
+    resolve(real.rwlockUnlock, "pthread_rwlock_unlock");
+    resolve(real.rwlockDestroy, "pthread_rwlock_destroy");
+    resolve(real.barrierInit, "pthread_barrier_init");
+    resolve(real.barrierWait, "pthread_barrier_wait");
+    resolve(real.barrierDestroy, "pthread_barrier_destroy");
+    resolve(real.create, "pthread_create");
+    resolve(real.join, "pthread_join");
+    resolve(real.mutexLock, "pthread_mutex_lock");
+}
+
+const RealFunctions &next()
+{
+    if (!real.mutexLock)
+    {
+        resolveReal();
+    }
+    return real;
+}
+
+/// Reports the first object a full map leaves untracked.
+void reportFull(std::atomic<bool> &full, const char *kind, std::size_t size)
+{
+    if (!full.exchange(true, std::memory_order_relaxed))
+    {
+        std::fprintf(stderr, "lockset_preload: %s map full at %zu entries; further %ss are not tracked\n", kind,
+                     size, kind);
+    }
+}
+
+Lock *lockFor(const void *address)
+{
+    Preload &p = preload();
+    Lock *l = p.locks.find(address);
+    if (l)
+    {
+        return l;
+    }
+    Inside guard;
+    l = p.locks.findOrCreate(address, [&p] {
+        return p.detector.createLock(p.nextLockId.fetch_add(1, std::memory_order_relaxed));
+    });
+    if (!l)
+    {
+        reportFull(p.locksFull, "lock", p.locks.size());
+    }
+    return l;
+}
+
+/// Forgets the Lock of a destroyed mutex or rwlock.
+void destroyed(const void *address)
+{
+    if (self.inside || initState.load(std::memory_order_acquire) != Ready)
+    {
+        return;
+    }
+    Inside guard;
+    Preload &p = preload();
+    if (Lock *l = p.locks.remove(address))
+    {
+        p.detector.destroyLock(l);
+    }
+}
+
+void acquired(const void *address, bool writeMode)
+{
+    Thread *t = caller();
+    if (!t)
+    {
+        return;
+    }
+    if (Lock *l = lockFor(address))
+    {
+        Inside guard;
+        preload().detector.onLockAcquire(t, l, writeMode);
+    }
+}
+
+void releasing(const void *address)
+{
+    Thread *t = caller();
+    if (!t)
+    {
+        return;
+    }
+    if (Lock *l = preload().locks.find(address))
+    {
+        Inside guard;
+        preload().detector.onLockRelease(t, l);
+    }
+}
+
+} // namespace
+
+__attribute__((constructor)) void lockset_preload::initialize()
+{
+    int expected = Uninitialized;
+    if (!initState.compare_exchange_strong(expected, Initializing))
+    {
+        return;
+    }
+    next();
+    self.inside = true;
+    Preload *p = new (storage) Preload();
+    const char *engine = std::getenv("LOCKSET_ENGINE");
+    if (engine && std::strcmp(engine, "hybrid") == 0)
+    {
+        p->hybrid = true;
+        p->detector.setEngine(DetectorEngine::Hybrid);
+    }
+    p->detector.locksetMainStart();
+    attach(p->nextThreadId.fetch_add(1, std::memory_order_relaxed));
+    self.inside = false;
+    initState.store(Ready, std::memory_order_release);
+}
+
+namespace
+{
+
+__attribute__((destructor)) void summarize()
+{
+    if (initState.load(std::memory_order_acquire) != Ready)
+    {
+        return;
+    }
+    self.inside = true;
+    Preload &p = preload();
+    Logger::flush();
+    std::fprintf(stderr, "lockset_preload: %llu data races (%llu racing accesses), %zu locks, %d threads\n",
+                 static_cast<unsigned long long>(p.detector.getNumDataRaces()),
+                 static_cast<unsigned long long>(p.detector.getNumRaceOccurrences()), p.locks.size(),
+                 p.nextThreadId.load(std::memory_order_relaxed) - 1);
+}
+
+/// What pthread_create hands the trampoline.
+struct StartArgs
+{
+    void *(*routine)(void *);
+    void *arg;
+    int id;
+    bool untracked;
+};
+
+/// Unregisters the thread when its start routine returns or unwinds.
+class ThreadExit
+{
+public:
+    ~ThreadExit()
+    {
+        self.inside = true;
+        if (self.thread)
+        {
+            // Later threads may get the same stack; forget the accesses to it.
+            pthread_attr_t attr;
+            if (pthread_getattr_np(pthread_self(), &attr) == 0)
+            {
+                void *stack;
+                std::size_t size;
+                if (pthread_attr_getstack(&attr, &stack, &size) == 0)
+                {
+                    preload().detector.onMemoryFree(stack, size);
+                }
+                pthread_attr_destroy(&attr);
+            }
+            preload().detector.unregisterThread(self.thread);
+            self.thread = nullptr;
+        }
+    }
+};
+
+void *trampoline(void *p)
+{
+    StartArgs args = *static_cast<StartArgs *>(p);
+    // Inside first: an interposed free would otherwise attach the thread.
+    self.inside = true;
+    delete static_cast<StartArgs *>(p);
+    if (args.untracked)
+    {
+        return args.routine(args.arg);
+    }
+    attach(args.id);
+    self.inside = false;
+    ThreadExit onExit;
+    return args.routine(args.arg);
+}
+
+} // namespace
+
+extern "C" {
+
+LOCKSET_EXPORT int pthread_mutex_lock(pthread_mutex_t *m)
+{
+    int result = next().mutexLock(m);
+    if (result == 0)
+    {
+        acquired(m, true);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_mutex_trylock(pthread_mutex_t *m)
+{
+    int result = next().mutexTrylock(m);
+    if (result == 0)
+    {
+        acquired(m, true);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_mutex_timedlock(pthread_mutex_t *m, const struct timespec *abstime)
+{
+    int result = next().mutexTimedlock(m, abstime);
+    if (result == 0)
+    {
+        acquired(m, true);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_mutex_unlock(pthread_mutex_t *m)
+{
+    releasing(m);
+    return next().mutexUnlock(m);
+}
+
+LOCKSET_EXPORT int pthread_mutex_destroy(pthread_mutex_t *m)
+{
+    // A locked mutex is not destroyed (EBUSY) and keeps its Lock.
+    int result = next().mutexDestroy(m);
+    if (result == 0)
+    {
+        destroyed(m);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_rwlock_rdlock(pthread_rwlock_t *l)
+{
+    int result = next().rdlock(l);
+    if (result == 0)
+    {
+        acquired(l, false);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_rwlock_tryrdlock(pthread_rwlock_t *l)
+{
+    int result = next().tryrdlock(l);
+    if (result == 0)
+    {
+        acquired(l, false);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_rwlock_timedrdlock(pthread_rwlock_t *l, const struct timespec *abstime)
+{
+    int result = next().timedrdlock(l, abstime);
+    if (result == 0)
+    {
+        acquired(l, false);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_rwlock_wrlock(pthread_rwlock_t *l)
+{
+    int result = next().wrlock(l);
+    if (result == 0)
+    {
+        acquired(l, true);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_rwlock_trywrlock(pthread_rwlock_t *l)
+{
+    int result = next().trywrlock(l);
+    if (result == 0)
+    {
+        acquired(l, true);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_rwlock_timedwrlock(pthread_rwlock_t *l, const struct timespec *abstime)
+{
+    int result = next().timedwrlock(l, abstime);
+    if (result == 0)
+    {
+        acquired(l, true);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_rwlock_unlock(pthread_rwlock_t *l)
+{
+    releasing(l);
+    return next().rwlockUnlock(l);
+}
+
+LOCKSET_EXPORT int pthread_rwlock_destroy(pthread_rwlock_t *l)
+{
+    int result = next().rwlockDestroy(l);
+    if (result == 0)
+    {
+        destroyed(l);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_barrier_init(pthread_barrier_t *b, const pthread_barrierattr_t *attr, unsigned count)
+{
+    int result = next().barrierInit(b, attr, count);
+    if (result == 0 && !self.inside && initState.load(std::memory_order_acquire) == Ready)
+    {
+        Inside guard;
+        Preload &p = preload();
+        BarrierState *state = p.barriers.findOrCreate(b, [] { return new BarrierState(); });
+        if (state)
+        {
+            // A barrier initialized again at the same address starts over.
+            state->count.store(count, std::memory_order_relaxed);
+            state->arrivals.store(0, std::memory_order_relaxed);
+        }
+        else
+        {
+            reportFull(p.barriersFull, "barrier", p.barriers.size());
+        }
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_barrier_wait(pthread_barrier_t *b)
+{
+    if (caller())
+    {
+        BarrierState *state = preload().barriers.find(b);
+        if (state && state->arrivals.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+                         state->count.load(std::memory_order_relaxed))
+        {
+            // Every other thread is blocked in the real wait until we arrive.
+            state->arrivals.store(0, std::memory_order_relaxed);
+            Inside guard;
+            preload().detector.onBarrierReset();
+        }
+    }
+    return next().barrierWait(b);
+}
+
+LOCKSET_EXPORT int pthread_barrier_destroy(pthread_barrier_t *b)
+{
+    int result = next().barrierDestroy(b);
+    if (result == 0 && !self.inside && initState.load(std::memory_order_acquire) == Ready)
+    {
+        Inside guard;
+        delete preload().barriers.remove(b);
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*routine)(void *), void *arg)
+{
+    Thread *parent = caller();
+    bool untracked = self.inside || initState.load(std::memory_order_acquire) != Ready;
+    if (untracked && !self.inside)
+    {
+        // Before initialization: nothing to set up, start the thread as is.
+        return next().create(thread, attr, routine, arg);
+    }
+
+    Preload &p = preload();
+    StartArgs *args = new StartArgs{routine, arg, 0, untracked};
+    if (parent)
+    {
+        Inside guard;
+        args->id = p.nextThreadId.fetch_add(1, std::memory_order_relaxed);
+        if (p.hybrid)
+        {
+            p.detector.onThreadFork(parent, args->id);
+        }
+    }
+    int id = args->id;
+    int result = next().create(thread, attr, trampoline, args);
+    if (result != 0)
+    {
+        delete args;
+        return result;
+    }
+    if (parent && p.hybrid)
+    {
+        Inside guard;
+        std::lock_guard<std::mutex> lock(p.childrenMutex);
+        p.children[*thread] = id;
+    }
+    return result;
+}
+
+LOCKSET_EXPORT int pthread_join(pthread_t thread, void **retval)
+{
+    int result = next().join(thread, retval);
+    Thread *t = caller();
+    if (result == 0 && t && preload().hybrid)
+    {
+        Preload &p = preload();
+        Inside guard;
+        int child = 0;
+        {
+            std::lock_guard<std::mutex> lock(p.childrenMutex);
+            auto it = p.children.find(thread);
+            if (it != p.children.end())
+            {
+                child = it->second;
+                p.children.erase(it);
+            }
+        }
+        if (child)
+        {
+            p.detector.onThreadJoin(t, child);
+        }
+    }
+    return result;
+}
+
+LOCKSET_EXPORT void lockset_preload_access(const void *addr, size_t size, int isWrite)
+{
+    if (Thread *t = caller())
+    {
+        Inside guard;
+        preload().detector.onMemoryAccess(t, addr, size, isWrite ? AccessType::WRITE : AccessType::READ);
+    }
+}
+
+LOCKSET_EXPORT unsigned long long lockset_preload_races(void)
+{
+    if (initState.load(std::memory_order_acquire) != Ready)
+    {
+        return 0;
+    }
+    return preload().detector.getNumDataRaces();
+}
+
+} // extern "C"
@@ -0,0 +1,241 @@
+/**
+ * @file lockset_tsan.cpp
+ * @brief ThreadSanitizer instrumentation ABI on top of the lockset engine
+ *
+ * Built, together with lockset_preload.cpp, as liblockset_tsan.so. Code
+ * compiled with -fsanitize=thread calls __tsan_read4, __tsan_write8 and
+ * so on for every memory access. Objects compiled that way and linked
+ * against this library instead of libtsan are checked by the detector's
+ * onMemoryAccess state machine:
+ *
+ *   g++ -O2 -fsanitize=thread -c app.cpp
+ *   g++ app.o -L. -llockset_tsan -Wl,-rpath,. -o app
+ *
+ * Lock, barrier and thread events come from the pthread wrappers of
+ * lockset_preload.cpp, which the library also contains. The library
+ * replaces free and realloc as well. Freed blocks, and the stacks of
+ * exited threads, are forgotten, so memory that is reused does not race
+ * with its previous owner.
+ *
+ * An access is the call from the instrumented code, a thread_local test
+ * and onMemoryAccess on the shadow cells; nothing is allocated unless the
+ * access races. The entry points differ only in the size and access type
+ * they pass, so each is one inlined copy of that path.
+ *
+ * What the lockset engine does with the rest of the ABI:
+ * - __tsan_func_entry/exit are accepted and ignored. Races are reported
+ *   by address, not by stack.
+ * - Atomic operations are performed, always sequentially consistent, and
+ *   are not reported as accesses. An atomic orders nothing for the
+ *   lockset engine, so data published through an atomic flag rather than
+ *   a lock is still reported. The 128-bit atomics are not provided.
+ * - A vptr store counts as a write only if it changes the vptr, as in
+ *   ThreadSanitizer.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <malloc.h>
+#include "PreloadRuntime.h"
+
+using namespace lockset_preload;
+
+extern "C" {
+void __libc_free(void *p);
+void *__libc_realloc(void *p, std::size_t size);
+}
+
+namespace
+{
+
+inline __attribute__((always_inline)) void access(const void *addr, std::size_t size, AccessType type)
+{
+    if (Thread *t = caller())
+    {
+        Inside guard;
+        preload().detector.onMemoryAccess(t, addr, size, type);
+    }
+}
+
+inline void forget(void *p, std::size_t size)
+{
+    if (p && caller())
+    {
+        Inside guard;
+        preload().detector.onMemoryFree(p, size);
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+LOCKSET_EXPORT void __tsan_init()
+{
+    initialize();
+}
+
+LOCKSET_EXPORT void __tsan_func_entry(void *)
+{
+}
+
+LOCKSET_EXPORT void __tsan_func_exit()
+{
+}
+
+LOCKSET_EXPORT void __tsan_ignore_thread_begin()
+{
+    self.inside = true;
+}
+
+LOCKSET_EXPORT void __tsan_ignore_thread_end()
+{
+    self.inside = false;
+}
+
+// Plain, unaligned, volatile and _pc variants of every access size
+#define LOCKSET_TSAN_ACCESS(size)                                                                   \
+    LOCKSET_EXPORT void __tsan_read##size(void *addr) { access(addr, size, AccessType::READ); }    \
+    LOCKSET_EXPORT void __tsan_write##size(void *addr) { access(addr, size, AccessType::WRITE); }  \
+    LOCKSET_EXPORT void __tsan_unaligned_read##size(const void *addr)                               \
+    {                                                                                               \
+        access(addr, size, AccessType::READ);                                                       \
+    }                                                                                               \
+    LOCKSET_EXPORT void __tsan_unaligned_write##size(void *addr)                                    \
+    {                                                                                               \
+        access(addr, size, AccessType::WRITE);                                                      \
+    }                                                                                               \
+    LOCKSET_EXPORT void __tsan_volatile_read##size(void *addr) { access(addr, size, AccessType::READ); } \
+    LOCKSET_EXPORT void __tsan_volatile_write##size(void *addr)                                     \
+    {                                                                                               \
+        access(addr, size, AccessType::WRITE);                                                      \
+    }                                                                                               \
+    LOCKSET_EXPORT void __tsan_read##size##_pc(void *addr, void *) { access(addr, size, AccessType::READ); } \
+    LOCKSET_EXPORT void __tsan_write##size##_pc(void *addr, void *)                                 \
+    {                                                                                               \
+        access(addr, size, AccessType::WRITE);                                                      \
+    }
+
+LOCKSET_TSAN_ACCESS(1)
+LOCKSET_TSAN_ACCESS(2)
+LOCKSET_TSAN_ACCESS(4)
+LOCKSET_TSAN_ACCESS(8)
+LOCKSET_TSAN_ACCESS(16)
+
+#undef LOCKSET_TSAN_ACCESS
+
+LOCKSET_EXPORT void __tsan_read_range(void *addr, unsigned long size)
+{
+    access(addr, size, AccessType::READ);
+}
+
+LOCKSET_EXPORT void __tsan_write_range(void *addr, unsigned long size)
+{
+    access(addr, size, AccessType::WRITE);
+}
+
+LOCKSET_EXPORT void __tsan_vptr_read(void **)
+{
+}
+
+LOCKSET_EXPORT void __tsan_vptr_update(void **vptr, void *value)
+{
+    if (*vptr != value)
+    {
+        access(vptr, sizeof *vptr, AccessType::WRITE);
+    }
+}
+
+// Atomics of one width; the memory orders are ignored in favour of seq_cst
+#define LOCKSET_TSAN_ATOMIC(bits, type)                                                             \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_load(const volatile type *a, int)                     \
+    {                                                                                               \
+        return __atomic_load_n(a, __ATOMIC_SEQ_CST);                                                \
+    }                                                                                               \
+    LOCKSET_EXPORT void __tsan_atomic##bits##_store(volatile type *a, type v, int)                  \
+    {                                                                                               \
+        __atomic_store_n(a, v, __ATOMIC_SEQ_CST);                                                   \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_exchange(volatile type *a, type v, int)               \
+    {                                                                                               \
+        return __atomic_exchange_n(a, v, __ATOMIC_SEQ_CST);                                         \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_fetch_add(volatile type *a, type v, int)              \
+    {                                                                                               \
+        return __atomic_fetch_add(a, v, __ATOMIC_SEQ_CST);                                          \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_fetch_sub(volatile type *a, type v, int)              \
+    {                                                                                               \
+        return __atomic_fetch_sub(a, v, __ATOMIC_SEQ_CST);                                          \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_fetch_and(volatile type *a, type v, int)              \
+    {                                                                                               \
+        return __atomic_fetch_and(a, v, __ATOMIC_SEQ_CST);                                          \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_fetch_or(volatile type *a, type v, int)               \
+    {                                                                                               \
+        return __atomic_fetch_or(a, v, __ATOMIC_SEQ_CST);                                           \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_fetch_xor(volatile type *a, type v, int)              \
+    {                                                                                               \
+        return __atomic_fetch_xor(a, v, __ATOMIC_SEQ_CST);                                          \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_fetch_nand(volatile type *a, type v, int)             \
+    {                                                                                               \
+        return __atomic_fetch_nand(a, v, __ATOMIC_SEQ_CST);                                         \
+    }                                                                                               \
+    LOCKSET_EXPORT int __tsan_atomic##bits##_compare_exchange_strong(volatile type *a, type *c,     \
+                                                                     type v, int, int)              \
+    {                                                                                               \
+        return __atomic_compare_exchange_n(a, c, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);    \
+    }                                                                                               \
+    LOCKSET_EXPORT int __tsan_atomic##bits##_compare_exchange_weak(volatile type *a, type *c,       \
+                                                                   type v, int, int)                \
+    {                                                                                               \
+        return __atomic_compare_exchange_n(a, c, v, true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);     \
+    }                                                                                               \
+    LOCKSET_EXPORT type __tsan_atomic##bits##_compare_exchange_val(volatile type *a, type c,        \
+                                                                   type v, int, int)                \
+    {                                                                                               \
+        __atomic_compare_exchange_n(a, &c, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);          \
+        return c;                                                                                   \
+    }
+
+LOCKSET_TSAN_ATOMIC(8, char)
+LOCKSET_TSAN_ATOMIC(16, short)
+LOCKSET_TSAN_ATOMIC(32, int)
+LOCKSET_TSAN_ATOMIC(64, long long)
+
+#undef LOCKSET_TSAN_ATOMIC
+
+LOCKSET_EXPORT void __tsan_atomic_thread_fence(int)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+LOCKSET_EXPORT void __tsan_atomic_signal_fence(int)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+LOCKSET_EXPORT void free(void *p)
+{
+    if (p)
+    {
+        forget(p, malloc_usable_size(p));
+    }
+    __libc_free(p);
+}
+
+LOCKSET_EXPORT void *realloc(void *p, std::size_t size)
+{
+    std::size_t old = p ? malloc_usable_size(p) : 0;
+    void *moved = __libc_realloc(p, size);
+    if (moved && p && moved != p)
+    {
+        forget(p, old);
+    }
+    return moved;
+}
+
+} // extern "C"